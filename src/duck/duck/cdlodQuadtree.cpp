@@ -0,0 +1,231 @@
+#include "cdlodQuadtree.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <xmmintrin.h>
+
+using namespace mini::gk2;
+using namespace DirectX;
+
+namespace
+{
+	//part of the LOD range in which vertices morph towards the next level
+	constexpr float MORPH_REGION = 0.35f;
+
+	float BoxDistanceSq(float x, float z, float size, const XMFLOAT3& p)
+	{
+		float dx = std::max({ x - p.x, 0.0f, p.x - (x + size) });
+		float dz = std::max({ z - p.z, 0.0f, p.z - (z + size) });
+		return dx * dx + p.y * p.y + dz * dz;
+	}
+}
+
+CdlodQuadtree::CdlodQuadtree(float extent, int levels, float lodDistance, float normalStep)
+	: m_extent(extent), m_levels(levels), m_maxNodes(size_t(1) << 2 * (levels - 1)), m_normalStep(normalStep), m_ranges(levels),
+	m_vertexCount(0), m_x(maxVertexCount()), m_z(maxVertexCount()), m_h(maxVertexCount()),
+	m_xStep(maxVertexCount()), m_zStep(maxVertexCount()), m_hx(maxVertexCount()), m_hz(maxVertexCount())
+{
+	m_selected.reserve(m_maxNodes);
+
+	for (int l = 0; l < levels; l++)
+	{
+		m_ranges[l] = lodDistance * static_cast<float>(1 << l);
+	}
+
+	const int resolutions[2] = { PATCH_RESOLUTION, HALF_PATCH_RESOLUTION };
+	for (int p = 0; p < 2; p++)
+	{
+		for (int j = 0; j < resolutions[p]; j++)
+		{
+			for (int i = 0; i < resolutions[p]; i++)
+			{
+				m_patchX[p].push_back(static_cast<float>(i));
+				m_patchZ[p].push_back(static_cast<float>(j));
+				m_morphX[p].push_back(static_cast<float>(i % 2));
+				m_morphZ[p].push_back(static_cast<float>(j % 2));
+			}
+		}
+	}
+}
+
+void CdlodQuadtree::AddNode(float x, float z, float size, int level, int resolution)
+{
+	assert(m_selected.size() < m_maxNodes);
+
+	Node n;
+	n.x = x;
+	n.z = z;
+	n.size = size;
+	n.level = level;
+	n.resolution = resolution;
+	n.morphEnd = m_ranges[level];
+	n.morphStart = n.morphEnd - MORPH_REGION * (n.morphEnd - (level > 0 ? m_ranges[level - 1] : 0.0f));
+	n.baseVertex = m_vertexCount;
+
+	m_vertexCount += resolution * resolution;
+	m_selected.push_back(n);
+}
+
+bool CdlodQuadtree::SelectNode(float x, float z, float size, int level, const XMFLOAT3& cameraPos)
+{
+	float distSq = BoxDistanceSq(x, z, size, cameraPos);
+
+	if (distSq > m_ranges[level] * m_ranges[level])
+		return false;
+
+	if (level == 0 || distSq > m_ranges[level - 1] * m_ranges[level - 1])
+	{
+		AddNode(x, z, size, level, PATCH_RESOLUTION);
+		return true;
+	}
+
+	float half = 0.5f * size;
+	for (int c = 0; c < 4; c++)
+	{
+		float cx = x + (c % 2) * half;
+		float cz = z + (c / 2) * half;
+
+		// children out of the finer range are drawn as a quarter of this node's patch
+		if (!SelectNode(cx, cz, half, level - 1, cameraPos))
+		{
+			AddNode(cx, cz, half, level, HALF_PATCH_RESOLUTION);
+		}
+	}
+
+	return true;
+}
+
+void CdlodQuadtree::GeneratePatch(const Node& node, const XMFLOAT3& cameraPos)
+{
+	const int p = node.resolution == PATCH_RESOLUTION ? 0 : 1;
+	const int count = node.resolution * node.resolution;
+	const float spacing = node.size / (node.resolution - 1);
+
+	const float* gx = m_patchX[p].data();
+	const float* gz = m_patchZ[p].data();
+	const float* mx = m_morphX[p].data();
+	const float* mz = m_morphZ[p].data();
+
+	float* outX = m_x.data() + node.baseVertex;
+	float* outZ = m_z.data() + node.baseVertex;
+
+	const float morphScale = 1.0f / (node.morphEnd - node.morphStart);
+
+	const __m128 ox = _mm_set1_ps(node.x), oz = _mm_set1_ps(node.z), s = _mm_set1_ps(spacing);
+	const __m128 cx = _mm_set1_ps(cameraPos.x), cz = _mm_set1_ps(cameraPos.z), cy2 = _mm_set1_ps(cameraPos.y * cameraPos.y);
+	const __m128 start = _mm_set1_ps(node.morphStart), scale = _mm_set1_ps(morphScale);
+	const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		auto x = _mm_add_ps(ox, _mm_mul_ps(_mm_loadu_ps(gx + i), s));
+		auto z = _mm_add_ps(oz, _mm_mul_ps(_mm_loadu_ps(gz + i), s));
+
+		auto dx = _mm_sub_ps(x, cx);
+		auto dz = _mm_sub_ps(z, cz);
+		auto dist = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz)), cy2));
+		auto k = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(dist, start), scale), zero), one);
+
+		// odd vertices slide onto their even neighbours as the node approaches the coarser level
+		auto ks = _mm_mul_ps(k, s);
+		x = _mm_sub_ps(x, _mm_mul_ps(_mm_loadu_ps(mx + i), ks));
+		z = _mm_sub_ps(z, _mm_mul_ps(_mm_loadu_ps(mz + i), ks));
+
+		_mm_storeu_ps(outX + i, x);
+		_mm_storeu_ps(outZ + i, z);
+	}
+
+	for (; i < count; i++)
+	{
+		float x = node.x + gx[i] * spacing;
+		float z = node.z + gz[i] * spacing;
+
+		float dx = x - cameraPos.x;
+		float dz = z - cameraPos.z;
+		float dist = sqrtf(dx * dx + dz * dz + cameraPos.y * cameraPos.y);
+		float k = std::clamp((dist - node.morphStart) * morphScale, 0.0f, 1.0f);
+
+		outX[i] = x - mx[i] * k * spacing;
+		outZ[i] = z - mz[i] * k * spacing;
+	}
+}
+
+void CdlodQuadtree::Update(const XMFLOAT3& cameraPos, const HeightSource& heights, VertexPositionNormal* output)
+{
+	m_selected.clear();
+	m_vertexCount = 0;
+
+	const float h = 0.5f * m_extent;
+	const int root = m_levels - 1;
+
+	// camera too far away for any range - draw the whole area at the coarsest level
+	if (!SelectNode(-h, -h, m_extent, root, cameraPos))
+	{
+		AddNode(-h, -h, m_extent, root, PATCH_RESOLUTION);
+	}
+
+	for (const auto& node : m_selected)
+	{
+		GeneratePatch(node, cameraPos);
+	}
+
+	const __m128 step = _mm_set1_ps(m_normalStep);
+	int i = 0;
+	for (; i + 4 <= static_cast<int>(m_vertexCount); i += 4)
+	{
+		_mm_storeu_ps(m_xStep.data() + i, _mm_add_ps(_mm_loadu_ps(m_x.data() + i), step));
+		_mm_storeu_ps(m_zStep.data() + i, _mm_add_ps(_mm_loadu_ps(m_z.data() + i), step));
+	}
+	for (; i < static_cast<int>(m_vertexCount); i++)
+	{
+		m_xStep[i] = m_x[i] + m_normalStep;
+		m_zStep[i] = m_z[i] + m_normalStep;
+	}
+
+	// heights of all selected nodes are fetched in a single batch
+	heights.SampleHeights(m_x.data(), m_z.data(), m_h.data(), m_vertexCount);
+	heights.SampleHeights(m_xStep.data(), m_z.data(), m_hx.data(), m_vertexCount);
+	heights.SampleHeights(m_x.data(), m_zStep.data(), m_hz.data(), m_vertexCount);
+
+	for (unsigned int v = 0; v < m_vertexCount; v++)
+	{
+		float nx = m_h[v] - m_hx[v];
+		float nz = m_h[v] - m_hz[v];
+		float invLen = 1.0f / sqrtf(nx * nx + m_normalStep * m_normalStep + nz * nz);
+
+		output[v].position = XMFLOAT3(m_x[v], m_h[v], m_z[v]);
+		output[v].normal = XMFLOAT3(nx * invLen, m_normalStep * invLen, nz * invLen);
+	}
+}
+
+void CdlodQuadtree::PatchIndices(int resolution, std::vector<unsigned short>& indices)
+{
+	for (int j = 0; j < resolution - 1; j++)
+	{
+		for (int i = 0; i < resolution - 1; i++)
+		{
+			unsigned short v = j * resolution + i;
+
+			indices.push_back(v);
+			indices.push_back(v + 1);
+			indices.push_back(v + resolution);
+
+			indices.push_back(v + 1);
+			indices.push_back(v + resolution + 1);
+			indices.push_back(v + resolution);
+		}
+	}
+}
+
+std::vector<unsigned short> CdlodQuadtree::Indices()
+{
+	std::vector<unsigned short> indices;
+	indices.reserve(IndexCount(PATCH_RESOLUTION) + IndexCount(HALF_PATCH_RESOLUTION));
+
+	PatchIndices(PATCH_RESOLUTION, indices);
+	PatchIndices(HALF_PATCH_RESOLUTION, indices);
+
+	return indices;
+}
\ No newline at end of file
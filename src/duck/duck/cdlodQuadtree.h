@@ -0,0 +1,79 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+
+#include "heightSource.h"
+#include "vertexTypes.h"
+
+namespace mini::gk2
+{
+	//Continuous distance-dependent level of detail (CDLOD) quadtree over the square water area.
+	//Nodes are selected by their distance from the camera and vertices of each selected node
+	//morph towards the next coarser level near the end of the node's LOD range, which removes
+	//popping and cracks between neighbouring levels.
+	class CdlodQuadtree
+	{
+	public:
+		static constexpr int PATCH_RESOLUTION = 17;	//vertices along the side of a full node patch
+		static constexpr int HALF_PATCH_RESOLUTION = PATCH_RESOLUTION / 2 + 1;	//patch covering a quarter of a node
+
+		struct Node
+		{
+			float x, z;			//corner of the node with the smallest coordinates
+			float size;			//side of the area covered by the node
+			int level;			//LOD level, 0 is the most detailed one
+			int resolution;		//PATCH_RESOLUTION or HALF_PATCH_RESOLUTION
+			float morphStart, morphEnd;
+			unsigned int baseVertex;	//offset of the node's vertices in the vertex buffer
+		};
+
+		//extent - side of the square water area centered at the origin
+		//levels - number of LOD levels, the root node has level (levels - 1)
+		//lodDistance - visibility range of the most detailed level, doubled with every level
+		//normalStep - distance between height samples used for normal calculation
+		CdlodQuadtree(float extent, int levels, float lodDistance, float normalStep);
+
+		//Selects nodes for the given camera position (in water plane local space) and writes
+		//their vertices to output, which is expected to be a mapped dynamic vertex buffer
+		//of maxVertexCount() vertices.
+		void Update(const DirectX::XMFLOAT3& cameraPos, const HeightSource& heights, VertexPositionNormal* output);
+
+		//Nodes selected during the last update, exposed for instrumentation and drawing
+		const std::vector<Node>& selectedNodes() const { return m_selected; }
+		unsigned int vertexCount() const { return m_vertexCount; }
+
+		//Selected nodes never overlap and none is smaller than a leaf, so at most all
+		//4^(levels - 1) leaves can be selected at once
+		size_t maxNodes() const { return m_maxNodes; }
+		unsigned int maxVertexCount() const { return static_cast<unsigned int>(m_maxNodes * PATCH_RESOLUTION * PATCH_RESOLUTION); }
+
+		//Index buffer contents - full patch indices followed by half patch indices
+		static std::vector<unsigned short> Indices();
+		static unsigned int IndexCount(int resolution) { return (resolution - 1) * (resolution - 1) * 6; }
+		static unsigned int StartIndex(int resolution) { return resolution == PATCH_RESOLUTION ? 0 : IndexCount(PATCH_RESOLUTION); }
+
+	private:
+		bool SelectNode(float x, float z, float size, int level, const DirectX::XMFLOAT3& cameraPos);
+		void AddNode(float x, float z, float size, int level, int resolution);
+		void GeneratePatch(const Node& node, const DirectX::XMFLOAT3& cameraPos);
+
+		static void PatchIndices(int resolution, std::vector<unsigned short>& indices);
+
+		float m_extent;
+		int m_levels;
+		size_t m_maxNodes;
+		float m_normalStep;
+		std::vector<float> m_ranges;
+
+		std::vector<Node> m_selected;
+		unsigned int m_vertexCount;
+
+		//patch-local grid coordinates and morph offsets of full and half patch vertices
+		std::vector<float> m_patchX[2], m_patchZ[2], m_morphX[2], m_morphZ[2];
+
+		//structure of arrays scratch buffers, one entry per generated vertex
+		std::vector<float> m_x, m_z, m_h;
+		std::vector<float> m_xStep, m_zStep, m_hx, m_hz;
+	};
+}
\ No newline at end of file
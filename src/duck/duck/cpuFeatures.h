@@ -0,0 +1,34 @@
+#pragma once
+
+#include <intrin.h>
+
+namespace mini::gk2
+{
+	namespace detail
+	{
+		inline bool DetectAvx2()
+		{
+			int regs[4];
+			__cpuid(regs, 0);
+			if (regs[0] < 7)
+				return false;
+
+			// AVX registers have to be enabled by the OS as well (OSXSAVE and the XCR0 state bits)
+			__cpuid(regs, 1);
+			const bool osxsave = (regs[2] & (1 << 27)) != 0;
+			const bool avx = (regs[2] & (1 << 28)) != 0;
+			if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+				return false;
+
+			__cpuidex(regs, 7, 0);
+			return (regs[1] & (1 << 5)) != 0;
+		}
+	}
+
+	//True if AVX2 code paths can be used on this machine, detected once
+	inline bool HasAvx2()
+	{
+		static const bool avx2 = detail::DetectAvx2();
+		return avx2;
+	}
+}
\ No newline at end of file
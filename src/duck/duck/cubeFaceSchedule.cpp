@@ -0,0 +1,176 @@
+#include "cubeFaceSchedule.h"
+#include "exceptions.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+using namespace mini::gk2;
+using namespace DirectX;
+
+namespace
+{
+	constexpr float CHECK_RANGE = 10.0f;
+	constexpr float CHECK_RADIUS = 0.5f;
+
+	std::wstring FaceList(const std::vector<int>& faces)
+	{
+		std::wstring list;
+		for (auto f : faces)
+			list += (list.empty() ? L"" : L" ") + std::to_wstring(f);
+		return list.empty() ? L"-" : list;
+	}
+}
+
+CubeFaceSchedule::CubeFaceSchedule(XMFLOAT3 center, float range, int facesPerFrame)
+	: m_center(center), m_range(range), m_facesPerFrame(facesPerFrame), m_moved(false), m_frame(0), m_faces{}
+{
+	Invalidate();
+}
+
+void CubeFaceSchedule::Invalidate()
+{
+	for (int f = 0; f < FACE_COUNT; f++)
+		Invalidate(static_cast<D3D11_TEXTURECUBE_FACE>(f));
+}
+
+void CubeFaceSchedule::Invalidate(D3D11_TEXTURECUBE_FACE face)
+{
+	auto& state = m_faces[face];
+	if (!state.dirty)
+	{
+		state.dirty = true;
+		state.dirtySince = m_frame;
+	}
+}
+
+void CubeFaceSchedule::SetCenter(const XMFLOAT3& center)
+{
+	if (center.x == m_center.x && center.y == m_center.y && center.z == m_center.z)
+		return;
+
+	m_center = center;
+	m_moved = true;
+	Invalidate();
+}
+
+void CubeFaceSchedule::MarkMoving(const XMFLOAT3& position, float radius)
+{
+	const float d[3] = { position.x - m_center.x, position.y - m_center.y, position.z - m_center.z };
+
+	if (sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]) - radius > m_range)
+		return;
+
+	// sides of a face's frustum are the planes |d[b]| = d[a] tilted by 45 degrees,
+	// the sphere reaches inside if it isn't farther than its radius from both pairs
+	const float slack = radius * sqrtf(2.0f);
+
+	for (int f = 0; f < FACE_COUNT; f++)
+	{
+		const int a = f / 2;
+		const float forward = f % 2 ? -d[a] : d[a];
+
+		if (fabsf(d[(a + 1) % 3]) - forward > slack || fabsf(d[(a + 2) % 3]) - forward > slack)
+			continue;
+
+		auto face = static_cast<D3D11_TEXTURECUBE_FACE>(f);
+		Invalidate(face);
+		m_faces[face].moving = true;
+	}
+}
+
+std::vector<D3D11_TEXTURECUBE_FACE> CubeFaceSchedule::NextFaces()
+{
+	std::vector<D3D11_TEXTURECUBE_FACE> faces;
+	for (int f = 0; f < FACE_COUNT; f++)
+	{
+		if (m_faces[f].dirty)
+			faces.push_back(static_cast<D3D11_TEXTURECUBE_FACE>(f));
+	}
+
+	// faces seeing moving objects count as older, so that faces dirtied once still get their turn
+	auto age = [this](D3D11_TEXTURECUBE_FACE face)
+	{
+		return m_frame - m_faces[face].dirtySince + (m_faces[face].moving ? MOVING_PRIORITY : 0);
+	};
+
+	// stable sort keeps the face order among equally old faces
+	std::stable_sort(faces.begin(), faces.end(), [&age](D3D11_TEXTURECUBE_FACE l, D3D11_TEXTURECUBE_FACE r)
+	{
+		return age(l) > age(r);
+	});
+
+	if (!m_moved && faces.size() > static_cast<size_t>(m_facesPerFrame))
+		faces.resize(m_facesPerFrame);
+
+	for (auto face : faces)
+		m_faces[face].dirty = false;
+
+	for (auto& state : m_faces)
+		state.moving = false;
+
+	m_moved = false;
+	m_frame++;
+	return faces;
+}
+
+void mini::gk2::RunCubeFaceCheck(const std::wstring& reportPath)
+{
+	std::wofstream report(reportPath);
+	if (!report)
+		THROW(L"Couldn't open the cube face check report file");
+
+	report << L"frame\tfaces\texpected\n";
+
+	CubeFaceSchedule schedule(XMFLOAT3(0.0f, 0.0f, 0.0f), CHECK_RANGE, 2);
+	int frame = 0;
+	auto expect = [&](const std::vector<int>& expected)
+	{
+		std::vector<int> faces;
+		for (auto face : schedule.NextFaces())
+			faces.push_back(face);
+
+		report << frame << L"\t" << FaceList(faces) << L"\t" << FaceList(expected) << L"\n";
+		if (faces != expected)
+			THROW(L"Cube face schedule returned faces " + FaceList(faces) + L" in frame " + std::to_wstring(frame)
+				+ L" instead of " + FaceList(expected));
+		frame++;
+	};
+
+	// a new map is filled two faces at a time, then nothing changes
+	expect({ 0, 1 });
+	expect({ 2, 3 });
+	expect({ 4, 5 });
+	expect({});
+
+	// an object in front of the +X face dirties only that face, objects out of range don't dirty any
+	schedule.MarkMoving(XMFLOAT3(5.0f, 0.0f, 0.0f), CHECK_RADIUS);
+	expect({ 0 });
+	schedule.MarkMoving(XMFLOAT3(2.0f * CHECK_RANGE, 0.0f, 0.0f), CHECK_RADIUS);
+	expect({});
+
+	// an object moving below the center keeps the -Y face first, the other faces follow in order
+	schedule.Invalidate();
+	for (int f : { 0, 1, 2, 4, 5 })
+	{
+		schedule.MarkMoving(XMFLOAT3(0.0f, -5.0f, 0.0f), CHECK_RADIUS);
+		expect({ 3, f });
+	}
+	schedule.MarkMoving(XMFLOAT3(0.0f, -5.0f, 0.0f), CHECK_RADIUS);
+	expect({ 3 });
+
+	// moving the teapot the map is rendered from forces all faces at once, staying in place doesn't
+	schedule.SetCenter(XMFLOAT3(1.0f, 0.0f, 0.0f));
+	expect({ 0, 1, 2, 3, 4, 5 });
+	schedule.SetCenter(XMFLOAT3(1.0f, 0.0f, 0.0f));
+	expect({});
+}
+
+bool mini::gk2::RunCubeFaceCommand(int argc, wchar_t** argv)
+{
+	if (argc < 3 || std::wstring(argv[1]) != L"--cube-face-check")
+		return false;
+
+	RunCubeFaceCheck(argv[2]);
+	return true;
+}
\ No newline at end of file
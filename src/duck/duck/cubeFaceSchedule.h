@@ -0,0 +1,69 @@
+#pragma once
+
+#include <array>
+#include <cfloat>
+#include <d3d11.h>
+#include <DirectXMath.h>
+#include <string>
+#include <vector>
+
+namespace mini::gk2
+{
+	//Decides which faces of a dynamic cube map are re-rendered in a frame.
+	//Faces are rendered only after being invalidated, at most facesPerFrame of them per frame.
+	//Faces that can see a moving object go first, the rest follow in the order they became dirty
+	//and can be overtaken by moving ones for at most MOVING_PRIORITY frames.
+	//The schedule doesn't touch the device, renderers just draw the faces it returns.
+	class CubeFaceSchedule
+	{
+	public:
+		static constexpr int FACE_COUNT = 6;
+
+		//center - position the cube map is rendered from, range - distance beyond which nothing is visible
+		explicit CubeFaceSchedule(DirectX::XMFLOAT3 center = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f), float range = FLT_MAX,
+			int facesPerFrame = 1);
+
+		//Marks all faces dirty, e.g. after a change of the static scene
+		void Invalidate();
+		void Invalidate(D3D11_TEXTURECUBE_FACE face);
+
+		//Moves the point the cube map is rendered from. Every face sees the scene from the wrong place
+		//after a move, so all of them are rendered in the next frame regardless of facesPerFrame.
+		void SetCenter(const DirectX::XMFLOAT3& center);
+
+		//Marks faces whose frustum may contain the bounding sphere of an object that moved this frame
+		void MarkMoving(const DirectX::XMFLOAT3& position, float radius);
+
+		//Returns faces to be re-rendered this frame and marks them clean
+		std::vector<D3D11_TEXTURECUBE_FACE> NextFaces();
+
+		bool dirty(D3D11_TEXTURECUBE_FACE face) const { return m_faces[face].dirty; }
+		int facesPerFrame() const { return m_facesPerFrame; }
+		void SetFacesPerFrame(int faces) { m_facesPerFrame = faces; }
+
+	private:
+		static constexpr unsigned long long MOVING_PRIORITY = FACE_COUNT;
+
+		struct FaceState
+		{
+			bool dirty;
+			bool moving;	//an object moved inside the face's frustum this frame
+			unsigned long long dirtySince;
+		};
+
+		DirectX::XMFLOAT3 m_center;
+		float m_range;
+		int m_facesPerFrame;
+		bool m_moved;	//the center moved since the last NextFaces
+		unsigned long long m_frame;
+
+		std::array<FaceState, FACE_COUNT> m_faces;
+	};
+
+	//Drives a schedule through a scripted sequence of frames with moving objects and a moving center,
+	//writes the faces returned in every frame to reportPath and throws at the first unexpected one
+	void RunCubeFaceCheck(const std::wstring& reportPath);
+
+	//Handles the --cube-face-check <report> command line switch, returns false if it's not present
+	bool RunCubeFaceCommand(int argc, wchar_t** argv);
+}
\ No newline at end of file
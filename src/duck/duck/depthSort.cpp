@@ -0,0 +1,303 @@
+#include "depthSort.h"
+#include "particleKernels.h"
+#include "particleSystem.h"
+#include "exceptions.h"
+#include "randomStreams.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <span>
+
+using namespace mini::gk2;
+using namespace DirectX;
+
+namespace
+{
+	constexpr float BENCHMARK_EXTENT = 10.0f;
+	constexpr float BENCHMARK_SPEED = 0.02f;
+	constexpr float BENCHMARK_CAMERA_DISTANCE = 30.0f;
+	constexpr float BENCHMARK_CAMERA_SPEED = 0.001f;	//radians per second
+	constexpr float BENCHMARK_FRAME_TIME = 1.0f / 60.0f;
+	constexpr float BENCHMARK_TIME_TO_LIVE = 5.0f;
+
+	//Places a particle at a random point with a random slow velocity
+	void Reborn(ParticlePool& pool, size_t slot, Philox& random)
+	{
+		for (auto a : { ParticlePool::PositionX, ParticlePool::PositionY, ParticlePool::PositionZ })
+			pool.data(a)[slot] = random.Uniform(-BENCHMARK_EXTENT, BENCHMARK_EXTENT);
+		for (auto a : { ParticlePool::VelocityX, ParticlePool::VelocityY, ParticlePool::VelocityZ })
+			pool.data(a)[slot] = random.Uniform(-BENCHMARK_SPEED, BENCHMARK_SPEED);
+		pool.data(ParticlePool::Age)[slot] = 0.0f;
+	}
+
+	float DistanceSq(const ParticlePool& pool, size_t slot, const XMFLOAT3& camera)
+	{
+		const float dx = pool.data(ParticlePool::PositionX)[slot] - camera.x;
+		const float dy = pool.data(ParticlePool::PositionY)[slot] - camera.y;
+		const float dz = pool.data(ParticlePool::PositionZ)[slot] - camera.z;
+		return dx * dx + dy * dy + dz * dz;
+	}
+
+	void WriteVertex(const ParticlePool& pool, size_t slot, ParticleVertex& v)
+	{
+		v.Pos = XMFLOAT3(pool.data(ParticlePool::PositionX)[slot], pool.data(ParticlePool::PositionY)[slot],
+			pool.data(ParticlePool::PositionZ)[slot]);
+		v.Age = pool.data(ParticlePool::Age)[slot];
+		v.Angle = pool.data(ParticlePool::Angle)[slot];
+		v.Size = pool.data(ParticlePool::Size)[slot];
+	}
+}
+
+DepthSort::DepthSort(size_t capacity)
+	: m_count(0), m_head(0), m_order(capacity), m_orderTemp(capacity), m_keys(capacity), m_keysTemp(capacity), m_slotKeys(capacity),
+	m_histograms{}, m_lastMethod(DepthSortMethod::Radix), m_lastDisorder(0.0f)
+{ }
+
+void DepthSort::Track(const ParticlePool& pool, size_t expired)
+{
+	const size_t capacity = pool.capacity();
+
+	// particles of the last call which were younger than the expired ones are still alive
+	size_t kept = 0;
+	for (size_t i = 0; i < m_count; i++)
+	{
+		const unsigned int slot = m_order[i];
+		const size_t rank = slot >= m_head ? slot - m_head : slot + capacity - m_head;
+		if (rank >= expired)
+			m_order[kept++] = slot;
+	}
+
+	// new particles follow the survivors in the ring
+	for (size_t r = kept; r < pool.size(); r++)
+		m_order[r] = static_cast<unsigned int>(pool.Slot(r));
+
+	m_count = pool.size();
+	m_head = pool.Slot(0);
+}
+
+void DepthSort::Sort(const ParticlePool& pool, size_t expired, XMFLOAT3 camera, ParticleVertex* output, DepthSortMethod method)
+{
+	Track(pool, expired);
+
+	// keys are computed in slot order and gathered from a single array afterwards
+	for (const auto& range : pool.Ranges())
+	{
+		for (size_t slot = range.first; slot < range.last; slot++)
+		{
+			// bits of non-negative floats compare like unsigned integers, inverting them puts the farthest first
+			const float distance = DistanceSq(pool, slot, camera);
+
+			uint32_t bits;
+			memcpy(&bits, &distance, sizeof(bits));
+			m_slotKeys[slot] = ~bits;
+		}
+	}
+
+	for (size_t i = 0; i < m_count; i++)
+		m_keys[i] = m_slotKeys[m_order[i]];
+
+	size_t descents = 0;
+	for (size_t i = 1; i < m_count; i++)
+		descents += m_keys[i] < m_keys[i - 1];
+
+	m_lastDisorder = m_count > 1 ? static_cast<float>(descents) / (m_count - 1) : 0.0f;
+
+	// the descents don't tell how far keys travel, so the automatic choice caps the insertion work as well
+	if (method == DepthSortMethod::Auto)
+	{
+		method = m_lastDisorder <= MAX_INSERTION_DISORDER && InsertionSort(MAX_INSERTION_SHIFTS * m_count)
+			? DepthSortMethod::Insertion : DepthSortMethod::Radix;
+		if (method == DepthSortMethod::Radix)
+			RadixSort();
+	}
+	else if (method == DepthSortMethod::Insertion)
+		InsertionSort();
+	else
+		RadixSort();
+
+	m_lastMethod = method;
+
+	// vertices are scattered to their positions while the attributes are read in slot order,
+	// a gather in the sorted order would miss the cache once per attribute instead
+	for (size_t i = 0; i < m_count; i++)
+		m_slotKeys[m_order[i]] = static_cast<uint32_t>(i);
+
+	for (const auto& range : pool.Ranges())
+	{
+		for (size_t slot = range.first; slot < range.last; slot++)
+			WriteVertex(pool, slot, output[m_slotKeys[slot]]);
+	}
+}
+
+bool DepthSort::InsertionSort(size_t maxShifts)
+{
+	size_t shifts = 0;
+	for (size_t i = 1; i < m_count; i++)
+	{
+		const uint32_t key = m_keys[i];
+		const unsigned int slot = m_order[i];
+
+		size_t j = i;
+		for (; j > 0 && m_keys[j - 1] > key; j--)
+		{
+			m_keys[j] = m_keys[j - 1];
+			m_order[j] = m_order[j - 1];
+		}
+
+		m_keys[j] = key;
+		m_order[j] = slot;
+
+		shifts += i - j;
+		if (shifts > maxShifts)
+			return false;
+	}
+
+	return true;
+}
+
+void DepthSort::RadixSort()
+{
+	if (m_count < 2)
+		return;
+
+	constexpr uint32_t mask = BUCKETS - 1;
+
+	for (auto& histogram : m_histograms)
+		histogram.fill(0);
+
+	// counts of all digits are gathered in a single pass
+	for (size_t i = 0; i < m_count; i++)
+	{
+		const uint32_t key = m_keys[i];
+		for (int p = 0; p < RADIX_PASSES; p++)
+			m_histograms[p][(key >> (p * RADIX_BITS)) & mask]++;
+	}
+
+	for (int p = 0; p < RADIX_PASSES; p++)
+	{
+		auto& histogram = m_histograms[p];
+		const int shift = p * RADIX_BITS;
+
+		// all keys share the digit - the pass wouldn't change the order
+		if (histogram[(m_keys[0] >> shift) & mask] == m_count)
+			continue;
+
+		unsigned int offset = 0;
+		for (auto& count : histogram)
+		{
+			const unsigned int c = count;
+			count = offset;
+			offset += c;
+		}
+
+		for (size_t i = 0; i < m_count; i++)
+		{
+			const uint32_t key = m_keys[i];
+			const unsigned int target = histogram[(key >> shift) & mask]++;
+
+			m_keysTemp[target] = key;
+			m_orderTemp[target] = m_order[i];
+		}
+
+		std::swap(m_keys, m_keysTemp);
+		std::swap(m_order, m_orderTemp);
+	}
+}
+
+void mini::gk2::RunDepthSortBenchmark(const std::wstring& reportPath, int frames)
+{
+	std::wofstream report(reportPath);
+	if (!report)
+		THROW(L"Couldn't open the depth sort benchmark report file");
+
+	report << L"particles\tstd::sort ms\tradix ms\tauto ms\tinsertion frames\tdisorder\treborn per frame\n";
+
+	for (size_t count : { 1000, 10000, 100000, 1000000 })
+	{
+		ParticlePool pool(count);
+		Philox random = RandomStreams(1).Stream(RandomSubsystem::Benchmark);
+
+		for (size_t i = 0; i < count; i++)
+			pool.Emit();
+
+		for (auto a : { ParticlePool::PositionX, ParticlePool::PositionY, ParticlePool::PositionZ })
+			random.FillUniform(std::span<float>(pool.data(a), count), -BENCHMARK_EXTENT, BENCHMARK_EXTENT);
+		for (auto a : { ParticlePool::VelocityX, ParticlePool::VelocityY, ParticlePool::VelocityZ })
+			random.FillUniform(std::span<float>(pool.data(a), count), -BENCHMARK_SPEED, BENCHMARK_SPEED);
+
+		// ages fall from the head of the ring, so that the oldest particles die a few at a time every frame
+		float* age = pool.data(ParticlePool::Age);
+		for (size_t i = 0; i < count; i++)
+			age[i] = BENCHMARK_TIME_TO_LIVE * (count - 1 - i) / count;
+
+		std::vector<ParticleVertex> vertices(count);
+		std::vector<float> depths(count);
+		std::vector<unsigned int> order(count);
+
+		DepthSort radix(count), automatic(count);
+
+		double reference = 0.0, radixTime = 0.0, autoTime = 0.0;
+		int insertionFrames = 0;
+		float disorder = 0.0f;
+		size_t reborn = 0;
+
+		for (int f = 0; f < frames; f++)
+		{
+			// the pool stays full, so every slot is live and the whole ring is a single range for the kernel
+			IntegrateParticles(pool, { 0, count }, BENCHMARK_FRAME_TIME, 0.0f);
+
+			const size_t expired = pool.Expire(BENCHMARK_TIME_TO_LIVE);
+			for (size_t i = 0; i < expired; i++)
+				Reborn(pool, pool.Emit(), random);
+			reborn += expired;
+
+			const float angle = BENCHMARK_CAMERA_SPEED * BENCHMARK_FRAME_TIME * f;
+			const XMFLOAT3 camera(BENCHMARK_CAMERA_DISTANCE * sinf(angle), 0.0f, BENCHMARK_CAMERA_DISTANCE * cosf(angle));
+
+			// the comparison sort of the whole set done from scratch every frame
+			auto start = std::chrono::steady_clock::now();
+			for (size_t i = 0; i < count; i++)
+				depths[i] = DistanceSq(pool, i, camera);
+			std::iota(order.begin(), order.end(), 0);
+			std::sort(order.begin(), order.end(), [&depths](unsigned int a, unsigned int b) { return depths[a] > depths[b]; });
+			for (size_t i = 0; i < count; i++)
+				WriteVertex(pool, order[i], vertices[i]);
+			auto sorted = std::chrono::steady_clock::now();
+
+			radix.Sort(pool, expired, camera, vertices.data(), DepthSortMethod::Radix);
+			auto radixSorted = std::chrono::steady_clock::now();
+
+			automatic.Sort(pool, expired, camera, vertices.data());
+			auto autoSorted = std::chrono::steady_clock::now();
+
+			reference += std::chrono::duration<double>(sorted - start).count();
+			radixTime += std::chrono::duration<double>(radixSorted - sorted).count();
+			autoTime += std::chrono::duration<double>(autoSorted - radixSorted).count();
+			insertionFrames += automatic.lastMethod() == DepthSortMethod::Insertion;
+			disorder += automatic.lastDisorder();
+
+			for (size_t i = 1; i < count; i++)
+			{
+				if (DistanceSq(pool, automatic.order()[i], camera) > DistanceSq(pool, automatic.order()[i - 1], camera))
+					THROW(L"Particles aren't sorted back to front");
+			}
+		}
+
+		report << count << L"\t" << 1000.0 * reference / frames << L"\t" << 1000.0 * radixTime / frames << L"\t"
+			<< 1000.0 * autoTime / frames << L"\t" << insertionFrames << L"/" << frames << L"\t" << disorder / frames << L"\t"
+			<< static_cast<double>(reborn) / frames << L"\n";
+	}
+}
+
+bool mini::gk2::RunDepthSortCommand(int argc, wchar_t** argv)
+{
+	if (argc < 3 || std::wstring(argv[1]) != L"--sort-bench")
+		return false;
+
+	RunDepthSortBenchmark(argv[2]);
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <DirectXMath.h>
+
+#include "particlePool.h"
+
+namespace mini::gk2
+{
+	struct ParticleVertex;
+
+	enum class DepthSortMethod
+	{
+		Auto,		//picked from the disorder of the previous frame's order, insertion falls back to radix if it shifts too much
+		Insertion,	//insertion sort of the previous order, close to linear when particles barely moved
+		Radix		//LSD radix sort on the bits of the squared distances
+	};
+
+	//Back-to-front ordering of the live particles of a pool by their squared distance from the camera.
+	//The order of the previous frame is kept between calls: expired particles are dropped from it
+	//and new ones appended, so it is usually nearly sorted already.
+	class DepthSort
+	{
+	public:
+		//part of neighbouring pairs out of order above which the radix sort is cheaper
+		static constexpr float MAX_INSERTION_DISORDER = 1.0f / 32.0f;
+		//shifts per particle after which the automatic insertion sort gives up and the radix sort takes over,
+		//a few far-travelling particles (e.g. newborn ones) cost much more than their share of descents
+		static constexpr size_t MAX_INSERTION_SHIFTS = 8;
+
+		explicit DepthSort(size_t capacity = 0);
+
+		//Sorts particles of the pool and writes their vertices in that order to output,
+		//which has room for pool.size() vertices. expired - particles dropped from the pool since the last call
+		void Sort(const ParticlePool& pool, size_t expired, DirectX::XMFLOAT3 camera, ParticleVertex* output,
+			DepthSortMethod method = DepthSortMethod::Auto);
+
+		//Slots of the particles from the farthest one after the last call
+		const unsigned int* order() const { return m_order.data(); }
+
+		DepthSortMethod lastMethod() const { return m_lastMethod; }
+		float lastDisorder() const { return m_lastDisorder; }
+
+	private:
+		static constexpr int RADIX_BITS = 11;
+		static constexpr int RADIX_PASSES = 3;
+		static constexpr size_t BUCKETS = 1 << RADIX_BITS;
+
+		//Brings the kept order up to date with the pool
+		void Track(const ParticlePool& pool, size_t expired);
+
+		//Gives up after maxShifts moved keys and returns false, the order stays a valid permutation
+		bool InsertionSort(size_t maxShifts = SIZE_MAX);
+		void RadixSort();
+
+		size_t m_count;
+		size_t m_head;	//slot of the oldest particle during the last call
+
+		//keys are inverted bits of the squared distances, ascending keys go back to front
+		std::vector<unsigned int> m_order, m_orderTemp;
+		std::vector<uint32_t> m_keys, m_keysTemp;
+		std::vector<uint32_t> m_slotKeys;	//keys indexed by slot, reused for the sorted positions of the slots
+		std::array<std::array<unsigned int, BUCKETS>, RADIX_PASSES> m_histograms;
+
+		DepthSortMethod m_lastMethod;
+		float m_lastDisorder;
+	};
+
+	//Times std::sort, the radix sort and the automatic choice on 1k, 10k, 100k and 1M particles moving
+	//slowly in front of a moving camera, dying and being reborn at random places, and writes them to reportPath
+	void RunDepthSortBenchmark(const std::wstring& reportPath, int frames = 60);
+
+	//Handles the --sort-bench <report> command line switch, returns false if it's not present
+	bool RunDepthSortCommand(int argc, wchar_t** argv);
+}
\ No newline at end of file
@@ -1,50 +1,133 @@
 #include "duckDemo.h"
 
-#include <random>
-#include <array>
 #include <algorithm>
+#include <climits>
 #include <execution>
+#include <fstream>
 
 #include "DDSTextureLoader.h"
+#include "exceptions.h"
+#include "heightSource.h"
+#include "waterPlanner.h"
 
 using namespace DirectX;
 
 namespace mini::gk2
 {
+	constexpr const wchar_t* WINDOW_TITLE = L"Kaczucha";
+	//resolution of the water textures, they cover the whole visible water area
 	constexpr int WATER_MESH_SIZE = 256;
 	constexpr float WAVE_SPEED = 1.0f;
 	constexpr float POINTS_DISTANCE = 2.0f / (WATER_MESH_SIZE - 1);
 	constexpr float INTEGRAL_STEP = 1.0f / WATER_MESH_SIZE;
+	constexpr float WATER_EXTENT = 20.0f;
+	//interactive simulation is kept inside the near-field square, Gerstner waves fill the rest.
+	//The grid keeps the spacing of the textures, so it spans WATER_NEAR_EXTENT instead of WATER_EXTENT.
+	constexpr int WATER_GRID_SIZE = 180;
+	constexpr float WATER_NEAR_EXTENT = WATER_EXTENT * (WATER_GRID_SIZE - 1) / (WATER_MESH_SIZE - 1);
+	constexpr int ABSORPTION_BAND = WATER_GRID_SIZE / 8;
+	constexpr float WATER_DISPLACEMENT = 2.0f;
+	constexpr int WATER_LOD_LEVELS = 6;
+	constexpr float WATER_LOD_DISTANCE = 1.25f;
+	constexpr const wchar_t* WATER_WISDOM_FILE = L"water.wisdom";
+	//normal map resolutions relative to WATER_MESH_SIZE, switched at runtime
+	constexpr float WATER_NORMAL_MAP_RATIOS[] = { 1.0f, 2.0f, 0.5f };
+	//normal map ratios used by the frame budget, from the cheapest one
+	constexpr size_t WATER_NORMAL_MAP_BUDGET_RATIOS[] = { 2, 0, 1 };
+	constexpr double TARGET_FRAME_TIME = 1.0 / 60.0;
+	constexpr float WATER_BLEND_WIDTH = 2.0f;
+	constexpr int GERSTNER_WAVE_COUNT = 8;
+	constexpr float GERSTNER_WAVELENGTH = 5.0f;
+	constexpr float GERSTNER_AMPLITUDE = 0.01f;
+	constexpr float GERSTNER_STEEPNESS = 0.6f;
+	//raindrops lighter than the threshold become ripple sprites and never reach the simulation
+	constexpr float RAINDROP_MIN_SIZE = 0.02f;
+	constexpr float RAINDROP_MAX_SIZE = 0.25f;
+	constexpr float SMALL_RAINDROP_THRESHOLD = 0.225f;
+	//heavy drops keep falling as often as all drops did before ripple sprites, those landing outside of
+	//the simulated square and the extra light drops drawn per frame all end up as sprites
+	constexpr float HEAVY_RAINDROP_CHANCE = 0.005f;
+	constexpr float RAINDROP_CHANCE = HEAVY_RAINDROP_CHANCE * (RAINDROP_MAX_SIZE - RAINDROP_MIN_SIZE) / (RAINDROP_MAX_SIZE - SMALL_RAINDROP_THRESHOLD);
+	constexpr float RIPPLE_SPRITE_SCALE = 0.1f;
+	constexpr float RIPPLE_SPEED = 1.5f;
+	constexpr float RIPPLE_WIDTH = 0.6f;
+	constexpr float RIPPLE_LIFETIME = 2.5f;
+	constexpr float SPLASH_AMOUNT = 0.25f;
+	constexpr float DUCK_WAKE_AMPLITUDE = 0.25f;
+	//ducks outside of the simulated square leave a ripple sprite this often, which keeps the sprite pool from filling up
+	constexpr float DUCK_WAKE_SPRITE_INTERVAL = 0.2f;
+	constexpr size_t DUCK_COUNT = 8;
+	constexpr float DUCK_SCALE = 0.01f;
+	constexpr float DUCK_SEPARATION_RADIUS = 1.5f;
+	constexpr float DUCK_SEPARATION_STRENGTH = 2.0f;
+	constexpr float DUCK_AREA_EXTENT = 20.0f;
+	//bounding sphere of the duck model in its own units, the model stands on the xz plane
+	constexpr float DUCK_BOUNDS_CENTER_Y = 56.0f;
+	constexpr float DUCK_BOUNDS_RADIUS = 115.0f;
+	//ducks farther from the camera are drawn as billboards with one of the pre-baked views
+	constexpr int DUCK_IMPOSTOR_VIEWS = 16;
+	constexpr unsigned int DUCK_IMPOSTOR_TILE_SIZE = 128;
+	constexpr float DUCK_IMPOSTOR_ELEVATION = XM_PI / 6.0f;
+	constexpr float DUCK_IMPOSTOR_DISTANCE = 8.0f;
+	constexpr float DUCK_IMPOSTOR_DISTANCE_STEP = 1.25f;
+	//the duck mesh keeps its vertices in slot 0, per-duck transforms are read from the next one
+	constexpr unsigned int DUCK_INSTANCE_SLOT = 1;
+	constexpr const wchar_t* DUCK_MESH_FILE = L"../resources/mesh/duck.txt";
+
+	namespace
+	{
+		//Takes the calls of Mesh::RenderInstanced in place of the device context and counts the draws
+		struct DrawRecorder
+		{
+			const ID3D11Buffer* instances;
+			unsigned int instanceSlot = UINT_MAX;
+			unsigned int draws = 0, instanceCount = 0;
+
+			void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY) { }
+			void IASetIndexBuffer(ID3D11Buffer*, DXGI_FORMAT, UINT) { }
+
+			void IASetVertexBuffers(UINT slot, UINT count, ID3D11Buffer* const* buffers, const UINT*, const UINT*)
+			{
+				for (UINT i = 0; i < count; i++)
+				{
+					if (buffers[i] == instances)
+						instanceSlot = slot + i;
+				}
+			}
+
+			void DrawIndexedInstanced(UINT, UINT count, UINT, INT, UINT)
+			{
+				draws++;
+				instanceCount += count;
+			}
+		};
+	}
 
 	DuckDemo::DuckDemo(HINSTANCE appInstance)
-		: DxApplication(appInstance, 1280, 720, L"Kaczucha"),
+		: DxApplication(appInstance, 1280, 720, WINDOW_TITLE),
 		m_cbWorldMtx(m_device.CreateConstantBuffer<Matrix>()),
 		m_cbProjMtx(m_device.CreateConstantBuffer<Matrix>()),
 		m_cbViewMtx(m_device.CreateConstantBuffer<Matrix, 2>()),
 		m_cbSurfaceColor(m_device.CreateConstantBuffer<Vector4>()),
 		m_cbLightPos(m_device.CreateConstantBuffer<Vector4>()),
-		m_time(0.0f),
-		m_heights(WATER_MESH_SIZE* WATER_MESH_SIZE),
-		m_prevHeights(WATER_MESH_SIZE* WATER_MESH_SIZE),
-		m_absorption(WATER_MESH_SIZE* WATER_MESH_SIZE),
-		m_range(WATER_MESH_SIZE * WATER_MESH_SIZE),
+		m_cbImpostor(m_device.CreateConstantBuffer<Vector4>()),
+		m_ducks(DUCK_COUNT, DUCK_PERIOD, DUCK_AREA_EXTENT, DUCK_SEPARATION_RADIUS),
+		m_duckImpostors(m_device, DUCK_IMPOSTOR_VIEWS, DUCK_IMPOSTOR_TILE_SIZE),
+		m_impostorDistance(DUCK_IMPOSTOR_DISTANCE),
+		m_water(WATER_GRID_SIZE, WAVE_SPEED, INTEGRAL_STEP, POINTS_DISTANCE, ABSORPTION_BAND,
+			WaterPlanner(WATER_GRID_SIZE, Stencil::NinePoint).Plan(WATER_WISDOM_FILE)),
+		m_waterNormals(POINTS_DISTANCE, static_cast<int>(WATER_MESH_SIZE * WATER_NORMAL_MAP_RATIOS[0]), WATER_NEAR_EXTENT / WATER_EXTENT),
+		m_waterHeights(POINTS_DISTANCE, WATER_MESH_SIZE, WATER_NEAR_EXTENT / WATER_EXTENT),
+		m_waterPyramid(WATER_GRID_SIZE, WATER_NEAR_EXTENT, WATER_DISPLACEMENT),
+		m_waterGrid(WATER_EXTENT, WATER_EXTENT / WATER_MESH_SIZE),
+		m_waterQuadtree(WATER_EXTENT, WATER_LOD_LEVELS, WATER_LOD_DISTANCE, WATER_EXTENT / WATER_MESH_SIZE),
+		m_gerstnerWaves(GERSTNER_WAVE_COUNT, GERSTNER_WAVELENGTH, GERSTNER_AMPLITUDE, XM_PIDIV4, XM_PIDIV2, GERSTNER_STEEPNESS),
+		m_ripples(RIPPLE_SPEED, RIPPLE_WIDTH, RIPPLE_LIFETIME),
+		m_frameBudget(TARGET_FRAME_TIME),
+		m_weatherRandom(RandomStreams::Global().Stream(RandomSubsystem::Weather)),
 		m_duckTexture(m_device.CreateShaderResourceView(L"../resources/textures/ducktex.png")),
 		m_grayNoise(m_device.CreateShaderResourceView(L"../resources/textures/gray_noise.jpg"))
 	{
-		for (int i = 0; i < WATER_MESH_SIZE * WATER_MESH_SIZE; i++)
-		{
-			int x = i % WATER_MESH_SIZE;
-			int y = i / WATER_MESH_SIZE;
-
-			int dy = min(y, WATER_MESH_SIZE - y - 1);
-			int dx = min(y, WATER_MESH_SIZE - x - 1);
-
-			float l = static_cast<float>(min(dx, dy)) / (WATER_MESH_SIZE - 1);
-
-			m_absorption[i] = 0.95f * min(1.0f, l / 0.2f);
-			m_range[i] = i;
-		}
-
 		auto s = m_window.getClientSize();
 		auto ar = static_cast<float>(s.cx) / s.cy;
 		XMStoreFloat4x4(&m_projMtx, XMMatrixPerspectiveFovLH(XM_PIDIV4, ar, 0.01f, 100.0f));
@@ -64,18 +147,41 @@ namespace mini::gk2
 		psCode = m_device.LoadByteCode(L"waterPS.cso");
 		m_waterVS = m_device.CreateVertexShader(vsCode);
 		m_waterPS = m_device.CreatePixelShader(psCode);
+		m_waterHeightPS = m_device.CreatePixelShader(m_device.LoadByteCode(L"waterHeightPS.cso"));
 
-		vsCode = m_device.LoadByteCode(L"duckVS.cso");
+		vsCode = m_device.LoadByteCode(L"duckInstancedVS.cso");
 		psCode = m_device.LoadByteCode(L"duckPS.cso");
 		m_duckVS = m_device.CreateVertexShader(vsCode);
 		m_duckPS = m_device.CreatePixelShader(psCode);
-		m_positionNormalTexLayout = m_device.CreateInputLayout(VertexPositionNormalTex::Layout, vsCode);
 
-		m_duck = Mesh::LoadDuckMesh(m_device, L"../resources/mesh/duck.txt");
-		m_duckMtx = Matrix::CreateScale(0.01f);
+		m_duck = Mesh::LoadDuckMesh(m_device, DUCK_MESH_FILE);
+		m_vbDuckInstances = m_device.CreateVertexBuffer<InstanceTransform>(static_cast<unsigned int>(DUCK_COUNT));
+		m_vbDuckImpostors = m_device.CreateVertexBuffer<InstanceTransform>(static_cast<unsigned int>(DUCK_COUNT));
+
+		// mesh vertices in slot 0, per-duck transforms in the slot RenderInstanced binds them to (see --instancing-check)
+		std::vector<D3D11_INPUT_ELEMENT_DESC> duckLayout(std::begin(VertexPositionNormalTex::Layout), std::end(VertexPositionNormalTex::Layout));
+		for (auto element : InstanceTransform::Layout)
+		{
+			element.InputSlot = DUCK_INSTANCE_SLOT;
+			duckLayout.push_back(element);
+		}
+		m_duckInstanceLayout = m_device.CreateInputLayout(duckLayout, vsCode);
+
+		vsCode = m_device.LoadByteCode(L"impostorVS.cso");
+		m_impostorVS = m_device.CreateVertexShader(vsCode);
+		m_impostorGS = m_device.CreateGeometryShader(m_device.LoadByteCode(L"impostorGS.cso"));
+		m_impostorPS = m_device.CreatePixelShader(m_device.LoadByteCode(L"impostorPS.cso"));
+		m_duckImpostorLayout = m_device.CreateInputLayout(InstanceTransform::PointLayout, vsCode);
 
 		m_box = Mesh::ShadedBox(m_device, -20.0f);
-		m_waterPlane = Mesh::Rectangle(m_device, 20.0f);
+
+		auto gridIndices = ProjectedGrid::Indices();
+		m_waterGridIndexCount = static_cast<unsigned int>(gridIndices.size());
+		m_ibWaterGrid = m_device.CreateIndexBuffer(gridIndices);
+		m_vbWaterGrid = m_device.CreateVertexBuffer<VertexPositionNormal>(ProjectedGrid::VERTEX_COUNT);
+
+		m_ibWaterQuadtree = m_device.CreateIndexBuffer(CdlodQuadtree::Indices());
+		m_vbWaterQuadtree = m_device.CreateVertexBuffer<VertexPositionNormal>(m_waterQuadtree.maxVertexCount());
 
 		ID3D11ShaderResourceView* cubeMap = nullptr;
 		auto hr = CreateDDSTextureFromFile(m_device.get().get(), m_device.context().get(), L"../resources/textures/las_cubemap.dds", nullptr, &cubeMap);
@@ -88,32 +194,49 @@ namespace mini::gk2
 		rs.CullMode = D3D11_CULL_NONE;
 		m_noCullRastState = m_device.CreateRasterizerState(rs);
 
-		auto texDesc = D3D11_TEXTURE2D_DESC{};
-		texDesc.Format = DXGI_FORMAT::DXGI_FORMAT_R8G8B8A8_UNORM;
-		texDesc.ArraySize = 1;
-		texDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-		texDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
-		texDesc.Height = texDesc.Width = WATER_MESH_SIZE;
-		texDesc.Usage = D3D11_USAGE_DYNAMIC;
-		texDesc.SampleDesc.Count = 1;
-		texDesc.MipLevels = 1;
-		
-		m_waterNormalTexture = m_device.CreateTexture(texDesc);
-		m_waterNormalSrv = m_device.CreateShaderResourceView(m_waterNormalTexture);
+		CreateWaterNormalTexture();
+
+		auto heightDesc = D3D11_TEXTURE2D_DESC{};
+		heightDesc.Format = DXGI_FORMAT::DXGI_FORMAT_R32_FLOAT;
+		heightDesc.ArraySize = 1;
+		heightDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		heightDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		heightDesc.Height = heightDesc.Width = WATER_MESH_SIZE;
+		heightDesc.Usage = D3D11_USAGE_DYNAMIC;
+		heightDesc.SampleDesc.Count = 1;
+		heightDesc.MipLevels = 1;
+
+		m_waterHeightTexture = m_device.CreateTexture(heightDesc);
+		m_waterHeightSrv = m_device.CreateShaderResourceView(m_waterHeightTexture);
+
+		BakeDuckImpostors();
 
 		UpdateBuffer(m_cbLightPos, Vector4{ 0.0f, 3.0f, 0.0f, 1.0f });
+
+		// the simulation is stepped every other frame at the lower level, normal map costs grow with the texel count
+		m_budgetWaterSteps = m_frameBudget.Register(L"water steps", { 0.5f, 1.0f }, 1);
+		m_budgetWaterNormals = m_frameBudget.Register(L"water normals", { 0.25f, 1.0f, 4.0f }, 0);
 	}
 
 	void DuckDemo::Update(const Clock& c)
 	{
 		double dt = c.getFrameTime();
-		m_time += dt;
 
 		HandleCameraInput(dt);
+		HandleKeyboardInput();
 
-		UpdateDuckPos();
+		if (m_adaptiveQuality)
+			ApplyFrameBudget(dt);
+
+		m_gerstnerWaves.Update(static_cast<float>(dt));
+		m_ripples.Update(static_cast<float>(dt));
+
+		UpdateDuckPos(static_cast<float>(dt));
 		UpdateRaindrops();
 		UpdateWaterNormals();
+		UpdateWaterGeometry();
+
+		m_waterPyramid.Update(m_water);
 	}
 
 	void DuckDemo::Render()
@@ -125,18 +248,19 @@ namespace mini::gk2
 		UpdateCameraCB();
 
 		SetWaterShaders();
-		DrawMesh(m_waterPlane, Matrix::CreateTranslation(0.0f, m_waterLevel, 0.0f));
+		DrawWater(Matrix::CreateTranslation(0.0f, m_waterLevel, 0.0f));
 
 		SetDuckShaders();
-		DrawMesh(m_duck, m_duckMtx);
-		
+		m_duck.RenderInstanced(m_device.context(), m_vbDuckInstances, sizeof(InstanceTransform), static_cast<unsigned int>(m_meshDuckCount));
+		DrawDuckImpostors();
+
 		SetCubeMapShaders();
 		DrawMesh(m_box, Matrix::Identity);
 	}
 
 	void DuckDemo::SetDuckShaders()
 	{
-		m_device.context()->IASetInputLayout(m_positionNormalTexLayout.get());
+		m_device.context()->IASetInputLayout(m_duckInstanceLayout.get());
 		m_device.context()->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
 		m_device.context()->RSSetState(nullptr);
@@ -155,6 +279,60 @@ namespace mini::gk2
 		SetShaders(m_duckVS, m_duckPS);
 	}
 
+	void DuckDemo::BakeDuckImpostors()
+	{
+		// the light keeps its position relative to a duck swimming at the water level
+		UpdateBuffer(m_cbLightPos, Vector4{ 0.0f, (3.0f - m_waterLevel) / DUCK_SCALE, 0.0f, 1.0f });
+
+		auto instance = m_device.CreateVertexBuffer(std::vector<InstanceTransform>{ { XMFLOAT3(0.0f, 0.0f, 0.0f), 1.0f, XMFLOAT2(1.0f, 0.0f) } });
+
+		m_duckImpostors.Bake(m_device.context(), XMFLOAT3(0.0f, DUCK_BOUNDS_CENTER_Y, 0.0f), DUCK_BOUNDS_RADIUS, DUCK_IMPOSTOR_ELEVATION,
+			[this, &instance](const XMFLOAT4X4& viewMtx, const XMFLOAT4X4& projMtx)
+			{
+				UpdateCameraCB(Matrix(viewMtx));
+				UpdateBuffer(m_cbProjMtx, projMtx);
+				SetDuckShaders();
+				m_duck.RenderInstanced(m_device.context(), instance, sizeof(InstanceTransform), 1);
+			});
+
+		UpdateBuffer(m_cbImpostor, Vector4{ DUCK_BOUNDS_CENTER_Y, DUCK_BOUNDS_RADIUS,
+			static_cast<float>(m_duckImpostors.views()), static_cast<float>(m_duckImpostors.tilesPerRow()) });
+	}
+
+	void DuckDemo::DrawDuckImpostors()
+	{
+		if (m_impostorDuckCount == 0)
+			return;
+
+		m_device.context()->IASetInputLayout(m_duckImpostorLayout.get());
+		m_device.context()->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_POINTLIST);
+
+		m_device.context()->RSSetState(nullptr);
+
+		ID3D11Buffer* vsb[] = { m_cbImpostor.get(), m_cbViewMtx.get() };
+		m_device.context()->VSSetConstantBuffers(0, 2, vsb);
+		ID3D11Buffer* gsb[] = { m_cbProjMtx.get(), m_cbImpostor.get() };
+		m_device.context()->GSSetConstantBuffers(0, 2, gsb);
+
+		ID3D11ShaderResourceView* views[] = { m_duckImpostors.srv().get() };
+		ID3D11SamplerState* samplers[] = { m_samplerWrap.get() };
+		m_device.context()->PSSetShaderResources(0, 1, views);
+		m_device.context()->PSSetSamplers(0, 1, samplers);
+
+		unsigned int stride = sizeof(InstanceTransform);
+		unsigned int offset = 0;
+		auto vb = m_vbDuckImpostors.get();
+		m_device.context()->IASetVertexBuffers(0, 1, &vb, &stride, &offset);
+
+		m_device.context()->VSSetShader(m_impostorVS.get(), nullptr, 0);
+		m_device.context()->GSSetShader(m_impostorGS.get(), nullptr, 0);
+		m_device.context()->PSSetShader(m_impostorPS.get(), nullptr, 0);
+
+		m_device.context()->Draw(static_cast<unsigned int>(m_impostorDuckCount), 0);
+
+		m_device.context()->GSSetShader(nullptr, nullptr, 0);
+	}
+
 	void DuckDemo::SetPhongShaders()
 	{
 		UpdateBuffer(m_cbSurfaceColor, Vector4{ 1.0f, 1.0f, 1.0f, 0.0f });
@@ -198,7 +376,9 @@ namespace mini::gk2
 
 		m_device.context()->RSSetState(m_noCullRastState.get());
 
-		ID3D11ShaderResourceView* views[] = { m_cubeMap.get(), m_waterNormalSrv.get() };
+		const bool heightMap = m_waterShading == WaterShading::HeightMap;
+
+		ID3D11ShaderResourceView* views[] = { m_cubeMap.get(), heightMap ? m_waterHeightSrv.get() : m_waterNormalSrv.get() };
 		ID3D11SamplerState* samplers[] = { m_samplerWrap.get() };
 		m_device.context()->PSSetShaderResources(0, 2, views);
 		m_device.context()->PSSetSamplers(0, 1, samplers);
@@ -207,7 +387,7 @@ namespace mini::gk2
 		m_device.context()->VSSetConstantBuffers(0, 3, vsb);
 		m_device.context()->PSSetConstantBuffers(0, 1, vsb + 1);
 
-		SetShaders(m_waterVS, m_waterPS);
+		SetShaders(m_waterVS, heightMap ? m_waterHeightPS : m_waterPS);
 	}
 	
 	void DuckDemo::UpdateCameraCB(Matrix viewMtx)
@@ -229,179 +409,336 @@ namespace mini::gk2
 		m.Render(m_device.context());
 	}
 
-	std::array<float, 4> DeBoor(float t, int degree = 3)
+	void DuckDemo::DrawWater(Matrix worldMtx)
 	{
-		std::array<float, 4> result{ 0.0f };
-		result[0] = 1.0f;
+		UpdateBuffer(m_cbWorldMtx, worldMtx);
 
-		// knots are 0, 1, 2, 3 - t is always from 0 to 1
-		for (int j = 1; j <= degree; j++)
-		{
-			for (int i = j; i >= 1; i--)
-			{
-				float left = i - j;
-				float right = i + 1;
-				result[i] = result[i] * ((right - t) / j) + result[i - 1] * ((t - left) / j);
-			}
+		unsigned int stride = sizeof(VertexPositionNormal);
+		unsigned int offset = 0;
 
-			result[0] = result[0] * (1.0f - t) / j;
+		if (m_waterGeometry == WaterGeometry::ProjectedGrid)
+		{
+			auto vb = m_vbWaterGrid.get();
+			m_device.context()->IASetVertexBuffers(0, 1, &vb, &stride, &offset);
+			m_device.context()->IASetIndexBuffer(m_ibWaterGrid.get(), DXGI_FORMAT_R16_UINT, 0);
+			m_device.context()->DrawIndexed(m_waterGridIndexCount, 0, 0);
+			return;
 		}
 
-		return result;
+		auto vb = m_vbWaterQuadtree.get();
+		m_device.context()->IASetVertexBuffers(0, 1, &vb, &stride, &offset);
+		m_device.context()->IASetIndexBuffer(m_ibWaterQuadtree.get(), DXGI_FORMAT_R16_UINT, 0);
+
+		for (const auto& node : m_waterQuadtree.selectedNodes())
+		{
+			m_device.context()->DrawIndexed(CdlodQuadtree::IndexCount(node.resolution),
+				CdlodQuadtree::StartIndex(node.resolution), node.baseVertex);
+		}
 	}
 
-	float RandomDistribution(float min, float max)
+	void DuckDemo::CreateWaterNormalTexture()
 	{
-		static std::random_device rd;
-		static std::mt19937 e2(rd());
-		static std::uniform_real_distribution<> dist(0, 1);
-
-		float next = dist(e2);
+		auto texDesc = D3D11_TEXTURE2D_DESC{};
+		texDesc.Format = DXGI_FORMAT::DXGI_FORMAT_R8G8B8A8_UNORM;
+		texDesc.ArraySize = 1;
+		texDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		texDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		texDesc.Height = texDesc.Width = m_waterNormals.resolution();
+		texDesc.Usage = D3D11_USAGE_DYNAMIC;
+		texDesc.SampleDesc.Count = 1;
+		texDesc.MipLevels = 1;
 
-		return next * (max - min) + min;
+		m_waterNormalTexture = m_device.CreateTexture(texDesc);
+		m_waterNormalSrv = m_device.CreateShaderResourceView(m_waterNormalTexture);
 	}
-	
-	void DuckDemo::UpdateRaindrops()
+
+	void DuckDemo::HandleKeyboardInput()
 	{
-		if (RandomDistribution(0.0f, 1.0f) < 0.005f)
-		{
-			int x = static_cast<int>(RandomDistribution(0, 255));
-			int y = static_cast<int>(RandomDistribution(0, 255));
+		KeyboardState state;
+		if (!m_keyboard.GetState(state))
+			return;
 
-			m_heights[y * WATER_MESH_SIZE + x] += 0.25f;
+		if (m_prevKeyboardState.keyPressed(state, DIK_G))
+		{
+			m_waterGeometry = m_waterGeometry == WaterGeometry::ProjectedGrid ? WaterGeometry::Quadtree : WaterGeometry::ProjectedGrid;
 		}
-	}
 
-	void DuckDemo::UpdateDuckPos()
-	{
-		while (m_time > DUCK_PERIOD)
+		if (m_prevKeyboardState.keyPressed(state, DIK_F))
 		{
-			if (!m_duckCurveControlPoints.empty())
-			{
-				m_duckCurveControlPoints.pop();
-			}
-
-			m_time -= DUCK_PERIOD;
+			m_farFieldWaves = !m_farFieldWaves;
 		}
 
-		while (m_duckCurveControlPoints.size() < 4)
+		if (m_prevKeyboardState.keyPressed(state, DIK_H))
 		{
-			m_duckCurveControlPoints.push(Vector2{ RandomDistribution(-10, 10), RandomDistribution(-10, 10) });
+			m_waterShading = m_waterShading == WaterShading::NormalMap ? WaterShading::HeightMap : WaterShading::NormalMap;
 		}
 
-		float parameter = m_time / DUCK_PERIOD;
-
-		std::array<Vector2, 4> controlPoints;
+		if (m_prevKeyboardState.keyPressed(state, DIK_N))
+		{
+			// manual choice of the resolution turns adaptive quality off
+			m_adaptiveQuality = false;
+			SetWaterNormalMapRatio((m_waterNormalMapRatio + 1) % std::size(WATER_NORMAL_MAP_RATIOS));
+		}
 
-		for (int i = 0; i < controlPoints.size(); i++)
+		if (m_prevKeyboardState.keyPressed(state, DIK_B))
 		{
-			controlPoints[i] = m_duckCurveControlPoints.front();
-			m_duckCurveControlPoints.pop();
+			m_adaptiveQuality = !m_adaptiveQuality;
+			m_frameBudget.Reset();
 		}
 
-		// calculate position and tangent to the curve based on control points
-		auto values = DeBoor(parameter, 3);
-		auto derivatives = DeBoor(parameter, 2);
+		if (m_prevKeyboardState.keyPressed(state, DIK_MINUS))
+		{
+			m_impostorDistance /= DUCK_IMPOSTOR_DISTANCE_STEP;
+		}
 
-		Vector2 position = {};
-		Vector2 tangent = {};
+		if (m_prevKeyboardState.keyPressed(state, DIK_EQUALS))
+		{
+			m_impostorDistance *= DUCK_IMPOSTOR_DISTANCE_STEP;
+		}
 
-		// calculate position on curve
-		for (int i = 0; i < controlPoints.size(); i++)
+		if (m_prevKeyboardState.keyPressed(state, DIK_SPACE))
 		{
-			position += values[i] * controlPoints[i];
+			SplashAtViewCenter();
 		}
 
-		// calculate tangent to the curve in point
-		for (int i = 0; i < controlPoints.size() - 1; i++)
+		m_prevKeyboardState = state;
+	}
+
+	void DuckDemo::UpdateRaindrops()
+	{
+		if (m_weatherRandom.Uniform() >= RAINDROP_CHANCE)
+			return;
+
+		float size = m_weatherRandom.Uniform(RAINDROP_MIN_SIZE, RAINDROP_MAX_SIZE);
+		float x = m_weatherRandom.Uniform(-0.5f * WATER_EXTENT, 0.5f * WATER_EXTENT);
+		float z = m_weatherRandom.Uniform(-0.5f * WATER_EXTENT, 0.5f * WATER_EXTENT);
+
+		// heavy drops falling outside of the simulated square become sprites as well
+		const float toGrid = (WATER_GRID_SIZE - 1) / WATER_NEAR_EXTENT;
+		int gridX = static_cast<int>((x + 0.5f * WATER_NEAR_EXTENT) * toGrid + 0.5f);
+		int gridY = static_cast<int>((z + 0.5f * WATER_NEAR_EXTENT) * toGrid + 0.5f);
+		if (size < SMALL_RAINDROP_THRESHOLD || gridX < 0 || gridY < 0 || gridX >= WATER_GRID_SIZE || gridY >= WATER_GRID_SIZE)
 		{
-			auto Q = controlPoints[i + 1] - controlPoints[i];
-			tangent += derivatives[i] * Q;
+			m_ripples.Add(x, z, size * RIPPLE_SPRITE_SCALE);
+			return;
 		}
 
-		tangent.Normalize();
+		m_water.Disturb(gridX, gridY, size);
+	}
 
-		Vector3 pos = { position.x, m_waterLevel, position.y };
+	void DuckDemo::SetWaterNormalMapRatio(size_t ratio)
+	{
+		if (ratio == m_waterNormalMapRatio)
+			return;
+
+		m_waterNormalMapRatio = ratio;
+		m_waterNormals.SetResolution(static_cast<int>(WATER_MESH_SIZE * WATER_NORMAL_MAP_RATIOS[m_waterNormalMapRatio]));
+
+		CreateWaterNormalTexture();
+	}
+
+	void DuckDemo::ApplyFrameBudget(double frameTime)
+	{
+		// costs recorded during the previous update belong to the frame measured by the clock
+		m_frameBudget.EndFrame(frameTime);
+
+		m_frameBudget.BeginFrame();
+
+		SetWaterNormalMapRatio(WATER_NORMAL_MAP_BUDGET_RATIOS[m_frameBudget.level(m_budgetWaterNormals)]);
+	}
+
+	void DuckDemo::SplashAtViewCenter()
+	{
+		auto eye = m_camera.getCameraPosition();
+		auto target = m_camera.getTarget();
+
+		// the ray is traced in the water plane's local space
+		XMFLOAT3 origin(eye.x, eye.y - m_waterLevel, eye.z);
+		XMFLOAT3 direction(target.x - eye.x, target.y - eye.y, target.z - eye.z);
 
-		float angle = atan2f(tangent.x, tangent.y);
+		RayHit hit = m_waterPyramid.Raycast(origin, direction);
+		if (!hit.hit)
+			return;
 
-		m_duckMtx = Matrix::CreateScale(0.01f) * Matrix::CreateRotationY(angle + XM_PIDIV2) * Matrix::CreateTranslation(pos);
+		const float toGrid = (WATER_GRID_SIZE - 1) / WATER_NEAR_EXTENT;
+		int x = static_cast<int>((hit.position.x + 0.5f * WATER_NEAR_EXTENT) * toGrid + 0.5f);
+		int y = static_cast<int>((hit.position.z + 0.5f * WATER_NEAR_EXTENT) * toGrid + 0.5f);
 
-		for (int i = 0; i < controlPoints.size(); i++)
+		m_water.Disturb(x, y, SPLASH_AMOUNT);
+	}
+
+	void DuckDemo::UpdateDuckPos(float dt)
+	{
+		m_ducks.Update(dt);
+		m_ducks.Separate(DUCK_SEPARATION_STRENGTH, dt);
+
+		D3D11_MAPPED_SUBRESOURCE meshes, impostors;
+		auto hr = m_device.context()->Map(m_vbDuckInstances.get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &meshes);
+		if (FAILED(hr))
+			THROW_DX(hr);
+		hr = m_device.context()->Map(m_vbDuckImpostors.get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &impostors);
+		if (FAILED(hr))
 		{
-			m_duckCurveControlPoints.push(controlPoints[i]);
+			m_device.context()->Unmap(m_vbDuckInstances.get(), 0);
+			THROW_DX(hr);
 		}
 
-		// water disturbance
-		Vector3 point = (pos / 20.0f + Vector3{0.5f, 0.0f, 0.5f}) * WATER_MESH_SIZE;
-		int x = point.x;
-		int y = point.z;
+		// the duck model faces the -x axis
+		auto camPos = m_camera.getCameraPosition();
+		size_t meshCount = m_ducks.WriteInstances(static_cast<InstanceTransform*>(meshes.pData), static_cast<InstanceTransform*>(impostors.pData),
+			XMFLOAT3(camPos.x, camPos.y, camPos.z), m_impostorDistance, m_waterLevel, DUCK_SCALE, XM_PIDIV2);
 
-		m_heights[y * WATER_MESH_SIZE + x] += 0.25f;
+		m_device.context()->Unmap(m_vbDuckImpostors.get(), 0);
+		m_device.context()->Unmap(m_vbDuckInstances.get(), 0);
+
+		// the title shows how the fleet is split, it's changed only when a duck crosses the impostor distance
+		if (meshCount != m_meshDuckCount || m_ducks.count() - meshCount != m_impostorDuckCount)
+		{
+			m_meshDuckCount = meshCount;
+			m_impostorDuckCount = m_ducks.count() - meshCount;
+			UpdateWindowTitle();
+		}
+
+		// water disturbance, ducks swimming outside of the simulated square leave ripple sprites instead
+		const float toGrid = (WATER_GRID_SIZE - 1) / WATER_NEAR_EXTENT;
+		m_wakeTimer += dt;
+		bool wakeSprites = m_wakeTimer >= DUCK_WAKE_SPRITE_INTERVAL;
+		if (wakeSprites)
+			m_wakeTimer = 0.0f;
+		for (size_t i = 0; i < m_ducks.count(); i++)
+		{
+			int x = static_cast<int>((m_ducks.x()[i] + 0.5f * WATER_NEAR_EXTENT) * toGrid + 0.5f);
+			int y = static_cast<int>((m_ducks.z()[i] + 0.5f * WATER_NEAR_EXTENT) * toGrid + 0.5f);
+			if (x < 0 || y < 0 || x >= WATER_GRID_SIZE || y >= WATER_GRID_SIZE)
+			{
+				if (wakeSprites)
+					m_ripples.Add(m_ducks.x()[i], m_ducks.z()[i], DUCK_WAKE_AMPLITUDE * RIPPLE_SPRITE_SCALE);
+				continue;
+			}
+
+			m_water.Disturb(x, y, DUCK_WAKE_AMPLITUDE);
+		}
 	}
 	
+	void DuckDemo::UpdateWindowTitle()
+	{
+		auto title = std::wstring(WINDOW_TITLE) + L" - ducks: " + std::to_wstring(meshDuckCount()) + L" meshes, "
+			+ std::to_wstring(impostorDuckCount()) + L" impostors";
+		SetWindowTextW(m_window.getHandle(), title.c_str());
+	}
+
 	void DuckDemo::UpdateWaterNormals()
 	{
-		float A = powf(WAVE_SPEED * INTEGRAL_STEP / POINTS_DISTANCE, 2.0f);
-		float B = 2.0f - 4 * A;
+		bool step = !m_adaptiveQuality || m_frameBudget.level(m_budgetWaterSteps) > 0 || m_waterFrame++ % 2 == 0;
+		if (step)
+		{
+			auto scope = m_frameBudget.Measure(m_budgetWaterSteps);
+			m_water.Step();
+		}
 
-		auto prevPrevHeights = m_prevHeights;
-		m_prevHeights = m_heights;
+		auto scope = m_frameBudget.Measure(m_budgetWaterNormals);
 
-		for (int y = 1; y < WATER_MESH_SIZE - 1; y++)
+		// normals are reconstructed by the pixel shader, only the heights are uploaded
+		if (m_waterShading == WaterShading::HeightMap)
 		{
-			for (int x = 1; x < WATER_MESH_SIZE - 1; x++)
-			{
-				float d = m_absorption[y * WATER_MESH_SIZE + x];
-				float prevValue = prevPrevHeights[y * WATER_MESH_SIZE + x];
-				
-				float sum = m_prevHeights[(y + 1) * WATER_MESH_SIZE + x] + m_prevHeights[(y - 1) * WATER_MESH_SIZE + x]
-					+ m_prevHeights[y * WATER_MESH_SIZE + x + 1] + m_prevHeights[y * WATER_MESH_SIZE + x - 1];
-
-				m_heights[y * WATER_MESH_SIZE + x] = d * (A * sum + B * m_prevHeights[y * WATER_MESH_SIZE + x] - prevValue);
-			}
+			UpdateWaterHeights();
+			return;
 		}
 
-		std::vector<unsigned char> vectors(WATER_MESH_SIZE * WATER_MESH_SIZE * 4);
+		D3D11_MAPPED_SUBRESOURCE res;
+		auto hr = m_device.context()->Map(m_waterNormalTexture.get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &res);
+		if (FAILED(hr))
+			THROW_DX(hr);
 
-		for (int x = 0; x < WATER_MESH_SIZE - 1; x++)
-		{
-			for (int y = 0; y < WATER_MESH_SIZE - 1; y++)
-			{
-				float height = m_heights[y * WATER_MESH_SIZE + x];
-				float hNeighbourX = m_heights[y * WATER_MESH_SIZE + x + 1];
-				float hNeighbourY = m_heights[(y + 1) * WATER_MESH_SIZE + x];
+		GridHeightSource nearField(m_water, WATER_NEAR_EXTENT);
+		HybridHeightSource hybrid(nearField, m_gerstnerWaves, WATER_NEAR_EXTENT, WATER_BLEND_WIDTH);
 
-				auto dx = Vector3{ POINTS_DISTANCE, hNeighbourX - height, 0.0f };
-				auto dz = Vector3{ 0.0f, hNeighbourX - height, POINTS_DISTANCE };
+		WaterSurfaceDetail detail{ WATER_EXTENT, m_farFieldWaves ? &hybrid : nullptr, &m_ripples };
+		m_waterNormals.Generate(m_water, res.pData, res.RowPitch, detail);
 
-				auto normal = dx.Cross(dz);
-				normal.Normalize();
+		m_device.context()->Unmap(m_waterNormalTexture.get(), 0);
+	}
 
-				normal = normal.y < 0.0 ? -normal : normal;
+	void DuckDemo::UpdateWaterHeights()
+	{
+		D3D11_MAPPED_SUBRESOURCE res;
+		auto hr = m_device.context()->Map(m_waterHeightTexture.get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &res);
+		if (FAILED(hr))
+			THROW_DX(hr);
 
-				vectors[4 * (WATER_MESH_SIZE * y + x)] = (normal.x + 1.0) / 2.0f * 255;
-				vectors[4 * (WATER_MESH_SIZE * y + x) + 1] = normal.y * 255;
-				vectors[4 * (WATER_MESH_SIZE * y + x) + 2] = (normal.z + 1.0) / 2.0f * 255;
-				vectors[4 * (WATER_MESH_SIZE * y + x) + 3] = 255;
-			}
-		}
+		GridHeightSource nearField(m_water, WATER_NEAR_EXTENT);
+		HybridHeightSource hybrid(nearField, m_gerstnerWaves, WATER_NEAR_EXTENT, WATER_BLEND_WIDTH);
+
+		WaterSurfaceDetail detail{ WATER_EXTENT, m_farFieldWaves ? &hybrid : nullptr, &m_ripples };
+		m_waterHeights.GenerateHeights(m_water, res.pData, res.RowPitch, detail);
+
+		m_device.context()->Unmap(m_waterHeightTexture.get(), 0);
+	}
+
+	void DuckDemo::UpdateWaterGeometry()
+	{
+		GridHeightSource nearField(m_water, WATER_NEAR_EXTENT, WATER_DISPLACEMENT);
+		HybridHeightSource hybrid(nearField, m_gerstnerWaves, WATER_NEAR_EXTENT, WATER_BLEND_WIDTH, WATER_DISPLACEMENT);
+
+		const HeightSource& heights = m_farFieldWaves ? static_cast<const HeightSource&>(hybrid) : nearField;
+
+		const auto& vb = m_waterGeometry == WaterGeometry::ProjectedGrid ? m_vbWaterGrid : m_vbWaterQuadtree;
 
 		D3D11_MAPPED_SUBRESOURCE res;
-		m_device.context()->Map(m_waterNormalTexture.get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &res);
+		auto hr = m_device.context()->Map(vb.get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &res);
+		if (FAILED(hr))
+			THROW_DX(hr);
 
-		if (res.RowPitch == WATER_MESH_SIZE * 4 * sizeof(unsigned char))
+		auto vertices = static_cast<VertexPositionNormal*>(res.pData);
+
+		if (m_waterGeometry == WaterGeometry::ProjectedGrid)
 		{
-			memcpy(res.pData, vectors.data(), vectors.size() * sizeof(unsigned char));
+			Matrix viewProj = Matrix(m_camera.getViewMatrix()) * m_projMtx;
+			Matrix invViewProj = viewProj.Invert();
+
+			m_waterGrid.Update(viewProj, invViewProj, m_waterLevel, heights, vertices);
 		}
 		else
 		{
-			for (int i = 0; i < res.DepthPitch / res.RowPitch; i++)
-			{
-				memcpy((unsigned char*)res.pData + i * res.RowPitch, static_cast<unsigned char*>(vectors.data()) + i * WATER_MESH_SIZE * 4, WATER_MESH_SIZE * 4 * sizeof(unsigned char));
-			}
+			auto camPos = m_camera.getCameraPosition();
+			m_waterQuadtree.Update(XMFLOAT3{ camPos.x, camPos.y - m_waterLevel, camPos.z }, heights, vertices);
 		}
 
-		m_device.context()->Unmap(m_waterNormalTexture.get(), 0);
+		m_device.context()->Unmap(vb.get(), 0);
+	}
+
+	void RunInstancingCheck(const std::wstring& reportPath, unsigned int instanceCount)
+	{
+		std::wofstream report(reportPath);
+		if (!report)
+			THROW(L"Couldn't open the instancing report file");
+
+		// buffers need a device, which needs a window, the window is never shown
+		Window window(GetModuleHandleW(nullptr), Window::m_defaultWindowWidth, Window::m_defaultWindowHeight);
+		DxDevice device(window);
+		auto duck = Mesh::LoadDuckMesh(device, DUCK_MESH_FILE);
+		auto instances = device.CreateVertexBuffer<InstanceTransform>(instanceCount);
+
+		DrawRecorder recorder{ instances.get() };
+		duck.RenderInstanced(&recorder, instances, sizeof(InstanceTransform), instanceCount);
+
+		report << L"instances\tdraws\tinstance slot\n";
+		report << instanceCount << L'\t' << recorder.draws << L'\t' << recorder.instanceSlot << L'\n';
+
+		if (recorder.draws != 1 || recorder.instanceCount != instanceCount)
+			THROW(std::to_wstring(instanceCount) + L" ducks are drawn with " + std::to_wstring(recorder.draws)
+				+ L" draw calls instead of one");
+		if (recorder.instanceSlot != DUCK_INSTANCE_SLOT)
+			THROW(L"Duck transforms are bound to slot " + std::to_wstring(recorder.instanceSlot) + L" instead of "
+				+ std::to_wstring(DUCK_INSTANCE_SLOT));
+	}
+
+	bool RunInstancingCommand(int argc, wchar_t** argv)
+	{
+		if (argc < 3 || std::wstring(argv[1]) != L"--instancing-check")
+			return false;
+
+		RunInstancingCheck(argv[2]);
+		return true;
 	}
-}
+}
\ No newline at end of file
@@ -2,8 +2,18 @@
 
 #include "dxApplication.h"
 #include "mesh.h"
+#include "projectedGrid.h"
+#include "cdlodQuadtree.h"
+#include "waterSimulation.h"
+#include "waterNormalMap.h"
+#include "gerstnerWaves.h"
+#include "rippleSprites.h"
+#include "heightPyramid.h"
+#include "frameBudget.h"
+#include "duckFleet.h"
+#include "impostorAtlas.h"
+#include "randomStreams.h"
 
-#include <queue>
 
 #include <SimpleMath.h>
 
@@ -16,14 +26,33 @@ namespace mini::gk2
 	public:
 		using Base = DxApplication;
 
+		enum class WaterGeometry
+		{
+			ProjectedGrid,
+			Quadtree
+		};
+
+		//Where the water pixel shader takes its normals from
+		enum class WaterShading
+		{
+			NormalMap,	//RGBA8 normals generated on the CPU
+			HeightMap	//raw heights, normals reconstructed in the shader
+		};
+
 		explicit DuckDemo(HINSTANCE appInstance);
 
+		//Ducks drawn as meshes and as impostors in the last frame
+		size_t meshDuckCount() const { return m_meshDuckCount; }
+		size_t impostorDuckCount() const { return m_impostorDuckCount; }
+
 	protected:
 
 		void Update(const Clock& c) override;
 		void Render() override;
 
 		void SetDuckShaders();
+		void BakeDuckImpostors();
+		void DrawDuckImpostors();
 		void SetPhongShaders();
 		void SetCubeMapShaders();
 		void SetWaterShaders();
@@ -32,39 +61,78 @@ namespace mini::gk2
 
 		void DrawMesh(const Mesh& m, Matrix worldMtx);
 
+		void CreateWaterNormalTexture();
+		void SetWaterNormalMapRatio(size_t ratio);
+		void HandleKeyboardInput();
+		void ApplyFrameBudget(double frameTime);
+
 		void UpdateRaindrops();
-		void UpdateDuckPos();
+		void SplashAtViewCenter();
+		void UpdateDuckPos(float dt);
+		void UpdateWindowTitle();
 		void UpdateWaterNormals();
+		void UpdateWaterHeights();
+		void UpdateWaterGeometry();
+
+		void DrawWater(Matrix worldMtx);
 
 		void UpdateCameraCB(Matrix viewMtx);
 		void UpdateCameraCB() { UpdateCameraCB(m_camera.getViewMatrix()); }
 
 		float m_waterLevel = -0.5f;
 
-		std::vector<float> m_heights;
-		std::vector<float> m_prevHeights;
-		std::vector<float> m_absorption;
-		std::vector<int> m_range;
+		WaterSimulation m_water;
+		WaterNormalMap m_waterNormals;
+		WaterNormalMap m_waterHeights;	//resamples the grid for the height-only shading path
+		HeightPyramid m_waterPyramid;
 
-		float m_time;
 		const float DUCK_PERIOD = 5.0f;
-		std::queue<Vector2> m_duckCurveControlPoints;
+		DuckFleet m_ducks;
+
+		//ducks past the impostor distance are drawn as billboards, counts of both kinds come from the last update
+		ImpostorAtlas m_duckImpostors;
+		float m_impostorDistance;
+		size_t m_meshDuckCount = 0, m_impostorDuckCount = 0;
+		float m_wakeTimer = 0.0f;	//ducks outside of the simulated square leave ripple sprites
 
 		dx_ptr<ID3D11VertexShader> m_phongVS, m_envVS, m_duckVS, m_waterVS;
-		dx_ptr<ID3D11PixelShader> m_phongPS, m_envPS, m_duckPS, m_waterPS;
+		dx_ptr<ID3D11PixelShader> m_phongPS, m_envPS, m_duckPS, m_waterPS, m_waterHeightPS;
 
 		dx_ptr<ID3D11InputLayout> m_positionNormalLayout;
-		dx_ptr<ID3D11InputLayout> m_positionNormalTexLayout;
+		dx_ptr<ID3D11InputLayout> m_duckInstanceLayout;
+
+		dx_ptr<ID3D11VertexShader> m_impostorVS;
+		dx_ptr<ID3D11GeometryShader> m_impostorGS;
+		dx_ptr<ID3D11PixelShader> m_impostorPS;
+		dx_ptr<ID3D11InputLayout> m_duckImpostorLayout;
 
 		dx_ptr<ID3D11RasterizerState> m_noCullRastState;
 		dx_ptr<ID3D11SamplerState> m_samplerWrap;
 
 		Mesh m_duck;
+		dx_ptr<ID3D11Buffer> m_vbDuckInstances;
+		dx_ptr<ID3D11Buffer> m_vbDuckImpostors;
 		Mesh m_box;
-		Mesh m_waterPlane;
+
+		WaterGeometry m_waterGeometry = WaterGeometry::ProjectedGrid;
+		KeyboardState m_prevKeyboardState;
+
+		ProjectedGrid m_waterGrid;
+		dx_ptr<ID3D11Buffer> m_vbWaterGrid;
+		dx_ptr<ID3D11Buffer> m_ibWaterGrid;
+		unsigned int m_waterGridIndexCount;
+
+		CdlodQuadtree m_waterQuadtree;
+		dx_ptr<ID3D11Buffer> m_vbWaterQuadtree;
+		dx_ptr<ID3D11Buffer> m_ibWaterQuadtree;
+
+		GerstnerWaves m_gerstnerWaves;
+		bool m_farFieldWaves = true;	//off leaves only ripple sprites outside of the simulated square
+
+		RippleSprites m_ripples;
+		Philox m_weatherRandom;	//raindrops
 
 		Matrix m_projMtx;
-		Matrix m_duckMtx;
 
 		dx_ptr<ID3D11ShaderResourceView> m_cubeMap;
 		dx_ptr<ID3D11ShaderResourceView> m_duckTexture;
@@ -72,11 +140,31 @@ namespace mini::gk2
 
 		dx_ptr<ID3D11Texture2D> m_waterNormalTexture;
 		dx_ptr<ID3D11ShaderResourceView> m_waterNormalSrv;
+		size_t m_waterNormalMapRatio = 0;
+
+		//quality of the water work is chosen by the frame budget while adaptive quality is on
+		FrameBudget m_frameBudget;
+		int m_budgetWaterSteps, m_budgetWaterNormals;
+		bool m_adaptiveQuality = true;
+		unsigned int m_waterFrame = 0;
+
+		WaterShading m_waterShading = WaterShading::NormalMap;
+		dx_ptr<ID3D11Texture2D> m_waterHeightTexture;
+		dx_ptr<ID3D11ShaderResourceView> m_waterHeightSrv;
 
 		dx_ptr<ID3D11Buffer> m_cbWorldMtx, //vertex shader constant buffer slot 0
 			m_cbProjMtx;				   //vertex shader constant buffer slot 2 & geometry shader constant buffer slot 0
 		dx_ptr<ID3D11Buffer> m_cbViewMtx;  //vertex shader constant buffer slot 1
 		dx_ptr<ID3D11Buffer> m_cbSurfaceColor;	//pixel shader constant buffer slot 0
 		dx_ptr<ID3D11Buffer> m_cbLightPos; //pixel shader constant buffer slot 1
+		dx_ptr<ID3D11Buffer> m_cbImpostor; //impostor vertex shader slot 0 & geometry shader slot 1
 	};
+
+	//Draws instanceCount ducks the way the demo does, with a recorder in place of the device context,
+	//writes the recorded draw calls and instance slot to reportPath and throws if the ducks take more than
+	//a single draw call or their transforms miss the slot the duck input layout reads them from
+	void RunInstancingCheck(const std::wstring& reportPath, unsigned int instanceCount = 10000);
+
+	//Handles the --instancing-check <report> command line switch, returns false if it's not present
+	bool RunInstancingCommand(int argc, wchar_t** argv);
 }
@@ -0,0 +1,377 @@
+#include "duckFleet.h"
+#include "cpuFeatures.h"
+#include "exceptions.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <execution>
+#include <fstream>
+#include <immintrin.h>
+#include <numeric>
+
+using namespace mini::gk2;
+
+namespace
+{
+	constexpr float BENCHMARK_SPACING = 2.0f;	//side of the square of water per duck
+	constexpr float BENCHMARK_RADIUS = 1.0f;
+	constexpr float BENCHMARK_PERIOD = 5.0f;
+	constexpr float BENCHMARK_STRENGTH = 1.0f;
+	constexpr float BENCHMARK_FRAME_TIME = 1.0f / 60.0f;
+	constexpr size_t REFERENCE_COUNT = 1000;
+	constexpr float REFERENCE_TOLERANCE = 1e-5f;	//separation sums neighbours in a different order than the reference
+
+	//Compares the grid's neighbours and the separation offsets of a small fleet with an O(n^2) pass over all pairs
+	void CheckAgainstBruteForce()
+	{
+		const size_t count = REFERENCE_COUNT;
+		const float extent = BENCHMARK_SPACING * sqrtf(static_cast<float>(count));
+		DuckFleet fleet(count, BENCHMARK_PERIOD, extent, BENCHMARK_RADIUS);
+
+		// one separation beforehand, so that the fading of existing offsets is checked as well
+		fleet.Separate(BENCHMARK_STRENGTH, BENCHMARK_FRAME_TIME);
+		fleet.Update(BENCHMARK_FRAME_TIME);
+
+		std::vector<float> offsetX(fleet.offsetX(), fleet.offsetX() + count);
+		std::vector<float> offsetZ(fleet.offsetZ(), fleet.offsetZ() + count);
+		fleet.Separate(BENCHMARK_STRENGTH, BENCHMARK_FRAME_TIME);
+
+		std::vector<unsigned> offsets, neighbours;
+		fleet.grid().QueryNeighbours(fleet.x(), fleet.z(), count, BENCHMARK_RADIUS, offsets, neighbours);
+
+		const float* x = fleet.x();
+		const float* z = fleet.z();
+		const float radius = BENCHMARK_RADIUS;
+		const float fade = std::min(DuckFleet::RETURN_RATE * BENCHMARK_FRAME_TIME, 1.0f);
+
+		std::vector<unsigned> found, expected;
+		for (unsigned i = 0; i < count; i++)
+		{
+			found.assign(neighbours.begin() + offsets[i], neighbours.begin() + offsets[i + 1]);
+			std::sort(found.begin(), found.end());
+
+			expected.clear();
+			float pushX = 0.0f, pushZ = 0.0f;
+			for (unsigned j = 0; j < count; j++)
+			{
+				const float dx = x[i] - x[j], dz = z[i] - z[j];
+				const float distanceSq = dx * dx + dz * dz;
+				if (distanceSq >= radius * radius)
+					continue;
+
+				expected.push_back(j);
+				if (j == i || distanceSq == 0.0f)
+					continue;
+
+				const float distance = sqrtf(distanceSq);
+				const float weight = (radius - distance) / (radius * distance);
+				pushX += dx * weight;
+				pushZ += dz * weight;
+			}
+
+			if (found != expected)
+				THROW(L"The grid finds " + std::to_wstring(found.size()) + L" neighbours of duck " + std::to_wstring(i)
+					+ L" instead of " + std::to_wstring(expected.size()));
+
+			const float expectedX = offsetX[i] + BENCHMARK_STRENGTH * pushX * BENCHMARK_FRAME_TIME - fade * offsetX[i];
+			const float expectedZ = offsetZ[i] + BENCHMARK_STRENGTH * pushZ * BENCHMARK_FRAME_TIME - fade * offsetZ[i];
+			const float error = std::max(fabsf(fleet.offsetX()[i] - expectedX), fabsf(fleet.offsetZ()[i] - expectedZ));
+			if (error > REFERENCE_TOLERANCE)
+				THROW(L"Separation of duck " + std::to_wstring(i) + L" differs from the pass over all pairs by "
+					+ std::to_wstring(error));
+		}
+	}
+}
+
+DuckFleet::DuckFleet(size_t count, float period, float extent, float separationRadius)
+	: m_count(count), m_speed(1.0f / period), m_extent(extent), m_separationRadius(separationRadius),
+	m_grid(extent, separationRadius),
+	m_random(RandomStreams::Global().Stream(RandomSubsystem::Ducks)), m_distribution(-0.5f * extent, 0.5f * extent)
+{
+	// ducks past count only pad the last group of lanes
+	const size_t padded = (count + LANES - 1) / LANES * LANES;
+
+	for (int p = 0; p < POINTS; p++)
+	{
+		m_pointsX[p].resize(padded);
+		m_pointsZ[p].resize(padded);
+	}
+
+	m_t.resize(padded);
+	m_x.resize(padded);
+	m_z.resize(padded);
+	m_vx.resize(padded);
+	m_vz.resize(padded);
+	m_offsetX.resize(padded);
+	m_offsetZ.resize(padded);
+
+	std::uniform_real_distribution<float> phase(0.0f, 1.0f);
+	for (size_t i = 0; i < padded; i++)
+	{
+		for (int p = 0; p < POINTS; p++)
+		{
+			m_pointsX[p][i] = m_distribution(m_random);
+			m_pointsZ[p][i] = m_distribution(m_random);
+		}
+
+		// spread segment changes over time
+		m_t[i] = i == 0 ? 0.0f : phase(m_random);
+	}
+
+	Update(0.0f);
+}
+
+void DuckFleet::NextSegment(size_t duck)
+{
+	for (int p = 0; p < POINTS - 1; p++)
+	{
+		m_pointsX[p][duck] = m_pointsX[p + 1][duck];
+		m_pointsZ[p][duck] = m_pointsZ[p + 1][duck];
+	}
+
+	m_pointsX[POINTS - 1][duck] = m_distribution(m_random);
+	m_pointsZ[POINTS - 1][duck] = m_distribution(m_random);
+	m_t[duck] -= 1.0f;
+}
+
+void DuckFleet::Update(float dt)
+{
+	const size_t padded = m_t.size();
+
+	if (HasAvx2())
+		UpdateAvx2(0, padded, dt);
+	else
+		UpdateScalar(0, padded, dt);
+}
+
+void DuckFleet::UpdateScalar(size_t first, size_t last, float dt)
+{
+	for (size_t i = first; i < last; i++)
+	{
+		m_t[i] += dt * m_speed;
+		while (m_t[i] >= 1.0f)
+			NextSegment(i);
+
+		const float t = m_t[i], s = 1.0f - t;
+		const float t2 = t * t, t3 = t2 * t;
+
+		// uniform cubic B-spline basis and its derivative
+		const float b[POINTS] = { s * s * s / 6.0f, (3.0f * t3 - 6.0f * t2 + 4.0f) / 6.0f,
+			(-3.0f * t3 + 3.0f * t2 + 3.0f * t + 1.0f) / 6.0f, t3 / 6.0f };
+		const float d[POINTS] = { -0.5f * s * s, 1.5f * t2 - 2.0f * t, -1.5f * t2 + t + 0.5f, 0.5f * t2 };
+
+		float x = 0.0f, z = 0.0f, vx = 0.0f, vz = 0.0f;
+		for (int p = 0; p < POINTS; p++)
+		{
+			x += b[p] * m_pointsX[p][i];
+			z += b[p] * m_pointsZ[p][i];
+			vx += d[p] * m_pointsX[p][i];
+			vz += d[p] * m_pointsZ[p][i];
+		}
+
+		m_x[i] = x + m_offsetX[i];
+		m_z[i] = z + m_offsetZ[i];
+		m_vx[i] = vx * m_speed;
+		m_vz[i] = vz * m_speed;
+	}
+}
+
+void DuckFleet::UpdateAvx2(size_t first, size_t last, float dt)
+{
+	const __m256 step = _mm256_set1_ps(dt * m_speed), speed = _mm256_set1_ps(m_speed);
+	const __m256 one = _mm256_set1_ps(1.0f), half = _mm256_set1_ps(0.5f), sixth = _mm256_set1_ps(1.0f / 6.0f);
+	const __m256 two = _mm256_set1_ps(2.0f), three = _mm256_set1_ps(3.0f), four = _mm256_set1_ps(4.0f);
+	const __m256 six = _mm256_set1_ps(6.0f), oneHalf = _mm256_set1_ps(1.5f);
+
+	for (size_t i = first; i < last; i += LANES)
+	{
+		auto t = _mm256_add_ps(_mm256_loadu_ps(m_t.data() + i), step);
+		_mm256_storeu_ps(m_t.data() + i, t);
+
+		// segments end once every period per duck, the few ducks leaving theirs are moved one by one
+		if (int ended = _mm256_movemask_ps(_mm256_cmp_ps(t, one, _CMP_GE_OQ)))
+		{
+			for (size_t l = 0; l < LANES; l++)
+			{
+				if (ended & (1 << l))
+				{
+					while (m_t[i + l] >= 1.0f)
+						NextSegment(i + l);
+				}
+			}
+
+			t = _mm256_loadu_ps(m_t.data() + i);
+		}
+
+		auto s = _mm256_sub_ps(one, t);
+		auto t2 = _mm256_mul_ps(t, t);
+		auto t3 = _mm256_mul_ps(t2, t);
+		auto s2 = _mm256_mul_ps(s, s);
+
+		auto b0 = _mm256_mul_ps(_mm256_mul_ps(s2, s), sixth);
+		auto b1 = _mm256_mul_ps(_mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(three, t3), _mm256_mul_ps(six, t2)), four), sixth);
+		auto b3 = _mm256_mul_ps(t3, sixth);
+		auto b2 = _mm256_sub_ps(_mm256_sub_ps(_mm256_sub_ps(one, b0), b1), b3);	// the basis sums to one
+
+		auto d0 = _mm256_mul_ps(s2, _mm256_set1_ps(-0.5f));
+		auto d1 = _mm256_sub_ps(_mm256_mul_ps(oneHalf, t2), _mm256_mul_ps(two, t));
+		auto d3 = _mm256_mul_ps(half, t2);
+		auto d2 = _mm256_sub_ps(_mm256_sub_ps(_mm256_setzero_ps(), _mm256_add_ps(d0, d1)), d3);	// derivatives sum to zero
+
+		const float* px[POINTS] = { m_pointsX[0].data() + i, m_pointsX[1].data() + i, m_pointsX[2].data() + i, m_pointsX[3].data() + i };
+		const float* pz[POINTS] = { m_pointsZ[0].data() + i, m_pointsZ[1].data() + i, m_pointsZ[2].data() + i, m_pointsZ[3].data() + i };
+
+		auto p0 = _mm256_loadu_ps(px[0]), p1 = _mm256_loadu_ps(px[1]), p2 = _mm256_loadu_ps(px[2]), p3 = _mm256_loadu_ps(px[3]);
+		auto x = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(b0, p0), _mm256_mul_ps(b1, p1)),
+			_mm256_add_ps(_mm256_mul_ps(b2, p2), _mm256_mul_ps(b3, p3)));
+		auto vx = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(d0, p0), _mm256_mul_ps(d1, p1)),
+			_mm256_add_ps(_mm256_mul_ps(d2, p2), _mm256_mul_ps(d3, p3)));
+
+		p0 = _mm256_loadu_ps(pz[0]), p1 = _mm256_loadu_ps(pz[1]), p2 = _mm256_loadu_ps(pz[2]), p3 = _mm256_loadu_ps(pz[3]);
+		auto z = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(b0, p0), _mm256_mul_ps(b1, p1)),
+			_mm256_add_ps(_mm256_mul_ps(b2, p2), _mm256_mul_ps(b3, p3)));
+		auto vz = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(d0, p0), _mm256_mul_ps(d1, p1)),
+			_mm256_add_ps(_mm256_mul_ps(d2, p2), _mm256_mul_ps(d3, p3)));
+
+		_mm256_storeu_ps(m_x.data() + i, _mm256_add_ps(x, _mm256_loadu_ps(m_offsetX.data() + i)));
+		_mm256_storeu_ps(m_z.data() + i, _mm256_add_ps(z, _mm256_loadu_ps(m_offsetZ.data() + i)));
+		_mm256_storeu_ps(m_vx.data() + i, _mm256_mul_ps(vx, speed));
+		_mm256_storeu_ps(m_vz.data() + i, _mm256_mul_ps(vz, speed));
+	}
+}
+
+void DuckFleet::Separate(float strength, float dt)
+{
+	m_grid.Build(m_x.data(), m_z.data(), m_count);
+
+	const float radius = m_separationRadius;
+	const float fade = std::min(RETURN_RATE * dt, 1.0f);
+
+	// offsets of a duck depend only on positions, ranges of ducks are steered in parallel
+	// in the grid's cell order, so that nearby ducks are queried one after another
+	std::vector<size_t> ranges((m_count + DUCKS_PER_JOB - 1) / DUCKS_PER_JOB);
+	std::iota(ranges.begin(), ranges.end(), 0);
+	std::for_each(std::execution::par, ranges.begin(), ranges.end(), [=, this](size_t job)
+	{
+		const size_t last = std::min(m_count, (job + 1) * DUCKS_PER_JOB);
+		for (size_t k = job * DUCKS_PER_JOB; k < last; k++)
+		{
+			const unsigned i = m_grid.sortedIndex(k);
+			float pushX = 0.0f, pushZ = 0.0f;
+
+			// push grows linearly from zero at the radius to one at the neighbour's position
+			m_grid.ForEachNeighbour(m_x[i], m_z[i], radius, [&](unsigned j, float dx, float dz, float distanceSq)
+			{
+				if (j == i || distanceSq == 0.0f)
+					return;
+
+				const float distance = sqrtf(distanceSq);
+				const float weight = (radius - distance) / (radius * distance);
+				pushX += dx * weight;
+				pushZ += dz * weight;
+			});
+
+			m_offsetX[i] += strength * pushX * dt - fade * m_offsetX[i];
+			m_offsetZ[i] += strength * pushZ * dt - fade * m_offsetZ[i];
+		}
+	});
+}
+
+float DuckFleet::heading(size_t duck) const
+{
+	return atan2f(m_vx[duck], m_vz[duck]);
+}
+
+mini::InstanceTransform DuckFleet::Transform(size_t duck, float height, float scale, float co, float so) const
+{
+	// cosine and sine of the heading straight from the velocity, ducks at rest face +z
+	const float length = sqrtf(m_vx[duck] * m_vx[duck] + m_vz[duck] * m_vz[duck]);
+	const float c = length > 0.0f ? m_vz[duck] / length : 1.0f;
+	const float s = length > 0.0f ? m_vx[duck] / length : 0.0f;
+
+	InstanceTransform instance;
+	instance.position = DirectX::XMFLOAT3(m_x[duck], height, m_z[duck]);
+	instance.scale = scale;
+	instance.rotation = DirectX::XMFLOAT2(c * co - s * so, s * co + c * so);
+	return instance;
+}
+
+void DuckFleet::WriteInstances(InstanceTransform* instances, float height, float scale, float yawOffset) const
+{
+	const float co = cosf(yawOffset), so = sinf(yawOffset);
+
+	for (size_t i = 0; i < m_count; i++)
+	{
+		instances[i] = Transform(i, height, scale, co, so);
+	}
+}
+
+size_t DuckFleet::WriteInstances(InstanceTransform* meshes, InstanceTransform* impostors, const DirectX::XMFLOAT3& viewer,
+	float lodDistance, float height, float scale, float yawOffset) const
+{
+	const float co = cosf(yawOffset), so = sinf(yawOffset);
+	const float dy = height - viewer.y;
+	const float lodDistanceSq = lodDistance * lodDistance;
+
+	size_t meshCount = 0, impostorCount = 0;
+	for (size_t i = 0; i < m_count; i++)
+	{
+		const float dx = m_x[i] - viewer.x;
+		const float dz = m_z[i] - viewer.z;
+
+		if (dx * dx + dy * dy + dz * dz < lodDistanceSq)
+			meshes[meshCount++] = Transform(i, height, scale, co, so);
+		else
+			impostors[impostorCount++] = Transform(i, height, scale, co, so);
+	}
+
+	return meshCount;
+}
+
+void mini::gk2::RunDuckFleetBenchmark(const std::wstring& reportPath, int frames)
+{
+	std::wofstream report(reportPath);
+	if (!report)
+		THROW(L"Couldn't open the duck fleet benchmark report file");
+
+	CheckAgainstBruteForce();
+
+	report << L"ducks\textent\tupdate ms\tseparate ms\tneighbours\n";
+
+	for (size_t count : { 10000, 100000 })
+	{
+		const float extent = BENCHMARK_SPACING * sqrtf(static_cast<float>(count));
+		DuckFleet fleet(count, BENCHMARK_PERIOD, extent, BENCHMARK_RADIUS);
+
+		double update = 0.0, separate = 0.0;
+		for (int f = 0; f < frames; f++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			fleet.Update(BENCHMARK_FRAME_TIME);
+			auto updated = std::chrono::steady_clock::now();
+			fleet.Separate(BENCHMARK_STRENGTH, BENCHMARK_FRAME_TIME);
+			auto separated = std::chrono::steady_clock::now();
+
+			update += std::chrono::duration<double>(updated - start).count();
+			separate += std::chrono::duration<double>(separated - updated).count();
+		}
+
+		// every duck finds itself as well
+		std::vector<unsigned> offsets, neighbours;
+		fleet.grid().QueryNeighbours(fleet.x(), fleet.z(), count, BENCHMARK_RADIUS, offsets, neighbours);
+		const double perDuck = static_cast<double>(neighbours.size() - count) / count;
+
+		report << count << L"\t" << extent << L"\t" << 1000.0 * update / frames << L"\t"
+			<< 1000.0 * separate / frames << L"\t" << perDuck << L"\n";
+	}
+}
+
+bool mini::gk2::RunDuckFleetCommand(int argc, wchar_t** argv)
+{
+	if (argc < 3 || std::wstring(argv[1]) != L"--fleet-bench")
+		return false;
+
+	RunDuckFleetBenchmark(argv[2]);
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "vertexTypes.h"
+#include "proximityGrid.h"
+#include "randomStreams.h"
+
+namespace mini::gk2
+{
+	//Ducks swimming along random uniform cubic B-splines in the xz plane.
+	//Every duck keeps a window of the four control points of its current segment, stored
+	//structure-of-arrays by slot so that eight ducks are evaluated per AVX2 instruction.
+	//A duck's window slides by one point only when it leaves its segment.
+	//Ducks closer than the separation radius push each other off their paths, the offsets
+	//fade away once they are apart again.
+	class DuckFleet
+	{
+	public:
+		static constexpr size_t LANES = 8;
+		static constexpr float RETURN_RATE = 0.5f;	//part of the offset from the path fading away per second
+
+		//period - time a duck needs to pass a single segment, extent - side of the square holding the control points
+		DuckFleet(size_t count, float period, float extent, float separationRadius = 1.0f);
+
+		void Update(float dt);
+
+		//Steers ducks away from their neighbours found in a grid built from the current positions,
+		//offsets take effect in the next update
+		void Separate(float strength, float dt);
+
+		size_t count() const { return m_count; }
+
+		const ProximityGrid& grid() const { return m_grid; }
+
+		//Positions and velocities of all ducks after the last update
+		const float* x() const { return m_x.data(); }
+		const float* z() const { return m_z.data(); }
+		const float* velocityX() const { return m_vx.data(); }
+		const float* velocityZ() const { return m_vz.data(); }
+
+		//Displacements from the paths caused by separation
+		const float* offsetX() const { return m_offsetX.data(); }
+		const float* offsetZ() const { return m_offsetZ.data(); }
+
+		//Rotation about the y axis turning the +z axis into the duck's direction of motion
+		float heading(size_t duck) const;
+
+		//Writes transforms of all ducks, e.g. straight into a mapped instance buffer of count() elements
+		//height - y coordinate of the ducks, yawOffset - rotation turning the model's forward axis onto +z
+		void WriteInstances(InstanceTransform* instances, float height, float scale, float yawOffset) const;
+
+		//Splits the ducks by their distance from the viewer, transforms of the ones closer than lodDistance
+		//go to meshes and of the remaining ones to impostors, returns the number of written mesh instances
+		size_t WriteInstances(InstanceTransform* meshes, InstanceTransform* impostors, const DirectX::XMFLOAT3& viewer,
+			float lodDistance, float height, float scale, float yawOffset) const;
+
+	private:
+		static constexpr int POINTS = 4;
+		static constexpr size_t DUCKS_PER_JOB = 1024;
+
+		void UpdateScalar(size_t first, size_t last, float dt);
+		void UpdateAvx2(size_t first, size_t last, float dt);
+
+		//Moves the duck to its next segment, drops the oldest control point and draws a new one
+		void NextSegment(size_t duck);
+
+		//co, so - cosine and sine of the yaw offset
+		InstanceTransform Transform(size_t duck, float height, float scale, float co, float so) const;
+
+		size_t m_count;
+		float m_speed;	//segments per second
+		float m_extent;
+
+		std::array<std::vector<float>, POINTS> m_pointsX, m_pointsZ;	//slot 0 holds the oldest point
+		std::vector<float> m_t;	//parameter of the current segment, [0, 1)
+
+		std::vector<float> m_x, m_z, m_vx, m_vz;
+		std::vector<float> m_offsetX, m_offsetZ;	//displacement from the path caused by separation
+
+		float m_separationRadius;
+		ProximityGrid m_grid;
+
+		Philox m_random;
+		std::uniform_real_distribution<float> m_distribution;
+	};
+
+	//Times fleet updates with separation for 10k and 100k ducks at the same density and writes them to reportPath.
+	//Neighbours and separation of a small fleet are first checked against a pass over all pairs,
+	//throws on any difference.
+	void RunDuckFleetBenchmark(const std::wstring& reportPath, int frames = 100);
+
+	//Handles the --fleet-bench <report> command line switch, returns false if it's not present
+	bool RunDuckFleetCommand(int argc, wchar_t** argv);
+}
\ No newline at end of file
@@ -0,0 +1,53 @@
+cbuffer cbView : register(b1) //Vertex Shader constant buffer slot 1
+{
+    matrix viewMatrix;
+    matrix invViewMatrix;
+};
+
+cbuffer cbProj : register(b2) //Vertex Shader constant buffer slot 2
+{
+    matrix projMatrix;
+};
+
+struct VSInput
+{
+    float3 pos : POSITION;
+    float3 norm : NORMAL0;
+    float2 tex : TEXTURE0;
+    float4 positionScale : INSTANCE0;
+    float2 rotation : INSTANCE1;
+};
+
+struct PSInput
+{
+    float4 pos : SV_POSITION;
+    float2 tex : TEXTURE0;
+    float3 worldPos : POSITION0;
+    float3 norm : NORMAL0;
+    float3 viewVec : TEXCOORD0;
+};
+
+// rotation about the y axis given by its cosine and sine, same direction as XMMatrixRotationY
+float3 rotateY(float3 v, float2 rotation)
+{
+    return float3(v.x * rotation.x + v.z * rotation.y, v.y, v.z * rotation.x - v.x * rotation.y);
+}
+
+PSInput main(VSInput i)
+{
+    PSInput o;
+    
+    o.worldPos = rotateY(i.pos * i.positionScale.w, i.rotation) + i.positionScale.xyz;
+    
+    o.pos = mul(viewMatrix, float4(o.worldPos, 1.0f));
+    o.pos = mul(projMatrix, o.pos);
+    
+    o.norm = normalize(rotateY(i.norm, i.rotation));
+    
+    o.tex = i.tex;
+    
+    float3 camPos = mul(invViewMatrix, float4(0.0f, 0.0f, 0.0f, 1.0f)).xyz;
+    o.viewVec = camPos - o.worldPos;
+    
+    return o;
+}
\ No newline at end of file
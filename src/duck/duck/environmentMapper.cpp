@@ -10,24 +10,26 @@ using namespace std;
 const int EnvironmentMapper::TEXTURE_SIZE = 256;
 
 EnvironmentMapper::EnvironmentMapper(const DxDevice& device, float nearPlane, float farPlane, XMFLOAT3 position)
-	: m_nearPlane(nearPlane), m_farPlane(farPlane),	m_position(position.x, position.y, position.z, 1.0f)
+	: m_nearPlane(nearPlane), m_farPlane(farPlane),	m_position(position.x, position.y, position.z, 1.0f),
+	m_schedule(position, farPlane)
 {
-	Texture2DDescription texDesc;
-	// TODO : 1.11 Setup texture width, height, mip levels and bind flags
+	Texture2DDescription texDesc(TEXTURE_SIZE, TEXTURE_SIZE);
+	texDesc.MipLevels = 1;
+	texDesc.BindFlags = D3D11_BIND_RENDER_TARGET;
 
-	// TODO : 1.12 Uncomment following lines
-	//m_faceTexture = device.CreateTexture(texDesc); 
-	//m_renderTarget = device.CreateRenderTargetView(m_faceTexture);
+	m_faceTexture = device.CreateTexture(texDesc);
+	m_renderTarget = device.CreateRenderTargetView(m_faceTexture);
 
 	SIZE s;
 	s.cx = s.cy = TEXTURE_SIZE;
 	m_depthBuffer = device.CreateDepthStencilView(s);
 
-	// TODO : 1.13 Create description for empty texture used as environment cube map, setup texture's width, height, mipLevels, bindflags, array size and miscFlags
+	texDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	texDesc.ArraySize = 6;
+	texDesc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
 
-	// TODO : 1.14 Uncomment following lines
-	//m_envTexture = device.CreateTexture(texDesc);
-	//m_envView = device.CreateShaderResourceView(m_envTexture);
+	m_envTexture = device.CreateTexture(texDesc);
+	m_envView = device.CreateShaderResourceView(m_envTexture);
 
 	//Shaders
 	auto vsCode = device.LoadByteCode(L"envMapVS.cso");
@@ -44,30 +46,34 @@ void EnvironmentMapper::Begin(const dx_ptr<ID3D11DeviceContext>& context) const
 	context->PSSetShader(m_envPS.get(), nullptr, 0);
 }
 
+void EnvironmentMapper::SetPosition(XMFLOAT3 position)
+{
+	m_position = XMFLOAT4(position.x, position.y, position.z, 1.0f);
+	m_schedule.SetCenter(position);
+}
+
 DirectX::XMMATRIX mini::gk2::EnvironmentMapper::FaceViewMtx(D3D11_TEXTURECUBE_FACE face) const
 {
-	// TODO : 1.15 Setup view matrix
+	static const XMFLOAT3 directions[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+	static const XMFLOAT3 ups[6] = { { 0, 1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 }, { 0, 1, 0 }, { 0, 1, 0 } };
 
-	// TODO : 1.16 Replace with correct implementation
-	return XMMatrixIdentity();
+	return XMMatrixLookToLH(XMLoadFloat4(&m_position), XMLoadFloat3(&directions[face]), XMLoadFloat3(&ups[face]));
 }
 
 DirectX::XMFLOAT4X4 mini::gk2::EnvironmentMapper::FaceProjMtx() const
 {
 	XMFLOAT4X4 proj;
 
-	// TODO : 1.17 Replace with correct implementation
-	XMStoreFloat4x4(&proj, XMMatrixIdentity());
+	XMStoreFloat4x4(&proj, XMMatrixPerspectiveFovLH(XM_PIDIV2, 1.0f, m_nearPlane, m_farPlane));
 
 	return proj;
 }
 
 void EnvironmentMapper::SetTarget(const dx_ptr<ID3D11DeviceContext>& context)
 {
-	D3D11_VIEWPORT viewport;
-
-	// TODO : 1.18 Setup viewport
-
+	SIZE s;
+	s.cx = s.cy = TEXTURE_SIZE;
+	Viewport viewport{ s };
 
 	context->RSSetViewports(1, &viewport);
 	ID3D11RenderTargetView* targets[1] = { m_renderTarget.get() };
@@ -85,6 +91,8 @@ void EnvironmentMapper::SaveFace(const dx_ptr<ID3D11DeviceContext>& context, D3D
 {
 	if (face < 0 || face > 5)
 		return;
-	// TODO : 1.19 Copy face to environment cube map
 
+	// the cube map has a single mip level, array slice index is the face's subresource index
+	context->CopySubresourceRegion(m_envTexture.get(), D3D11CalcSubresource(0, face, 1), 0, 0, 0,
+		m_faceTexture.get(), 0, nullptr);
 }
\ No newline at end of file
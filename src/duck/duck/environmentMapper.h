@@ -1,6 +1,7 @@
 #pragma once
 #include <DirectXMath.h>
 #include "dxDevice.h"
+#include "cubeFaceSchedule.h"
 
 namespace mini
 {
@@ -34,6 +35,9 @@ namespace mini
 
 			void Begin(const dx_ptr<ID3D11DeviceContext>& context) const;
 
+			//Moves the map with the object reflecting it, all faces are re-rendered in the next frame
+			void SetPosition(DirectX::XMFLOAT3 position);
+
 			DirectX::XMMATRIX FaceViewMtx(D3D11_TEXTURECUBE_FACE face) const;
 			DirectX::XMFLOAT4X4 FaceProjMtx() const;
 
@@ -41,6 +45,9 @@ namespace mini
 			void ClearTarget(const dx_ptr<ID3D11DeviceContext>& context);
 			void SaveFace(const dx_ptr<ID3D11DeviceContext>& context, D3D11_TEXTURECUBE_FACE face);
 
+			//Faces are re-rendered only when the schedule returns them
+			CubeFaceSchedule& schedule() { return m_schedule; }
+
 		private:
 			float m_nearPlane;
 			float m_farPlane;
@@ -53,6 +60,8 @@ namespace mini
 			dx_ptr<ID3D11ShaderResourceView> m_envView;
 			dx_ptr<ID3D11RenderTargetView> m_renderTarget;
 			dx_ptr<ID3D11DepthStencilView> m_depthBuffer;
+
+			CubeFaceSchedule m_schedule;
 		};
 	}
 }
\ No newline at end of file
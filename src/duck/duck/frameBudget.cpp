@@ -0,0 +1,152 @@
+#include "frameBudget.h"
+
+#include <algorithm>
+
+using namespace mini::gk2;
+
+FrameBudget::FrameBudget(double targetFrameTime, double smoothing)
+	: m_target(targetFrameTime), m_smoothing(smoothing), m_overhead(0.0), m_measured(false)
+{ }
+
+int FrameBudget::Register(const std::wstring& name, const std::vector<float>& costs, int priority)
+{
+	BudgetItem item;
+	item.name = name;
+	item.costs = costs;
+	item.priority = priority;
+	item.level = static_cast<int>(costs.size()) - 1;
+	item.unitCost = 0.0;
+	item.frameCost = 0.0;
+	item.fitFrames = 0;
+
+	m_items.push_back(item);
+	return static_cast<int>(m_items.size()) - 1;
+}
+
+std::vector<int> FrameBudget::Levels() const
+{
+	std::vector<int> levels(m_items.size());
+	for (size_t i = 0; i < m_items.size(); i++)
+		levels[i] = m_items[i].level;
+
+	return levels;
+}
+
+double FrameBudget::Cost(const std::vector<int>& levels) const
+{
+	double cost = 0.0;
+	for (size_t i = 0; i < m_items.size(); i++)
+		cost += m_items[i].unitCost * m_items[i].costs[levels[i]];
+
+	return cost;
+}
+
+std::vector<int> FrameBudget::Fit(double budget) const
+{
+	std::vector<int> levels(m_items.size());
+	for (size_t i = 0; i < m_items.size(); i++)
+		levels[i] = static_cast<int>(m_items[i].costs.size()) - 1;
+
+	double cost = Cost(levels);
+	while (cost > budget)
+	{
+		// lowest priority first, among equal priorities the one saving the most
+		int best = -1;
+		double bestSaving = 0.0;
+		for (size_t i = 0; i < m_items.size(); i++)
+		{
+			if (levels[i] == 0)
+				continue;
+
+			const auto& item = m_items[i];
+			double saving = item.unitCost * (item.costs[levels[i]] - item.costs[levels[i] - 1]);
+
+			if (best < 0 || item.priority < m_items[best].priority
+				|| (item.priority == m_items[best].priority && saving > bestSaving))
+			{
+				best = static_cast<int>(i);
+				bestSaving = saving;
+			}
+		}
+
+		// everything is at its cheapest level already
+		if (best < 0)
+			break;
+
+		levels[best]--;
+		cost -= bestSaving;
+	}
+
+	return levels;
+}
+
+bool FrameBudget::BeginFrame()
+{
+	for (auto& item : m_items)
+		item.frameCost = 0.0;
+
+	if (!m_measured)
+		return false;
+
+	const double budget = m_target - m_overhead;
+	const auto lower = Fit(budget);
+	const auto upper = Fit(budget * (1.0 - RAISE_HEADROOM));
+
+	bool changed = false;
+	for (size_t i = 0; i < m_items.size(); i++)
+	{
+		auto& item = m_items[i];
+
+		if (lower[i] < item.level)
+		{
+			item.level = lower[i];
+			item.fitFrames = 0;
+			changed = true;
+		}
+		else if (upper[i] > item.level)
+		{
+			if (++item.fitFrames >= RAISE_FRAMES)
+			{
+				item.level++;
+				item.fitFrames = 0;
+				changed = true;
+			}
+		}
+		else
+		{
+			item.fitFrames = 0;
+		}
+	}
+
+	return changed;
+}
+
+void FrameBudget::EndFrame(double frameTime)
+{
+	double itemsCost = 0.0;
+	for (auto& item : m_items)
+	{
+		itemsCost += item.frameCost;
+
+		// frames skipped by the item count as zero cost, levels describe the average cost per frame
+		const double unitCost = item.frameCost / std::max(item.costs[item.level], 1e-6f);
+		item.unitCost = m_measured ? item.unitCost + m_smoothing * (unitCost - item.unitCost) : unitCost;
+	}
+
+	const double overhead = std::max(frameTime - itemsCost, 0.0);
+	m_overhead = m_measured ? m_overhead + m_smoothing * (overhead - m_overhead) : overhead;
+	m_measured = true;
+}
+
+void FrameBudget::Reset()
+{
+	for (auto& item : m_items)
+	{
+		item.unitCost = 0.0;
+		item.frameCost = 0.0;
+		item.fitFrames = 0;
+	}
+
+	m_overhead = 0.0;
+	m_measured = false;
+}
\ No newline at end of file
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace mini::gk2
+{
+	//Work registered with the frame budget, level 0 is the cheapest quality setting
+	struct BudgetItem
+	{
+		std::wstring name;
+		std::vector<float> costs;	//relative cost of every quality level
+		int priority;	//items with lower priority are degraded first
+		int level;	//level chosen for the current frame
+
+		double unitCost;	//moving average of the measured cost per unit of relative cost, in seconds
+		double frameCost;	//cost measured during the current frame
+		int fitFrames;	//consecutive frames in which a higher level would fit the budget
+	};
+
+	//Chooses quality levels of the registered work so that frames fit the target frame time.
+	//Costs of the items and of the rest of the frame are tracked with moving averages,
+	//levels drop as soon as the prediction exceeds the budget and rise one at a time only
+	//after fitting with some headroom for several frames.
+	//Items are timed on the CPU only, GPU work they submit is seen through the frame time as overhead.
+	class FrameBudget
+	{
+	public:
+		//RAII timer adding the time of its scope to an item's cost of the current frame
+		class Scope
+		{
+		public:
+			Scope(FrameBudget& budget, int item)
+				: m_budget(budget), m_item(item), m_start(std::chrono::steady_clock::now())
+			{ }
+
+			~Scope()
+			{
+				std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - m_start;
+				m_budget.Record(m_item, elapsed.count());
+			}
+
+			Scope(const Scope&) = delete;
+			Scope& operator=(const Scope&) = delete;
+
+		private:
+			FrameBudget& m_budget;
+			int m_item;
+			std::chrono::steady_clock::time_point m_start;
+		};
+
+		//smoothing - weight of the newest sample in the moving averages
+		explicit FrameBudget(double targetFrameTime, double smoothing = 0.1);
+
+		//Registers work with the given relative costs of its quality levels, returns the item's id.
+		//Items start at their highest level.
+		int Register(const std::wstring& name, const std::vector<float>& costs, int priority = 0);
+
+		//Chooses levels for the coming frame, returns true if any of them changed
+		bool BeginFrame();
+
+		//Closes the frame measured by the application's clock
+		void EndFrame(double frameTime);
+
+		//Drops all measurements, e.g. after the work ran for a while without the budget deciding its levels
+		void Reset();
+
+		void Record(int item, double seconds) { m_items[item].frameCost += seconds; }
+		Scope Measure(int item) { return Scope(*this, item); }
+
+		int level(int item) const { return m_items[item].level; }
+		const std::vector<BudgetItem>& items() const { return m_items; }
+
+		double targetFrameTime() const { return m_target; }
+		void SetTargetFrameTime(double seconds) { m_target = seconds; }
+
+		//Predicted frame time at the current levels
+		double predictedFrameTime() const { return m_overhead + Cost(Levels()); }
+
+	private:
+		static constexpr double RAISE_HEADROOM = 0.15;	//part of the budget left free after raising a level
+		static constexpr int RAISE_FRAMES = 30;
+
+		std::vector<int> Levels() const;
+		double Cost(const std::vector<int>& levels) const;
+
+		//Degrades items starting from their highest levels until the predicted cost fits the budget
+		std::vector<int> Fit(double budget) const;
+
+		double m_target;
+		double m_smoothing;
+		double m_overhead;	//moving average of the frame time spent outside of registered items
+		bool m_measured;
+
+		std::vector<BudgetItem> m_items;
+	};
+}
\ No newline at end of file
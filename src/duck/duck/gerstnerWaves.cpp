@@ -0,0 +1,119 @@
+#include "gerstnerWaves.h"
+
+#include <DirectXMath.h>
+#include <cmath>
+#include <xmmintrin.h>
+
+using namespace mini::gk2;
+using namespace DirectX;
+
+namespace
+{
+	constexpr float GRAVITY = 9.81f;
+	//wavelength ratio of consecutive waves
+	constexpr float WAVELENGTH_FALLOFF = 0.75f;
+	//the displacement is a contraction for steepness below 1, each iteration shrinks the error by that factor
+	constexpr int REST_POSITION_ITERATIONS = 3;
+
+	float Fraction(float x) { return x - floorf(x); }
+}
+
+GerstnerWaves::GerstnerWaves(int waveCount, float wavelength, float amplitude, float direction, float spread, float steepness)
+	: m_time(0.0f)
+{
+	for (int i = 0; i < waveCount; i++)
+	{
+		float l = wavelength * powf(WAVELENGTH_FALLOFF, static_cast<float>(i));
+		float k = XM_2PI / l;
+
+		// low discrepancy sequences give evenly spread, deterministic directions and phases
+		float angle = direction + spread * (Fraction(i * 0.618034f) - 0.5f);
+
+		m_kx.push_back(k * cosf(angle));
+		m_kz.push_back(k * sinf(angle));
+		// deep water dispersion relation
+		m_omega.push_back(sqrtf(GRAVITY * k));
+		m_phase.push_back(XM_2PI * Fraction(i * 0.754877f));
+		// constant steepness - amplitude proportional to the wavelength
+		m_amplitude.push_back(amplitude * l / wavelength);
+		// the steepness is shared by all waves, so that the sum of their slopes never folds the surface over
+		m_offsetX.push_back(steepness * cosf(angle) / (k * waveCount));
+		m_offsetZ.push_back(steepness * sinf(angle) / (k * waveCount));
+	}
+
+	m_timePhase = m_phase;
+}
+
+void GerstnerWaves::Update(float dt)
+{
+	m_time += dt;
+
+	for (size_t w = 0; w < m_phase.size(); w++)
+	{
+		m_timePhase[w] = fmodf(m_phase[w] - m_omega[w] * m_time, XM_2PI);
+	}
+}
+
+void GerstnerWaves::SampleHeights(const float* x, const float* z, float* heights, size_t count) const
+{
+	const size_t waves = m_amplitude.size();
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		const auto px = _mm_loadu_ps(x + i);
+		const auto pz = _mm_loadu_ps(z + i);
+
+		// a surface point resting at r is moved to r + sum(offset * cos(k.r + phase)), that map is inverted
+		auto rx = px, rz = pz;
+		for (int it = 0; it < REST_POSITION_ITERATIONS; it++)
+		{
+			auto dx = _mm_setzero_ps(), dz = _mm_setzero_ps();
+			for (size_t w = 0; w < waves; w++)
+			{
+				auto arg = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, _mm_set1_ps(m_kx[w])), _mm_mul_ps(rz, _mm_set1_ps(m_kz[w]))),
+					_mm_set1_ps(m_timePhase[w]));
+				auto c = XMVectorCos(arg);
+				dx = _mm_add_ps(dx, _mm_mul_ps(c, _mm_set1_ps(m_offsetX[w])));
+				dz = _mm_add_ps(dz, _mm_mul_ps(c, _mm_set1_ps(m_offsetZ[w])));
+			}
+			rx = _mm_sub_ps(px, dx);
+			rz = _mm_sub_ps(pz, dz);
+		}
+
+		auto h = _mm_setzero_ps();
+		for (size_t w = 0; w < waves; w++)
+		{
+			auto arg = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, _mm_set1_ps(m_kx[w])), _mm_mul_ps(rz, _mm_set1_ps(m_kz[w]))),
+				_mm_set1_ps(m_timePhase[w]));
+			h = _mm_add_ps(h, _mm_mul_ps(XMVectorSin(arg), _mm_set1_ps(m_amplitude[w])));
+		}
+
+		_mm_storeu_ps(heights + i, h);
+	}
+
+	for (; i < count; i++)
+	{
+		float rx = x[i], rz = z[i];
+		for (int it = 0; it < REST_POSITION_ITERATIONS; it++)
+		{
+			float dx = 0.0f, dz = 0.0f;
+			for (size_t w = 0; w < waves; w++)
+			{
+				float c = cosf(rx * m_kx[w] + rz * m_kz[w] + m_timePhase[w]);
+				dx += m_offsetX[w] * c;
+				dz += m_offsetZ[w] * c;
+			}
+			rx = x[i] - dx;
+			rz = z[i] - dz;
+		}
+
+		float h = 0.0f;
+		for (size_t w = 0; w < waves; w++)
+		{
+			h += m_amplitude[w] * sinf(rx * m_kx[w] + rz * m_kz[w] + m_timePhase[w]);
+		}
+
+		heights[i] = h;
+	}
+}
\ No newline at end of file
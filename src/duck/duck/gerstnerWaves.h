@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+
+#include "heightSource.h"
+
+namespace mini::gk2
+{
+	//Sum of Gerstner (trochoidal) waves used as the far-field water surface.
+	//The surface is analytic and stateless, so its cost depends only on the number of
+	//sampled points and waves, not on the size of the covered area.
+	//Every wave also moves the surface points horizontally towards its crests. Heights are requested
+	//at fixed positions, so the rest position of the surface point that ends up there is found
+	//by fixed-point iteration before the heights are summed.
+	class GerstnerWaves : public HeightSource
+	{
+	public:
+		//waveCount - number of summed waves
+		//wavelength, amplitude - parameters of the longest wave, shorter waves scale both down
+		//direction - main direction of travel (radians), spread - angular range of wave directions
+		//steepness - in [0, 1), 0 gives plain sines, crests get sharper towards 1 where they turn into cusps
+		GerstnerWaves(int waveCount, float wavelength, float amplitude, float direction, float spread, float steepness);
+
+		void Update(float dt);
+
+		void SampleHeights(const float* x, const float* z, float* heights, size_t count) const override;
+
+		int waveCount() const { return static_cast<int>(m_amplitude.size()); }
+
+	private:
+		float m_time;
+
+		//structure of arrays - wave vector, angular frequency, initial phase and amplitude of each wave
+		std::vector<float> m_kx, m_kz, m_omega, m_phase, m_amplitude;
+		//horizontal displacement amplitude of each wave along x and z
+		std::vector<float> m_offsetX, m_offsetZ;
+		//initial phase shifted by the elapsed time, refreshed by Update
+		std::vector<float> m_timePhase;
+	};
+}
\ No newline at end of file
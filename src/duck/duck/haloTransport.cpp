@@ -0,0 +1,295 @@
+// winsock2.h has to come before Windows.h, which is included by the headers below
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+#include "haloTransport.h"
+#include "exceptions.h"
+
+#include <cstring>
+
+using namespace mini::gk2;
+
+namespace
+{
+	//busy waiting iterations before the waiting thread starts giving up its time slice
+	constexpr int SPIN_COUNT = 4000;
+	//the strip above may not be listening yet when a worker starts
+	constexpr int CONNECT_ATTEMPTS = 100;
+	constexpr DWORD CONNECT_RETRY_INTERVAL = 100;
+	//rows a connection can buffer before the sender blocks
+	constexpr int ROWS_IN_FLIGHT = 4;
+
+	SOCKET Listen(int port)
+	{
+		SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (s == INVALID_SOCKET)
+			throw mini::WinAPIException(__AT__, WSAGetLastError());
+
+		sockaddr_in address = {};
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_ANY);
+		address.sin_port = htons(static_cast<u_short>(port));
+
+		if (bind(s, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == SOCKET_ERROR || listen(s, 1) == SOCKET_ERROR)
+		{
+			auto error = WSAGetLastError();
+			closesocket(s);
+			throw mini::WinAPIException(__AT__, error);
+		}
+
+		return s;
+	}
+
+	SOCKET Connect(const std::wstring& host, int port)
+	{
+		ADDRINFOW hints = {};
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_protocol = IPPROTO_TCP;
+
+		ADDRINFOW* address = nullptr;
+		if (int error = GetAddrInfoW(host.c_str(), std::to_wstring(port).c_str(), &hints, &address))
+			throw mini::WinAPIException(__AT__, error);
+
+		int error = 0;
+		for (int attempt = 0; attempt < CONNECT_ATTEMPTS; attempt++)
+		{
+			SOCKET s = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+			if (s == INVALID_SOCKET)
+			{
+				error = WSAGetLastError();
+				break;
+			}
+
+			if (connect(s, address->ai_addr, static_cast<int>(address->ai_addrlen)) == 0)
+			{
+				FreeAddrInfoW(address);
+				return s;
+			}
+
+			error = WSAGetLastError();
+			closesocket(s);
+			Sleep(CONNECT_RETRY_INTERVAL);
+		}
+
+		FreeAddrInfoW(address);
+		throw mini::WinAPIException(__AT__, error);
+	}
+
+	//Rows are small and exchanged every step, they shouldn't wait for more data to be sent
+	void Configure(SOCKET s, int messageSize)
+	{
+		BOOL noDelay = TRUE;
+		int buffer = ROWS_IN_FLIGHT * messageSize;
+
+		if (setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay)) == SOCKET_ERROR
+			|| setsockopt(s, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&buffer), sizeof(buffer)) == SOCKET_ERROR
+			|| setsockopt(s, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&buffer), sizeof(buffer)) == SOCKET_ERROR)
+		{
+			throw mini::WinAPIException(__AT__, WSAGetLastError());
+		}
+	}
+
+	void SendAll(SOCKET s, const char* data, int size)
+	{
+		while (size > 0)
+		{
+			int sent = send(s, data, size, 0);
+			if (sent == SOCKET_ERROR)
+				throw mini::WinAPIException(__AT__, WSAGetLastError());
+
+			data += sent;
+			size -= sent;
+		}
+	}
+
+	void ReceiveAll(SOCKET s, char* data, int size)
+	{
+		while (size > 0)
+		{
+			int received = recv(s, data, size, 0);
+			if (received == SOCKET_ERROR)
+				throw mini::WinAPIException(__AT__, WSAGetLastError());
+			if (received == 0)
+				THROW(L"The neighbouring water strip closed its connection");
+
+			data += received;
+			size -= received;
+		}
+	}
+}
+
+size_t SharedMemoryHaloTransport::BlockSize(int subdomains, int rowLength)
+{
+	return subdomains * 2 * (sizeof(Slot) + 2 * rowLength * sizeof(float));
+}
+
+SharedMemoryHaloTransport::SharedMemoryHaloTransport(const std::wstring& name, int subdomains, int rowLength, bool create)
+	: m_mapping(nullptr), m_view(nullptr), m_subdomains(subdomains), m_rowLength(rowLength)
+{
+	const auto size = static_cast<unsigned long long>(BlockSize(subdomains, rowLength));
+
+	if (create)
+	{
+		m_mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+			static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), name.c_str());
+
+		// an existing block belongs to another batch, it may be smaller and its workers would see our rows
+		if (m_mapping && GetLastError() == ERROR_ALREADY_EXISTS)
+		{
+			CloseHandle(m_mapping);
+			THROW(L"The water batch shared memory block " + name + L" is already in use");
+		}
+	}
+	else
+	{
+		m_mapping = OpenFileMappingW(FILE_MAP_ALL_ACCESS, FALSE, name.c_str());
+	}
+
+	if (!m_mapping)
+		THROW_WINAPI;
+
+	m_view = static_cast<unsigned char*>(MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, static_cast<SIZE_T>(size)));
+	if (!m_view)
+	{
+		CloseHandle(m_mapping);
+		THROW_WINAPI;
+	}
+
+	if (create)
+	{
+		for (int i = 0; i < subdomains; i++)
+		{
+			for (auto side : { HaloSide::Top, HaloSide::Bottom })
+			{
+				auto slot = GetSlot(i, side);
+				slot->published[0] = slot->published[1] = -1;
+			}
+		}
+	}
+}
+
+SharedMemoryHaloTransport::~SharedMemoryHaloTransport()
+{
+	UnmapViewOfFile(m_view);
+	CloseHandle(m_mapping);
+}
+
+SharedMemoryHaloTransport::Slot* SharedMemoryHaloTransport::GetSlot(int subdomain, HaloSide side) const
+{
+	return reinterpret_cast<Slot*>(m_view) + subdomain * 2 + static_cast<int>(side);
+}
+
+float* SharedMemoryHaloTransport::GetRow(int subdomain, HaloSide side, int buffer) const
+{
+	auto rows = reinterpret_cast<float*>(m_view + m_subdomains * 2 * sizeof(Slot));
+	return rows + ((subdomain * 2 + static_cast<int>(side)) * 2 + buffer) * m_rowLength;
+}
+
+void SharedMemoryHaloTransport::Publish(int subdomain, HaloSide side, int step, const float* row)
+{
+	const int buffer = step & 1;
+
+	memcpy(GetRow(subdomain, side, buffer), row, m_rowLength * sizeof(float));
+
+	// full barrier - the row is visible before its step tag
+	InterlockedExchange(&GetSlot(subdomain, side)->published[buffer], step);
+}
+
+void SharedMemoryHaloTransport::Receive(int subdomain, HaloSide side, int step, float* row)
+{
+	const int neighbour = side == HaloSide::Top ? subdomain - 1 : subdomain + 1;
+	const HaloSide neighbourSide = side == HaloSide::Top ? HaloSide::Bottom : HaloSide::Top;
+	const int buffer = step & 1;
+
+	auto flag = &GetSlot(neighbour, neighbourSide)->published[buffer];
+
+	for (int spin = 0; InterlockedCompareExchange(flag, -1, -1) != step; spin++)
+	{
+		if (spin < SPIN_COUNT)
+			YieldProcessor();
+		else
+			SwitchToThread();
+	}
+
+	memcpy(row, GetRow(neighbour, neighbourSide, buffer), m_rowLength * sizeof(float));
+}
+
+SocketHaloTransport::SocketHaloTransport(int subdomain, int subdomains, int rowLength, const std::wstring& topHost, int basePort)
+	: m_top(INVALID_SOCKET), m_bottom(INVALID_SOCKET), m_rowLength(rowLength), m_message(sizeof(int) + rowLength * sizeof(float))
+{
+	WSADATA data;
+	if (int error = WSAStartup(MAKEWORD(2, 2), &data))
+		throw WinAPIException(__AT__, error);
+
+	SOCKET listener = INVALID_SOCKET;
+	try
+	{
+		// every strip listens before it connects, so strips never wait for each other's connections
+		if (subdomain + 1 < subdomains)
+			listener = Listen(basePort + subdomain);
+
+		if (subdomain > 0)
+		{
+			m_top = Connect(topHost, basePort + subdomain - 1);
+			Configure(m_top, static_cast<int>(m_message.size()));
+		}
+
+		if (listener != INVALID_SOCKET)
+		{
+			m_bottom = accept(listener, nullptr, nullptr);
+			if (m_bottom == INVALID_SOCKET)
+				throw WinAPIException(__AT__, WSAGetLastError());
+
+			closesocket(listener);
+			listener = INVALID_SOCKET;
+			Configure(m_bottom, static_cast<int>(m_message.size()));
+		}
+	}
+	catch (...)
+	{
+		if (listener != INVALID_SOCKET)
+			closesocket(listener);
+		Close();
+		throw;
+	}
+}
+
+SocketHaloTransport::~SocketHaloTransport()
+{
+	Close();
+}
+
+void SocketHaloTransport::Close()
+{
+	if (m_top != INVALID_SOCKET)
+		closesocket(m_top);
+	if (m_bottom != INVALID_SOCKET)
+		closesocket(m_bottom);
+
+	WSACleanup();
+}
+
+void SocketHaloTransport::Publish(int subdomain, HaloSide side, int step, const float* row)
+{
+	UNREFERENCED_PARAMETER(subdomain);
+
+	memcpy(m_message.data(), &step, sizeof(int));
+	memcpy(m_message.data() + sizeof(int), row, m_rowLength * sizeof(float));
+
+	SendAll(side == HaloSide::Top ? m_top : m_bottom, m_message.data(), static_cast<int>(m_message.size()));
+}
+
+void SocketHaloTransport::Receive(int subdomain, HaloSide side, int step, float* row)
+{
+	UNREFERENCED_PARAMETER(subdomain);
+
+	ReceiveAll(side == HaloSide::Top ? m_top : m_bottom, m_message.data(), static_cast<int>(m_message.size()));
+
+	int received;
+	memcpy(&received, m_message.data(), sizeof(int));
+	if (received != step)
+		THROW(L"Expected a halo row of step " + std::to_wstring(step) + L", received one of step " + std::to_wstring(received));
+
+	memcpy(row, m_message.data() + sizeof(int), m_rowLength * sizeof(float));
+}
\ No newline at end of file
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <Windows.h>
+#include <string>
+#include <vector>
+
+namespace mini::gk2
+{
+	enum class HaloSide
+	{
+		Top,	//towards the neighbouring strip with smaller row indices
+		Bottom	//towards the neighbouring strip with larger row indices
+	};
+
+	//Exchange of boundary rows between neighbouring strips of a decomposed water grid.
+	//Rows are tagged with the simulation step they belong to, a strip never runs more than
+	//one step ahead of its neighbours, so two rows in flight per side are enough.
+	class HaloTransport
+	{
+	public:
+		virtual ~HaloTransport() = default;
+
+		//Makes the boundary row of the subdomain on the given side available to its neighbour
+		virtual void Publish(int subdomain, HaloSide side, int step, const float* row) = 0;
+
+		//Waits until the neighbour on the given side publishes its boundary row for step and copies it
+		virtual void Receive(int subdomain, HaloSide side, int step, float* row) = 0;
+	};
+
+	//Halo exchange through a named shared memory block, usable by worker processes on a single host.
+	//Creating a block whose name is already taken fails, so that two batches never share their rows.
+	class SharedMemoryHaloTransport : public HaloTransport
+	{
+	public:
+		//name - name of the shared block, create - true for the process which sets the block up,
+		//workers open the existing one
+		SharedMemoryHaloTransport(const std::wstring& name, int subdomains, int rowLength, bool create);
+		~SharedMemoryHaloTransport() override;
+
+		SharedMemoryHaloTransport(const SharedMemoryHaloTransport& other) = delete;
+		SharedMemoryHaloTransport& operator=(const SharedMemoryHaloTransport& other) = delete;
+
+		void Publish(int subdomain, HaloSide side, int step, const float* row) override;
+		void Receive(int subdomain, HaloSide side, int step, float* row) override;
+
+	private:
+		//separate cache lines keep flags of different strips from false sharing
+		struct alignas(64) Slot
+		{
+			volatile LONG published[2];	//step stored in each of the two row buffers
+		};
+
+		Slot* GetSlot(int subdomain, HaloSide side) const;
+		float* GetRow(int subdomain, HaloSide side, int buffer) const;
+
+		static size_t BlockSize(int subdomains, int rowLength);
+
+		HANDLE m_mapping;
+		unsigned char* m_view;
+		int m_subdomains;
+		int m_rowLength;
+	};
+
+	//Halo exchange over TCP connections, a stand-in for workers running on separate hosts.
+	//Every strip listens on basePort + index for the strip below it and connects to the strip above it.
+	//A connection delivers rows in order, so each message only carries the step it belongs to.
+	class SocketHaloTransport : public HaloTransport
+	{
+	public:
+		//topHost - host running the strip above, basePort - port of the first strip
+		SocketHaloTransport(int subdomain, int subdomains, int rowLength, const std::wstring& topHost, int basePort);
+		~SocketHaloTransport() override;
+
+		SocketHaloTransport(const SocketHaloTransport& other) = delete;
+		SocketHaloTransport& operator=(const SocketHaloTransport& other) = delete;
+
+		void Publish(int subdomain, HaloSide side, int step, const float* row) override;
+		void Receive(int subdomain, HaloSide side, int step, float* row) override;
+
+	private:
+		void Close();
+
+		//SOCKET handles, winsock2.h has to be included before Windows.h, so it stays out of this header
+		UINT_PTR m_top, m_bottom;
+		int m_rowLength;
+
+		//step followed by the row
+		std::vector<char> m_message;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,420 @@
+#include "heightPyramid.h"
+#include "randomStreams.h"
+#include "exceptions.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <execution>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <emmintrin.h>
+
+using namespace mini::gk2;
+using namespace DirectX;
+
+namespace
+{
+	constexpr float INF = std::numeric_limits<float>::infinity();
+
+	constexpr int BENCHMARK_SIZE = 256;
+	constexpr float BENCHMARK_EXTENT = 20.0f;
+	constexpr float BENCHMARK_SCALE = 2.0f;
+	const XMFLOAT3 BENCHMARK_EYE(0.0f, 3.0f, -12.0f);
+
+	//height range of children outside of the grid, lying far above any ray's reach
+	constexpr float MISSING_CHILD = 1e30f;
+
+	//larger batches are traced in several parallel passes
+	constexpr size_t MAX_JOBS_PER_PASS = 1024;
+
+	//Indices of the jobs of a parallel pass, built once so that batches don't allocate
+	const std::vector<size_t>& JobIndices()
+	{
+		static const std::vector<size_t> indices = []
+		{
+			std::vector<size_t> v(MAX_JOBS_PER_PASS);
+			std::iota(v.begin(), v.end(), 0);
+			return v;
+		}();
+		return indices;
+	}
+
+	//Slab test of the ray against a box, returns the entry parameter or INF if the ray misses it
+	//within [0, tMax]. invD holds the reciprocals of the direction components.
+	float EnterBox(const XMFLOAT3& o, const XMFLOAT3& invD, float x0, float x1, float y0, float y1,
+		float z0, float z1, float tMax)
+	{
+		float tx0 = (x0 - o.x) * invD.x, tx1 = (x1 - o.x) * invD.x;
+		float ty0 = (y0 - o.y) * invD.y, ty1 = (y1 - o.y) * invD.y;
+		float tz0 = (z0 - o.z) * invD.z, tz1 = (z1 - o.z) * invD.z;
+
+		float enter = std::max({ std::min(tx0, tx1), std::min(ty0, ty1), std::min(tz0, tz1), 0.0f });
+		float exit = std::min({ std::max(tx0, tx1), std::max(ty0, ty1), std::max(tz0, tz1), tMax });
+
+		return enter <= exit ? enter : INF;
+	}
+
+	//Keeps the slab test finite for rays parallel to an axis
+	float NonZero(float v)
+	{
+		constexpr float EPSILON = 1e-12f;
+		return fabsf(v) < EPSILON ? std::copysign(EPSILON, v) : v;
+	}
+
+	//Moller-Trumbore ray-triangle intersection
+	bool IntersectTriangle(const XMFLOAT3& o, const XMFLOAT3& d, const XMFLOAT3& a, const XMFLOAT3& b,
+		const XMFLOAT3& c, float& t)
+	{
+		const float e1x = b.x - a.x, e1y = b.y - a.y, e1z = b.z - a.z;
+		const float e2x = c.x - a.x, e2y = c.y - a.y, e2z = c.z - a.z;
+
+		const float px = d.y * e2z - d.z * e2y;
+		const float py = d.z * e2x - d.x * e2z;
+		const float pz = d.x * e2y - d.y * e2x;
+
+		const float det = e1x * px + e1y * py + e1z * pz;
+		if (fabsf(det) < 1e-12f)
+			return false;
+
+		const float invDet = 1.0f / det;
+		const float sx = o.x - a.x, sy = o.y - a.y, sz = o.z - a.z;
+
+		const float u = (sx * px + sy * py + sz * pz) * invDet;
+		if (u < 0.0f || u > 1.0f)
+			return false;
+
+		const float qx = sy * e1z - sz * e1y;
+		const float qy = sz * e1x - sx * e1z;
+		const float qz = sx * e1y - sy * e1x;
+
+		const float v = (d.x * qx + d.y * qy + d.z * qz) * invDet;
+		if (v < 0.0f || u + v > 1.0f)
+			return false;
+
+		const float hit = (e2x * qx + e2y * qy + e2z * qz) * invDet;
+		if (hit < 0.0f || hit >= t)
+			return false;
+
+		t = hit;
+		return true;
+	}
+}
+
+HeightPyramid::HeightPyramid(int size, float extent, float scale)
+	: m_size(size), m_extent(extent), m_scale(scale), m_toGrid((size - 1) / extent),
+	m_heights(static_cast<size_t>(size) * size)
+{
+	for (int width = size - 1; ; width = (width + 1) / 2)
+	{
+		const size_t nodes = static_cast<size_t>(width) * width;
+		m_levels.push_back({ width, std::vector<float>(nodes), std::vector<float>(nodes),
+			std::vector<float>(m_levels.empty() ? 0 : 8 * nodes) });
+
+		if (width == 1)
+			break;
+	}
+
+	assert(m_levels.size() <= MAX_LEVELS);
+}
+
+void HeightPyramid::Update(const WaterSimulation& grid)
+{
+	const int n = m_size;
+	const __m128 scale = _mm_set1_ps(m_scale);
+
+	for (int y = 0; y < n; y++)
+	{
+		float* row = m_heights.data() + static_cast<size_t>(y) * n;
+		grid.ReadRow(y, row);
+
+		int x = 0;
+		for (; x + 4 <= n; x += 4)
+			_mm_storeu_ps(row + x, _mm_mul_ps(_mm_loadu_ps(row + x), scale));
+		for (; x < n; x++)
+			row[x] *= m_scale;
+	}
+
+	// height range of a cell is spanned by its four corners
+	Level& cells = m_levels[0];
+	for (int y = 0; y < cells.width; y++)
+	{
+		const float* top = m_heights.data() + static_cast<size_t>(y) * n;
+		const float* bottom = top + n;
+		float* outMin = cells.min.data() + static_cast<size_t>(y) * cells.width;
+		float* outMax = cells.max.data() + static_cast<size_t>(y) * cells.width;
+
+		int x = 0;
+		for (; x + 4 <= cells.width; x += 4)
+		{
+			auto a = _mm_loadu_ps(top + x), b = _mm_loadu_ps(top + x + 1);
+			auto c = _mm_loadu_ps(bottom + x), d = _mm_loadu_ps(bottom + x + 1);
+
+			_mm_storeu_ps(outMin + x, _mm_min_ps(_mm_min_ps(a, b), _mm_min_ps(c, d)));
+			_mm_storeu_ps(outMax + x, _mm_max_ps(_mm_max_ps(a, b), _mm_max_ps(c, d)));
+		}
+		for (; x < cells.width; x++)
+		{
+			outMin[x] = std::min({ top[x], top[x + 1], bottom[x], bottom[x + 1] });
+			outMax[x] = std::max({ top[x], top[x + 1], bottom[x], bottom[x + 1] });
+		}
+	}
+
+	for (size_t l = 1; l < m_levels.size(); l++)
+	{
+		const Level& fine = m_levels[l - 1];
+		Level& coarse = m_levels[l];
+
+		for (int y = 0; y < coarse.width; y++)
+		{
+			// odd widths leave the last node with a single child row or column
+			const size_t y0 = static_cast<size_t>(2 * y) * fine.width;
+			const size_t y1 = static_cast<size_t>(std::min(2 * y + 1, fine.width - 1)) * fine.width;
+
+			for (int x = 0; x < coarse.width; x++)
+			{
+				const int x0 = 2 * x, x1 = std::min(2 * x + 1, fine.width - 1);
+				const size_t i = static_cast<size_t>(y) * coarse.width + x;
+
+				coarse.min[i] = std::min({ fine.min[y0 + x0], fine.min[y0 + x1], fine.min[y1 + x0], fine.min[y1 + x1] });
+				coarse.max[i] = std::max({ fine.max[y0 + x0], fine.max[y0 + x1], fine.max[y1 + x0], fine.max[y1 + x1] });
+
+				const bool right = 2 * x + 1 < fine.width, below = 2 * y + 1 < fine.width;
+				float* block = coarse.children.data() + 8 * i;
+				block[0] = fine.min[y0 + x0];
+				block[1] = right ? fine.min[y0 + x1] : MISSING_CHILD;
+				block[2] = below ? fine.min[y1 + x0] : MISSING_CHILD;
+				block[3] = right && below ? fine.min[y1 + x1] : MISSING_CHILD;
+				block[4] = fine.max[y0 + x0];
+				block[5] = right ? fine.max[y0 + x1] : MISSING_CHILD;
+				block[6] = below ? fine.max[y1 + x0] : MISSING_CHILD;
+				block[7] = right && below ? fine.max[y1 + x1] : MISSING_CHILD;
+			}
+		}
+	}
+}
+
+bool HeightPyramid::IntersectCell(int x, int z, const XMFLOAT3& o, const XMFLOAT3& d, float& t) const
+{
+	const float* top = m_heights.data() + static_cast<size_t>(z) * m_size + x;
+	const float* bottom = top + m_size;
+
+	const float fx = static_cast<float>(x), fz = static_cast<float>(z);
+	const XMFLOAT3 p00(fx, top[0], fz), p10(fx + 1.0f, top[1], fz);
+	const XMFLOAT3 p01(fx, bottom[0], fz + 1.0f), p11(fx + 1.0f, bottom[1], fz + 1.0f);
+
+	// same split as the water mesh triangles
+	const bool first = IntersectTriangle(o, d, p00, p10, p01, t);
+	const bool second = IntersectTriangle(o, d, p10, p11, p01, t);
+	return first || second;
+}
+
+RayHit HeightPyramid::Raycast(const XMFLOAT3& origin, const XMFLOAT3& direction) const
+{
+	RayHit hit;
+	Raycast(&origin, &direction, &hit, 1);
+	return hit;
+}
+
+void HeightPyramid::Raycast(const XMFLOAT3* origins, const XMFLOAT3* directions, RayHit* hits, size_t count) const
+{
+	if (count <= RAYS_PER_JOB)
+	{
+		RaycastRange(origins, directions, hits, 0, count);
+		return;
+	}
+
+	// rays are independent, large batches are split into ranges traced in parallel
+	const auto& jobs = JobIndices();
+	for (size_t pass = 0; pass < count; pass += MAX_JOBS_PER_PASS * RAYS_PER_JOB)
+	{
+		const size_t jobCount = std::min(MAX_JOBS_PER_PASS, (count - pass + RAYS_PER_JOB - 1) / RAYS_PER_JOB);
+		std::for_each(std::execution::par, jobs.begin(), jobs.begin() + jobCount, [=, this](size_t job)
+		{
+			const size_t first = pass + job * RAYS_PER_JOB;
+			RaycastRange(origins, directions, hits, first, std::min(count, first + RAYS_PER_JOB));
+		});
+	}
+}
+
+void HeightPyramid::RaycastRange(const XMFLOAT3* origins, const XMFLOAT3* directions, RayHit* hits,
+	size_t first, size_t last) const
+{
+	struct Node
+	{
+		int level, x, z;
+	};
+
+	// every visited node pushes at most 4 children, a fixed array keeps queries free of allocations
+	Node stack[3 * MAX_LEVELS + 1];
+
+	const float half = 0.5f * m_extent;
+	const int root = static_cast<int>(m_levels.size()) - 1;
+	const float side = static_cast<float>(m_size - 1);
+
+	// child offsets of the lanes of a children block
+	const __m128 laneX = _mm_setr_ps(0.0f, 1.0f, 0.0f, 1.0f);
+	const __m128 laneZ = _mm_setr_ps(0.0f, 0.0f, 1.0f, 1.0f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 maxCoord = _mm_set1_ps(side);
+
+	for (size_t r = first; r < last; r++)
+	{
+		// grid space: x and z in cells, y unchanged, the ray parameter is preserved by the affine mapping
+		const XMFLOAT3 o((origins[r].x + half) * m_toGrid, origins[r].y, (origins[r].z + half) * m_toGrid);
+		const XMFLOAT3 d(directions[r].x * m_toGrid, directions[r].y, directions[r].z * m_toGrid);
+		const XMFLOAT3 invD(1.0f / NonZero(d.x), 1.0f / NonZero(d.y), 1.0f / NonZero(d.z));
+
+		// lanes of the children from the nearest one, the ray crosses them in this order
+		const int nearX = d.x >= 0.0f ? 0 : 1;
+		const int nearZ = d.z >= 0.0f ? 0 : 1;
+		const bool xMajor = fabsf(d.x) >= fabsf(d.z);
+		int order[4];
+		for (int c = 0; c < 4; c++)
+		{
+			const int a = c & 1, b = c >> 1;
+			order[c] = ((xMajor ? a : b) ^ nearX) | ((xMajor ? b : a) ^ nearZ) << 1;
+		}
+
+		const __m128 ox = _mm_set1_ps(o.x), oy = _mm_set1_ps(o.y), oz = _mm_set1_ps(o.z);
+		const __m128 ix = _mm_set1_ps(invD.x), iy = _mm_set1_ps(invD.y), iz = _mm_set1_ps(invD.z);
+
+		float t = INF;
+		int top = 0;
+
+		const Level& rootLevel = m_levels[root];
+		if (EnterBox(o, invD, 0.0f, side, rootLevel.min[0], rootLevel.max[0], 0.0f, side, INF) != INF)
+			stack[top++] = { root, 0, 0 };
+
+		// nodes on the stack already passed their box test, the first hit found ends the search
+		while (top > 0)
+		{
+			const Node node = stack[--top];
+
+			if (node.level == 0)
+			{
+				// cells are visited in the order the ray crosses them, the first hit is the nearest one
+				if (IntersectCell(node.x, node.z, o, d, t))
+					break;
+				continue;
+			}
+
+			// slab test of all four children at once
+			const Level& level = m_levels[node.level];
+			const float* block = level.children.data() + 8 * (static_cast<size_t>(node.z) * level.width + node.x);
+			const float cells = static_cast<float>(1 << (node.level - 1));
+			const __m128 size = _mm_set1_ps(cells);
+
+			const __m128 x0 = _mm_mul_ps(_mm_add_ps(_mm_set1_ps(2.0f * node.x), laneX), size);
+			const __m128 z0 = _mm_mul_ps(_mm_add_ps(_mm_set1_ps(2.0f * node.z), laneZ), size);
+			const __m128 x1 = _mm_min_ps(_mm_add_ps(x0, size), maxCoord);
+			const __m128 z1 = _mm_min_ps(_mm_add_ps(z0, size), maxCoord);
+
+			const __m128 tx0 = _mm_mul_ps(_mm_sub_ps(x0, ox), ix), tx1 = _mm_mul_ps(_mm_sub_ps(x1, ox), ix);
+			const __m128 ty0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(block), oy), iy);
+			const __m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(block + 4), oy), iy);
+			const __m128 tz0 = _mm_mul_ps(_mm_sub_ps(z0, oz), iz), tz1 = _mm_mul_ps(_mm_sub_ps(z1, oz), iz);
+
+			const __m128 enter = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx0, tx1), _mm_min_ps(ty0, ty1)), _mm_max_ps(_mm_min_ps(tz0, tz1), zero));
+			const __m128 exit = _mm_min_ps(_mm_max_ps(tx0, tx1), _mm_min_ps(_mm_max_ps(ty0, ty1), _mm_max_ps(tz0, tz1)));
+			const int overlap = _mm_movemask_ps(_mm_cmple_ps(enter, exit));
+
+			// pushed far to near, so that the nearest child is popped first
+			for (int c = 3; c >= 0; c--)
+			{
+				const int lane = order[c];
+				if (overlap & (1 << lane))
+					stack[top++] = { node.level - 1, 2 * node.x + (lane & 1), 2 * node.z + (lane >> 1) };
+			}
+		}
+
+		RayHit& hit = hits[r];
+		hit.hit = t != INF;
+		hit.t = hit.hit ? t : 0.0f;
+		hit.position = hit.hit ? XMFLOAT3(origins[r].x + t * directions[r].x, origins[r].y + t * directions[r].y,
+			origins[r].z + t * directions[r].z) : origins[r];
+	}
+}
+
+float HeightPyramid::HeightAt(float x, float z) const
+{
+	const float maxCoord = static_cast<float>(m_size - 1) - 0.001f;
+	const float gx = std::clamp((x + 0.5f * m_extent) * m_toGrid, 0.0f, maxCoord);
+	const float gz = std::clamp((z + 0.5f * m_extent) * m_toGrid, 0.0f, maxCoord);
+
+	const int ix = static_cast<int>(gx), iz = static_cast<int>(gz);
+	const float fx = gx - ix, fz = gz - iz;
+
+	const float* top = m_heights.data() + static_cast<size_t>(iz) * m_size + ix;
+	const float* bottom = top + m_size;
+
+	const float h0 = top[0] + (top[1] - top[0]) * fx;
+	const float h1 = bottom[0] + (bottom[1] - bottom[0]) * fx;
+	return h0 + (h1 - h0) * fz;
+}
+
+void mini::gk2::RunRaycastBenchmark(const std::wstring& reportPath, size_t rays, int frames)
+{
+	std::wofstream report(reportPath);
+	if (!report)
+		THROW(L"Couldn't open the raycast benchmark report file");
+
+	WaterSimulation water(BENCHMARK_SIZE, 1.0f, 1.0f / BENCHMARK_SIZE, 2.0f / (BENCHMARK_SIZE - 1), BENCHMARK_SIZE / 8);
+	for (int i = 1; i < 8; i++)
+		water.Disturb(BENCHMARK_SIZE * i / 8, BENCHMARK_SIZE * ((i * 5) % 8 + 1) / 10, 0.25f);
+	for (int s = 0; s < 100; s++)
+		water.Step();
+
+	HeightPyramid pyramid(BENCHMARK_SIZE, BENCHMARK_EXTENT, BENCHMARK_SCALE);
+	pyramid.Update(water);
+
+	// rays from a single eye towards random points of the water plane, like mouse picking from many cameras at once
+	Philox random = RandomStreams(1).Stream(RandomSubsystem::Benchmark);
+	std::vector<XMFLOAT3> origins(rays, BENCHMARK_EYE), directions(rays);
+	for (auto& d : directions)
+	{
+		d = XMFLOAT3(random.Uniform(-0.5f, 0.5f) * BENCHMARK_EXTENT - BENCHMARK_EYE.x, -BENCHMARK_EYE.y,
+			random.Uniform(-0.5f, 0.5f) * BENCHMARK_EXTENT - BENCHMARK_EYE.z);
+	}
+
+	std::vector<RayHit> hits(rays);
+	double parallel = 0.0, sequential = 0.0;
+	for (int f = 0; f < frames; f++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		pyramid.Raycast(origins.data(), directions.data(), hits.data(), rays);
+		auto batched = std::chrono::steady_clock::now();
+		for (size_t r = 0; r < rays; r++)
+			hits[r] = pyramid.Raycast(origins[r], directions[r]);
+		auto single = std::chrono::steady_clock::now();
+
+		parallel += std::chrono::duration<double>(batched - start).count();
+		sequential += std::chrono::duration<double>(single - batched).count();
+	}
+
+	size_t hitCount = 0;
+	float error = 0.0f;
+	for (const auto& hit : hits)
+	{
+		if (!hit.hit)
+			continue;
+
+		hitCount++;
+		error = std::max(error, fabsf(hit.position.y - pyramid.HeightAt(hit.position.x, hit.position.z)));
+	}
+
+	report << L"rays\thits\tparallel ms\tsequential ms\tns/ray\tmax surface distance\n";
+	report << rays << L"\t" << hitCount << L"\t" << 1000.0 * parallel / frames << L"\t" << 1000.0 * sequential / frames << L"\t"
+		<< 1e9 * sequential / (static_cast<double>(frames) * rays) << L"\t" << error << L"\n";
+}
+
+bool mini::gk2::RunRaycastCommand(int argc, wchar_t** argv)
+{
+	if (argc < 3 || std::wstring(argv[1]) != L"--raycast-bench")
+		return false;
+
+	RunRaycastBenchmark(argv[2]);
+	return true;
+}
\ No newline at end of file
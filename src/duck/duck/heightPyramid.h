@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <DirectXMath.h>
+#include <string>
+#include <vector>
+
+#include "waterSimulation.h"
+
+namespace mini::gk2
+{
+	struct RayHit
+	{
+		bool hit;
+		float t;	//ray parameter of the hit, position = origin + t * direction
+		DirectX::XMFLOAT3 position;
+	};
+
+	//Min/max height pyramid over the water grid for ray queries against the live surface.
+	//Level 0 stores the height range of every grid cell, each next level merges 2x2 nodes.
+	//Rays descend the pyramid front to back and only test triangles of cells whose
+	//whole parent chain overlaps the ray.
+	//Queries use the water plane local space, the grid covers [-extent/2, extent/2]^2.
+	class HeightPyramid
+	{
+	public:
+		//rays traced by a single job of a parallel batch
+		static constexpr size_t RAYS_PER_JOB = 256;
+		//every level halves the side of the grid, an int sized grid never needs more
+		static constexpr int MAX_LEVELS = 32;
+
+		//extent - side of the area covered by the grid, scale - factor applied to the grid heights
+		HeightPyramid(int size, float extent, float scale);
+
+		//Rebuilds the pyramid from the current simulation heights
+		void Update(const WaterSimulation& grid);
+
+		//Finds the nearest intersection of every ray with the surface
+		void Raycast(const DirectX::XMFLOAT3* origins, const DirectX::XMFLOAT3* directions, RayHit* hits, size_t count) const;
+		RayHit Raycast(const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& direction) const;
+
+		float HeightAt(float x, float z) const;
+		bool IsBelowSurface(const DirectX::XMFLOAT3& point) const { return point.y < HeightAt(point.x, point.z); }
+
+		int levelCount() const { return static_cast<int>(m_levels.size()); }
+
+	private:
+		struct Level
+		{
+			int width;	//nodes along each side
+			std::vector<float> min, max;
+			//per node, minima and then maxima of its four children in the order (0, 0), (1, 0), (0, 1), (1, 1),
+			//so that a single load fetches everything a box test of the children needs
+			std::vector<float> children;
+		};
+
+		void RaycastRange(const DirectX::XMFLOAT3* origins, const DirectX::XMFLOAT3* directions, RayHit* hits,
+			size_t first, size_t last) const;
+
+		//Intersects the ray given in grid space with the two triangles of cell (x, z), t is lowered on a hit
+		bool IntersectCell(int x, int z, const DirectX::XMFLOAT3& o, const DirectX::XMFLOAT3& d, float& t) const;
+
+		int m_size;
+		float m_extent;
+		float m_scale;
+		float m_toGrid;
+
+		std::vector<float> m_heights;	//scaled, row-major copy of the grid
+		std::vector<Level> m_levels;	//level 0 holds single grid cells
+	};
+
+	//Traces batches of rays from a camera above a rippled 256 x 256 grid, one batch per frame, and writes
+	//the mean batch time of the parallel and the sequential query and the largest distance of a hit
+	//from the surface to reportPath
+	void RunRaycastBenchmark(const std::wstring& reportPath, size_t rays = 10000, int frames = 100);
+
+	//Handles the --raycast-bench <report> command line switch, returns false if it's not present
+	bool RunRaycastCommand(int argc, wchar_t** argv);
+}
\ No newline at end of file
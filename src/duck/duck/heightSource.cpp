@@ -0,0 +1,122 @@
+#include "heightSource.h"
+
+#include <algorithm>
+#include <cmath>
+#include <emmintrin.h>
+
+using namespace mini::gk2;
+
+GridHeightSource::GridHeightSource(const WaterSimulation& grid, float extent, float scale)
+	: m_grid(grid), m_size(grid.size()), m_extent(extent), m_scale(scale)
+{ }
+
+void GridHeightSource::SampleHeights(const float* x, const float* z, float* heights, size_t count) const
+{
+	const float toGrid = (m_size - 1) / m_extent;
+	const float maxCoord = static_cast<float>(m_size - 1) - 0.001f;
+
+	const __m128 half = _mm_set1_ps(0.5f * m_extent);
+	const __m128 scale = _mm_set1_ps(toGrid);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 upper = _mm_set1_ps(maxCoord);
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		// grid coordinates, clamped so that the bilinear footprint stays inside the grid
+		auto gx = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_add_ps(_mm_loadu_ps(x + i), half), scale), zero), upper);
+		auto gz = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_add_ps(_mm_loadu_ps(z + i), half), scale), zero), upper);
+
+		auto ix = _mm_cvttps_epi32(gx);
+		auto iz = _mm_cvttps_epi32(gz);
+		auto fx = _mm_sub_ps(gx, _mm_cvtepi32_ps(ix));
+		auto fz = _mm_sub_ps(gz, _mm_cvtepi32_ps(iz));
+
+		// SSE2 has no gather, corner heights are fetched one lane at a time
+		alignas(16) int cols[4], rows[4];
+		_mm_store_si128(reinterpret_cast<__m128i*>(cols), ix);
+		_mm_store_si128(reinterpret_cast<__m128i*>(rows), iz);
+
+		alignas(16) float h00[4], h10[4], h01[4], h11[4];
+		for (int k = 0; k < 4; k++)
+		{
+			h00[k] = m_grid.height(cols[k], rows[k]);
+			h10[k] = m_grid.height(cols[k] + 1, rows[k]);
+			h01[k] = m_grid.height(cols[k], rows[k] + 1);
+			h11[k] = m_grid.height(cols[k] + 1, rows[k] + 1);
+		}
+
+		auto top = _mm_add_ps(_mm_load_ps(h00), _mm_mul_ps(fx, _mm_sub_ps(_mm_load_ps(h10), _mm_load_ps(h00))));
+		auto bottom = _mm_add_ps(_mm_load_ps(h01), _mm_mul_ps(fx, _mm_sub_ps(_mm_load_ps(h11), _mm_load_ps(h01))));
+		auto h = _mm_add_ps(top, _mm_mul_ps(fz, _mm_sub_ps(bottom, top)));
+
+		_mm_storeu_ps(heights + i, _mm_mul_ps(h, _mm_set1_ps(m_scale)));
+	}
+
+	for (; i < count; i++)
+	{
+		float gx = std::clamp((x[i] + 0.5f * m_extent) * toGrid, 0.0f, maxCoord);
+		float gz = std::clamp((z[i] + 0.5f * m_extent) * toGrid, 0.0f, maxCoord);
+
+		int ix = static_cast<int>(gx);
+		int iz = static_cast<int>(gz);
+		float fx = gx - ix;
+		float fz = gz - iz;
+
+		float h00 = m_grid.height(ix, iz), h10 = m_grid.height(ix + 1, iz);
+		float h01 = m_grid.height(ix, iz + 1), h11 = m_grid.height(ix + 1, iz + 1);
+		float top = h00 + fx * (h10 - h00);
+		float bottom = h01 + fx * (h11 - h01);
+
+		heights[i] = (top + fz * (bottom - top)) * m_scale;
+	}
+}
+
+HybridHeightSource::HybridHeightSource(const HeightSource& nearField, const HeightSource& farField, float nearExtent,
+	float blendWidth, float farScale)
+	: m_near(nearField), m_far(farField), m_halfExtent(0.5f * nearExtent), m_blendWidth(blendWidth), m_farScale(farScale)
+{ }
+
+void HybridHeightSource::SampleHeights(const float* x, const float* z, float* heights, size_t count) const
+{
+	m_near.SampleHeights(x, z, heights, count);
+	BlendFarField(x, z, heights, count);
+}
+
+void HybridHeightSource::BlendFarField(const float* x, const float* z, float* heights, size_t count) const
+{
+	m_farHeights.resize(count);
+	m_far.SampleHeights(x, z, m_farHeights.data(), count);
+
+	const float* far = m_farHeights.data();
+
+	const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	const __m128 half = _mm_set1_ps(m_halfExtent);
+	const __m128 invWidth = _mm_set1_ps(1.0f / m_blendWidth);
+	const __m128 farScale = _mm_set1_ps(m_farScale);
+	const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), three = _mm_set1_ps(3.0f), two = _mm_set1_ps(2.0f);
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		// distance from the border of the near-field square, positive inside
+		auto dist = _mm_max_ps(_mm_and_ps(_mm_loadu_ps(x + i), signMask), _mm_and_ps(_mm_loadu_ps(z + i), signMask));
+		auto t = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(half, dist), invWidth), zero), one);
+		// smoothstep keeps the blended surface free of creases
+		auto w = _mm_mul_ps(_mm_mul_ps(t, t), _mm_sub_ps(three, _mm_mul_ps(two, t)));
+
+		auto nearH = _mm_loadu_ps(heights + i);
+		auto farH = _mm_mul_ps(_mm_loadu_ps(far + i), farScale);
+		_mm_storeu_ps(heights + i, _mm_add_ps(farH, _mm_mul_ps(w, _mm_sub_ps(nearH, farH))));
+	}
+
+	for (; i < count; i++)
+	{
+		float dist = std::max(fabsf(x[i]), fabsf(z[i]));
+		float t = std::clamp((m_halfExtent - dist) / m_blendWidth, 0.0f, 1.0f);
+		float w = t * t * (3.0f - 2.0f * t);
+
+		float farH = far[i] * m_farScale;
+		heights[i] = farH + w * (heights[i] - farH);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "waterSimulation.h"
+
+namespace mini::gk2
+{
+	//Batched height lookup used by the water geometry generators.
+	//Positions are given in the water plane's local space (x, z).
+	class HeightSource
+	{
+	public:
+		virtual ~HeightSource() = default;
+
+		virtual void SampleHeights(const float* x, const float* z, float* heights, size_t count) const = 0;
+	};
+
+	//Bilinear lookup into the simulation's height grid covering [-extent/2, extent/2]^2,
+	//works with any of the simulation's memory layouts
+	class GridHeightSource : public HeightSource
+	{
+	public:
+		GridHeightSource(const WaterSimulation& grid, float extent, float scale = 1.0f);
+
+		void SampleHeights(const float* x, const float* z, float* heights, size_t count) const override;
+
+	private:
+		const WaterSimulation& m_grid;
+		int m_size;
+		float m_extent;
+		float m_scale;
+	};
+
+	//Near-field heights inside a square of side nearExtent centered at the origin, blended
+	//across a band along its border into far-field heights outside of it
+	class HybridHeightSource : public HeightSource
+	{
+	public:
+		//farScale - factor applied to the far-field heights to match the units of the near field
+		HybridHeightSource(const HeightSource& nearField, const HeightSource& farField, float nearExtent, float blendWidth,
+			float farScale = 1.0f);
+
+		void SampleHeights(const float* x, const float* z, float* heights, size_t count) const override;
+
+		//Blends the far field into near-field heights already sampled at the same points
+		void BlendFarField(const float* x, const float* z, float* heights, size_t count) const;
+
+	private:
+		const HeightSource& m_near;
+		const HeightSource& m_far;
+		float m_halfExtent;
+		float m_blendWidth;
+		float m_farScale;
+
+		mutable std::vector<float> m_farHeights;
+	};
+}
\ No newline at end of file
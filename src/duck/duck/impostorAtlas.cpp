@@ -0,0 +1,74 @@
+#include "impostorAtlas.h"
+#include "dxStructures.h"
+
+#include <cmath>
+
+using namespace mini;
+using namespace mini::gk2;
+using namespace DirectX;
+
+ImpostorAtlas::ImpostorAtlas(const DxDevice& device, int views, unsigned int tileSize)
+	: m_views(views), m_tilesPerRow(static_cast<int>(ceilf(sqrtf(static_cast<float>(views))))), m_tileSize(tileSize)
+{
+	const unsigned int rows = (views + m_tilesPerRow - 1) / m_tilesPerRow;
+
+	Texture2DDescription texDesc(m_tilesPerRow * tileSize, rows * tileSize);
+	texDesc.BindFlags |= D3D11_BIND_RENDER_TARGET;
+	texDesc.MiscFlags = D3D11_RESOURCE_MISC_GENERATE_MIPS;
+	texDesc.MipLevels = 1;
+	for (unsigned int size = tileSize; size > MIN_TILE_SIZE; size /= 2)
+		texDesc.MipLevels++;
+
+	m_atlasTexture = device.CreateTexture(texDesc);
+	m_atlasView = device.CreateShaderResourceView(m_atlasTexture);
+	m_renderTarget = device.CreateRenderTargetView(m_atlasTexture);
+
+	SIZE s;
+	s.cx = texDesc.Width;
+	s.cy = texDesc.Height;
+	m_depthBuffer = device.CreateDepthStencilView(s);
+}
+
+int ImpostorAtlas::NearestView(float yaw, int views)
+{
+	int view = static_cast<int>(floorf(yaw * views / XM_2PI + 0.5f)) % views;
+	return view < 0 ? view + views : view;
+}
+
+void ImpostorAtlas::Bake(const dx_ptr<ID3D11DeviceContext>& context, XMFLOAT3 center, float radius, float elevation,
+	const DrawFunction& draw)
+{
+	float clearColor[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	context->ClearRenderTargetView(m_renderTarget.get(), clearColor);
+	context->ClearDepthStencilView(m_depthBuffer.get(), D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+
+	ID3D11RenderTargetView* targets[1] = { m_renderTarget.get() };
+	context->OMSetRenderTargets(1, targets, m_depthBuffer.get());
+
+	// the eye stays outside of the bounding sphere, the sphere fills the whole tile
+	XMFLOAT4X4 projMtx;
+	XMStoreFloat4x4(&projMtx, XMMatrixOrthographicLH(2.0f * radius, 2.0f * radius, radius, 3.0f * radius));
+
+	SIZE s;
+	s.cx = s.cy = m_tileSize;
+	Viewport viewport{ s };
+
+	const XMVECTOR target = XMLoadFloat3(&center);
+
+	for (int k = 0; k < m_views; k++)
+	{
+		viewport.TopLeftX = static_cast<float>(k % m_tilesPerRow * m_tileSize);
+		viewport.TopLeftY = static_cast<float>(k / m_tilesPerRow * m_tileSize);
+		context->RSSetViewports(1, &viewport);
+
+		const float a = XM_2PI * k / m_views;
+		XMVECTOR direction = XMVectorSet(sinf(a) * cosf(elevation), sinf(elevation), cosf(a) * cosf(elevation), 0.0f);
+
+		XMFLOAT4X4 viewMtx;
+		XMStoreFloat4x4(&viewMtx, XMMatrixLookAtLH(target + 2.0f * radius * direction, target, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)));
+
+		draw(viewMtx, projMtx);
+	}
+
+	context->GenerateMips(m_atlasView.get());
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <functional>
+#include <DirectXMath.h>
+
+#include "dxDevice.h"
+
+namespace mini::gk2
+{
+	//Square tiles holding pictures of an object seen from views evenly spaced around its y axis.
+	//Tile k shows the object from the direction (sin a, ., cos a) of its local space, a = 2 * pi * k / views,
+	//lifted by a common elevation angle. Tiles are stored row by row, the background is transparent.
+	class ImpostorAtlas
+	{
+	public:
+		//smallest tile kept in the mip chain, lower levels would mix neighbouring tiles
+		static constexpr unsigned int MIN_TILE_SIZE = 8;
+
+		using DrawFunction = std::function<void(const DirectX::XMFLOAT4X4& viewMtx, const DirectX::XMFLOAT4X4& projMtx)>;
+
+		ImpostorAtlas(const DxDevice& device, int views, unsigned int tileSize);
+
+		//Renders all views of the object contained in the sphere (center, radius) with an orthographic projection
+		//draw - renders the object in its local space with the given matrices into the current render target
+		void Bake(const dx_ptr<ID3D11DeviceContext>& context, DirectX::XMFLOAT3 center, float radius, float elevation,
+			const DrawFunction& draw);
+
+		//Index of the baked view closest to the direction given by its angle about the y axis
+		static int NearestView(float yaw, int views);
+
+		int views() const { return m_views; }
+		int tilesPerRow() const { return m_tilesPerRow; }
+		const dx_ptr<ID3D11ShaderResourceView>& srv() const { return m_atlasView; }
+
+	private:
+		int m_views;
+		int m_tilesPerRow;
+		unsigned int m_tileSize;
+
+		dx_ptr<ID3D11Texture2D> m_atlasTexture;
+		dx_ptr<ID3D11ShaderResourceView> m_atlasView;
+		dx_ptr<ID3D11RenderTargetView> m_renderTarget;
+		dx_ptr<ID3D11DepthStencilView> m_depthBuffer;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+cbuffer cbProj : register(b0) //Geometry Shader constant buffer slot 0
+{
+	matrix projMatrix;
+};
+
+cbuffer cbImpostor : register(b1) //Geometry Shader constant buffer slot 1
+{
+	float4 impostor; //y of the bounding sphere's center and its radius in model units, view count, tiles per row
+};
+
+struct GSInput
+{
+	float4 pos : POSITION;
+	float size : TEXCOORD0;
+	float view : TEXCOORD1;
+};
+
+struct PSInput
+{
+	float4 pos : SV_POSITION;
+	float2 tex : TEXCOORD0;
+};
+
+[maxvertexcount(4)]
+void main(point GSInput inArray[1], inout TriangleStream<PSInput> ostream)
+{
+	GSInput i = inArray[0];
+
+	float tilesPerRow = impostor.w;
+	float rows = ceil(impostor.z / tilesPerRow);
+	float2 tile = float2(fmod(i.view, tilesPerRow), floor(i.view / tilesPerRow));
+	float2 tileSize = float2(1.0f / tilesPerRow, 1.0f / rows);
+
+	// camera facing quad in view space covering the bounding sphere, corners in strip order
+	static const float2 corners[4] = { float2(-1.0f, -1.0f), float2(-1.0f, 1.0f), float2(1.0f, -1.0f), float2(1.0f, 1.0f) };
+
+	PSInput o = (PSInput)0;
+	for (int k = 0; k < 4; k++)
+	{
+		o.pos = mul(projMatrix, i.pos + float4(corners[k] * i.size, 0.0f, 0.0f));
+		o.tex = (tile + float2(0.5f + 0.5f * corners[k].x, 0.5f - 0.5f * corners[k].y)) * tileSize;
+		ostream.Append(o);
+	}
+
+	ostream.RestartStrip();
+}
\ No newline at end of file
@@ -0,0 +1,18 @@
+Texture2D atlas : register(t0);
+SamplerState colorSampler : register(s0);
+
+struct PSInput
+{
+	float4 pos : SV_POSITION;
+	float2 tex : TEXCOORD0;
+};
+
+float4 main(PSInput i) : SV_TARGET
+{
+	float4 color = atlas.Sample(colorSampler, i.tex);
+
+	// alpha tested, impostors are drawn in any order with the depth test on
+	if (color.a < 0.5f)
+		discard;
+	return float4(color.rgb / color.a, 1.0f);
+}
\ No newline at end of file
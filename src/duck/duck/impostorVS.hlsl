@@ -0,0 +1,43 @@
+cbuffer cbImpostor : register(b0) //Vertex Shader constant buffer slot 0
+{
+	float4 impostor; //y of the bounding sphere's center and its radius in model units, view count, tiles per row
+};
+
+cbuffer cbView : register(b1) //Vertex Shader constant buffer slot 1
+{
+	matrix viewMatrix;
+	matrix invViewMatrix;
+};
+
+struct VSInput
+{
+	float4 positionScale : INSTANCE0;
+	float2 rotation : INSTANCE1;
+};
+
+struct GSInput
+{
+	float4 pos : POSITION;
+	float size : TEXCOORD0;
+	float view : TEXCOORD1;
+};
+
+static const float PI2 = 6.28318531f;
+
+GSInput main(VSInput i)
+{
+	GSInput o = (GSInput)0;
+	float scale = i.positionScale.w;
+	float3 center = i.positionScale.xyz + float3(0.0f, impostor.x * scale, 0.0f);
+
+	// direction towards the camera in the model's local space, the inverse rotation negates the sine
+	float3 camPos = mul(invViewMatrix, float4(0.0f, 0.0f, 0.0f, 1.0f)).xyz;
+	float3 toCam = camPos - i.positionScale.xyz;
+	float2 local = float2(toCam.x * i.rotation.x - toCam.z * i.rotation.y, toCam.z * i.rotation.x + toCam.x * i.rotation.y);
+
+	float views = impostor.z;
+	o.view = fmod(floor(atan2(local.x, local.y) * views / PI2 + 0.5f) + views, views);
+	o.pos = mul(viewMatrix, float4(center, 1.0f));
+	o.size = impostor.y * scale;
+	return o;
+}
\ No newline at end of file
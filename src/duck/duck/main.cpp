@@ -1,5 +1,19 @@
 ﻿#include "exceptions.h"
 #include "duckDemo.h"
+#include "waterSimulation.h"
+#include "waterNormalMap.h"
+#include "waterBatch.h"
+#include "pondBatch.h"
+#include "heightPyramid.h"
+#include "cubeFaceSchedule.h"
+#include "waterPlanner.h"
+#include "duckFleet.h"
+#include "randomStreams.h"
+#include "particleKernels.h"
+#include "depthSort.h"
+#include "particleEngine.h"
+
+#include <shellapi.h>
 
 using namespace std;
 using namespace mini;
@@ -11,10 +25,24 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE prevInstance, LPWSTR cmdLine,
 	UNREFERENCED_PARAMETER(cmdLine);
 	auto exitCode = EXIT_FAILURE;
 	CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
+	int argc = 0;
+	auto argv = CommandLineToArgvW(GetCommandLineW(), &argc);
 	try
 	{
-		DuckDemo app(hInstance);
-		exitCode = app.Run();
+		if (argv && (RunWaterBatchCommand(argc, argv) || RunWaterPlannerCommand(argc, argv) || RunDuckFleetCommand(argc, argv)
+			|| RunRandomCommand(argc, argv) || RunParticleCommand(argc, argv)
+			|| RunDepthSortCommand(argc, argv) || RunParticleEngineCommand(argc, argv)
+			|| RunWaterLayoutCommand(argc, argv) || RunRippleRoundnessCommand(argc, argv)
+			|| RunWaterNormalCommand(argc, argv) || RunPondBatchCommand(argc, argv)
+			|| RunRaycastCommand(argc, argv) || RunCubeFaceCommand(argc, argv) || RunInstancingCommand(argc, argv)))
+		{
+			exitCode = EXIT_SUCCESS;
+		}
+		else
+		{
+			DuckDemo app(hInstance);
+			exitCode = app.Run();
+		}
 	}
 	catch (Exception& e)
 	{
@@ -39,5 +67,6 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE prevInstance, LPWSTR cmdLine,
 	{
 		MessageBoxW(nullptr, L"Nieznany Błąd", L"Błąd", MB_OK);
 	}
+	LocalFree(argv);
 	return exitCode;
 }
\ No newline at end of file
@@ -37,6 +37,27 @@ namespace mini
 		Mesh& operator=(Mesh&& right) noexcept;
 		void Render(const dx_ptr<ID3D11DeviceContext>& context) const;
 
+		//Draws instanceCount copies of the mesh in a single call, instance data is bound to instanceSlot().
+		//Context is a pointer to a device context or to anything else taking the same calls, e.g. a recorder.
+		template<typename Context>
+		void RenderInstanced(const Context& context, const dx_ptr<ID3D11Buffer>& instances,
+			unsigned int instanceStride, unsigned int instanceCount) const
+		{
+			if (!m_indexBuffer || m_vertexBuffers.empty() || instanceCount == 0)
+				return;
+			context->IASetPrimitiveTopology(m_primitiveType);
+			context->IASetIndexBuffer(m_indexBuffer.get(), DXGI_FORMAT_R16_UINT, 0);
+			context->IASetVertexBuffers(0, m_vertexBuffers.size(), m_vertexBuffers.data(), m_strides.data(), m_offsets.data());
+
+			ID3D11Buffer* instanceBuffer = instances.get();
+			unsigned int offset = 0;
+			context->IASetVertexBuffers(instanceSlot(), 1, &instanceBuffer, &instanceStride, &offset);
+			context->DrawIndexedInstanced(m_indexCount, instanceCount, 0, 0, 0);
+		}
+
+		//vertex buffer slot of the instance data, following the mesh's own buffers
+		unsigned int instanceSlot() const { return static_cast<unsigned int>(m_vertexBuffers.size()); }
+
 		template<typename VertexType>
 		static Mesh SimpleTriMesh(const DxDevice& device, const std::vector<VertexType> verts, const std::vector<unsigned short> idxs)
 		{
@@ -0,0 +1,201 @@
+#include "particleEngine.h"
+#include "exceptions.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <execution>
+#include <fstream>
+#include <numeric>
+
+using namespace mini::gk2;
+using namespace DirectX;
+
+namespace
+{
+	constexpr float BENCHMARK_SPACING = 4.0f;
+	constexpr float BENCHMARK_TIME_TO_LIVE = 4.0f;
+	constexpr float BENCHMARK_FRAME_TIME = 1.0f / 60.0f;
+	const XMFLOAT4 BENCHMARK_CAMERA(0.0f, 20.0f, -40.0f, 1.0f);
+
+	double Seconds(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+size_t ParticleEngine::AddEmitter(const EmitterDesc& desc)
+{
+	const size_t index = m_emitters.size();
+	m_emitters.emplace_back(desc, static_cast<uint32_t>(index));
+	m_costs.push_back({ 0.0, 0.0 });
+	return index;
+}
+
+size_t ParticleEngine::particlesCount() const
+{
+	size_t count = 0;
+	for (const auto& e : m_emitters)
+		count += e.particlesCount();
+	return count;
+}
+
+size_t ParticleEngine::capacity() const
+{
+	size_t count = 0;
+	for (const auto& e : m_emitters)
+		count += e.capacity();
+	return count;
+}
+
+void ParticleEngine::SetEmissionRatio(float ratio)
+{
+	for (auto& e : m_emitters)
+		e.SetEmissionRatio(ratio);
+}
+
+void ParticleEngine::Update(float dt)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	m_jobs.clear();
+	for (size_t i = 0; i < m_emitters.size(); i++)
+	{
+		for (const auto& range : m_emitters[i].pool().Ranges())
+		{
+			for (size_t first = range.first; first < range.last; first += PARTICLES_PER_JOB)
+				m_jobs.push_back({ i, { first, std::min(range.last, first + PARTICLES_PER_JOB) } });
+		}
+	}
+	m_jobTimes.resize(m_jobs.size());
+
+	m_jobIndices.resize(m_jobs.size());
+	std::iota(m_jobIndices.begin(), m_jobIndices.end(), 0);
+	std::for_each(std::execution::par, m_jobIndices.begin(), m_jobIndices.end(), [=, this](size_t j)
+	{
+		auto jobStart = std::chrono::steady_clock::now();
+		m_emitters[m_jobs[j].emitter].Integrate(m_jobs[j].range, dt);
+		m_jobTimes[j] = Seconds(jobStart);
+	});
+
+	for (auto& cost : m_costs)
+		cost.update = 0.0;
+	for (size_t j = 0; j < m_jobs.size(); j++)
+		m_costs[m_jobs[j].emitter].update += m_jobTimes[j];
+
+	// emission draws from the emitter's own stream, so emitters don't share any state
+	m_emitterIndices.resize(m_emitters.size());
+	std::iota(m_emitterIndices.begin(), m_emitterIndices.end(), 0);
+	std::for_each(std::execution::par, m_emitterIndices.begin(), m_emitterIndices.end(), [=, this](size_t i)
+	{
+		auto spawnStart = std::chrono::steady_clock::now();
+		m_emitters[i].Spawn(dt);
+		m_costs[i].update += Seconds(spawnStart);
+	});
+
+	m_updateTime = Seconds(start);
+}
+
+void ParticleEngine::WriteVertices(XMFLOAT4 cameraPosition, std::span<ParticleVertex> output)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	if (output.size() < particlesCount())
+		THROW(L"Particle vertex output is too small");
+
+	m_distances.resize(m_emitters.size());
+	for (size_t i = 0; i < m_emitters.size(); i++)
+	{
+		const auto& p = m_emitters[i].desc().position;
+		const float dx = p.x - cameraPosition.x, dy = p.y - cameraPosition.y, dz = p.z - cameraPosition.z;
+		m_distances[i] = dx * dx + dy * dy + dz * dz;
+	}
+
+	// whole emitters are ordered, merging their particles by depth would cost another pass over the stream
+	m_order.resize(m_emitters.size());
+	std::iota(m_order.begin(), m_order.end(), 0);
+	std::sort(m_order.begin(), m_order.end(), [this](size_t a, size_t b) { return m_distances[a] > m_distances[b]; });
+
+	m_offsets.resize(m_emitters.size());
+	size_t offset = 0;
+	for (size_t i : m_order)
+	{
+		m_offsets[i] = offset;
+		offset += m_emitters[i].particlesCount();
+	}
+
+	std::for_each(std::execution::par, m_order.begin(), m_order.end(), [=, this](size_t i)
+	{
+		auto writeStart = std::chrono::steady_clock::now();
+		m_emitters[i].WriteVertices(cameraPosition, output.subspan(m_offsets[i], m_emitters[i].particlesCount()));
+		m_costs[i].write = Seconds(writeStart);
+	});
+
+	m_writeTime = Seconds(start);
+}
+
+void mini::gk2::RunParticleEngineBenchmark(const std::wstring& reportPath, size_t emitters, size_t particles, int frames)
+{
+	std::wofstream report(reportPath);
+	if (!report)
+		THROW(L"Couldn't open the particle engine benchmark report file");
+
+	// emitters stand on a square grid and are born as fast as they die, so they stay full
+	const size_t side = static_cast<size_t>(ceil(sqrt(static_cast<double>(emitters))));
+	ParticleEngine engine;
+	for (size_t i = 0; i < emitters; i++)
+	{
+		EmitterDesc desc = EmitterDesc::Smoke(XMFLOAT3(BENCHMARK_SPACING * (i % side), 0.0f, BENCHMARK_SPACING * (i / side)));
+		desc.capacity = particles / emitters;
+		desc.timeToLive = BENCHMARK_TIME_TO_LIVE;
+		desc.emissionRate = desc.capacity / BENCHMARK_TIME_TO_LIVE;
+		desc.maxAngle = XM_PIDIV4;
+		engine.AddEmitter(desc);
+	}
+
+	std::vector<ParticleVertex> vertices(engine.capacity());
+
+	for (float t = 0.0f; t < BENCHMARK_TIME_TO_LIVE; t += BENCHMARK_FRAME_TIME)
+		engine.Update(BENCHMARK_FRAME_TIME);
+	engine.WriteVertices(BENCHMARK_CAMERA, vertices);
+
+	std::vector<EmitterCost> costs(emitters, EmitterCost{ 0.0, 0.0 });
+	double update = 0.0, write = 0.0;
+	for (int f = 0; f < frames; f++)
+	{
+		engine.Update(BENCHMARK_FRAME_TIME);
+		engine.WriteVertices(BENCHMARK_CAMERA, vertices);
+
+		update += engine.updateTime();
+		write += engine.writeTime();
+		for (size_t i = 0; i < emitters; i++)
+		{
+			costs[i].update += engine.cost(i).update;
+			costs[i].write += engine.cost(i).write;
+		}
+	}
+
+	report << L"emitter\tparticles\tupdate ms\twrite ms\n";
+
+	// the sum over emitters is the CPU time, the wall time of the engine shows how well it was spread over threads
+	EmitterCost total{ 0.0, 0.0 };
+	for (size_t i = 0; i < emitters; i++)
+	{
+		report << i << L"\t" << engine.emitter(i).particlesCount() << L"\t" << 1000.0 * costs[i].update / frames << L"\t"
+			<< 1000.0 * costs[i].write / frames << L"\n";
+		total.update += costs[i].update;
+		total.write += costs[i].write;
+	}
+
+	report << L"all\t" << engine.particlesCount() << L"\t" << 1000.0 * total.update / frames << L"\t" << 1000.0 * total.write / frames << L"\n";
+	report << L"wall\t" << engine.particlesCount() << L"\t" << 1000.0 * update / frames << L"\t" << 1000.0 * write / frames << L"\n";
+}
+
+bool mini::gk2::RunParticleEngineCommand(int argc, wchar_t** argv)
+{
+	if (argc < 3 || std::wstring(argv[1]) != L"--engine-bench")
+		return false;
+
+	RunParticleEngineBenchmark(argv[2]);
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <vector>
+
+#include "particleSystem.h"
+
+namespace mini::gk2
+{
+	//Time spent on an emitter during the last frame, summed over all jobs working on it
+	struct EmitterCost
+	{
+		double update;	//seconds of integration, expiration and emission
+		double write;	//seconds of sorting and writing vertices
+	};
+
+	//Many independent emitters updated in parallel and drawn from a single vertex stream.
+	//Integration is split into jobs of at most PARTICLES_PER_JOB slots, so that a few large emitters
+	//keep all threads busy as well as many small ones.
+	class ParticleEngine
+	{
+	public:
+		static constexpr size_t PARTICLES_PER_JOB = 16384;
+
+		//Adds an emitter with its own random stream and returns its index
+		size_t AddEmitter(const EmitterDesc& desc);
+
+		void Update(float dt);
+
+		//Scales the emission rates of all emitters, the number of live particles follows within their time to live
+		void SetEmissionRatio(float ratio);
+
+		//Writes vertices of all particles to output, which must have room for particlesCount() vertices.
+		//Emitters follow each other back to front by the distance of their positions from the camera,
+		//particles of every emitter are sorted back to front. Particles of different emitters aren't
+		//interleaved, so the order is only exact for emitters whose clouds don't overlap on screen.
+		void WriteVertices(DirectX::XMFLOAT4 cameraPosition, std::span<ParticleVertex> output);
+
+		size_t emitterCount() const { return m_emitters.size(); }
+		const ParticleSystem& emitter(size_t i) const { return m_emitters[i]; }
+		const EmitterCost& cost(size_t i) const { return m_costs[i]; }
+
+		size_t particlesCount() const;
+		size_t capacity() const;	//vertices the stream may need at most
+
+		//Wall time of the last Update and WriteVertices in seconds
+		double updateTime() const { return m_updateTime; }
+		double writeTime() const { return m_writeTime; }
+
+	private:
+		struct Job
+		{
+			size_t emitter;
+			ParticlePool::Range range;
+		};
+
+		std::vector<ParticleSystem> m_emitters;
+		std::vector<EmitterCost> m_costs;
+
+		//kept between frames, so that updates don't allocate once the counts settle
+		std::vector<Job> m_jobs;
+		std::vector<double> m_jobTimes;
+		std::vector<size_t> m_jobIndices;	//0 .. m_jobs.size() - 1, iterated by the parallel integration
+		std::vector<size_t> m_emitterIndices;	//0 .. m_emitters.size() - 1, iterated by the parallel emission
+		std::vector<float> m_distances;	//squared distances of the emitters from the camera
+		std::vector<size_t> m_order;	//emitters from the farthest one during the last write
+		std::vector<size_t> m_offsets;	//first vertex of every emitter in the stream
+
+		double m_updateTime = 0.0;
+		double m_writeTime = 0.0;
+	};
+
+	//Runs a grid of emitters totalling the given number of live particles for the given number of frames
+	//after they fill up, writes the mean cost of every emitter and of the whole engine to reportPath
+	void RunParticleEngineBenchmark(const std::wstring& reportPath, size_t emitters = 64, size_t particles = 1 << 20, int frames = 60);
+
+	//Handles the --engine-bench <report> command line switch, returns false if it's not present
+	bool RunParticleEngineCommand(int argc, wchar_t** argv);
+}
\ No newline at end of file
@@ -0,0 +1,159 @@
+#include "particleKernels.h"
+#include "cpuFeatures.h"
+#include "exceptions.h"
+#include "randomStreams.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <immintrin.h>
+#include <span>
+
+using namespace mini::gk2;
+
+namespace
+{
+	constexpr size_t LANES = 8;
+	constexpr float BENCHMARK_FRAME_TIME = 1.0f / 60.0f;
+	constexpr float BENCHMARK_SCALE = 1.0f;
+
+	//Pointers to all attribute arrays of a pool
+	struct ParticleArrays
+	{
+		float *x, *y, *z;
+		const float *vx, *vy, *vz;
+		float* age;
+		float* angle;
+		const float* angularVelocity;
+		float* size;
+
+		explicit ParticleArrays(ParticlePool& pool)
+			: x(pool.data(ParticlePool::PositionX)), y(pool.data(ParticlePool::PositionY)), z(pool.data(ParticlePool::PositionZ)),
+			vx(pool.data(ParticlePool::VelocityX)), vy(pool.data(ParticlePool::VelocityY)), vz(pool.data(ParticlePool::VelocityZ)),
+			age(pool.data(ParticlePool::Age)), angle(pool.data(ParticlePool::Angle)),
+			angularVelocity(pool.data(ParticlePool::AngularVelocity)), size(pool.data(ParticlePool::Size))
+		{ }
+	};
+
+	//a += b * s without fusing, so that both kernels round the same way
+	inline __m256 MulAdd(__m256 a, __m256 b, __m256 s)
+	{
+		return _mm256_add_ps(a, _mm256_mul_ps(b, s));
+	}
+}
+
+void mini::gk2::IntegrateParticles(ParticlePool& pool, ParticlePool::Range range, float dt, float scale)
+{
+	if (HasAvx2())
+		IntegrateParticlesAvx2(pool, range, dt, scale);
+	else
+		IntegrateParticlesScalar(pool, range, dt, scale);
+}
+
+void mini::gk2::IntegrateParticlesScalar(ParticlePool& pool, ParticlePool::Range range, float dt, float scale)
+{
+	ParticleArrays p(pool);
+	const float growth = 1.0f + scale * dt;
+
+	for (size_t i = range.first; i < range.last; i++)
+	{
+		p.x[i] += p.vx[i] * dt;
+		p.y[i] += p.vy[i] * dt;
+		p.z[i] += p.vz[i] * dt;
+		p.age[i] += dt;
+		p.angle[i] += p.angularVelocity[i] * dt;
+		p.size[i] *= growth;
+	}
+}
+
+void mini::gk2::IntegrateParticlesAvx2(ParticlePool& pool, ParticlePool::Range range, float dt, float scale)
+{
+	ParticleArrays p(pool);
+	const __m256 t = _mm256_set1_ps(dt);
+	const __m256 growth = _mm256_set1_ps(1.0f + scale * dt);
+
+	size_t i = range.first;
+	for (; i + LANES <= range.last; i += LANES)
+	{
+		_mm256_storeu_ps(p.x + i, MulAdd(_mm256_loadu_ps(p.x + i), _mm256_loadu_ps(p.vx + i), t));
+		_mm256_storeu_ps(p.y + i, MulAdd(_mm256_loadu_ps(p.y + i), _mm256_loadu_ps(p.vy + i), t));
+		_mm256_storeu_ps(p.z + i, MulAdd(_mm256_loadu_ps(p.z + i), _mm256_loadu_ps(p.vz + i), t));
+		_mm256_storeu_ps(p.age + i, _mm256_add_ps(_mm256_loadu_ps(p.age + i), t));
+		_mm256_storeu_ps(p.angle + i, MulAdd(_mm256_loadu_ps(p.angle + i), _mm256_loadu_ps(p.angularVelocity + i), t));
+		_mm256_storeu_ps(p.size + i, _mm256_mul_ps(_mm256_loadu_ps(p.size + i), growth));
+	}
+
+	IntegrateParticlesScalar(pool, { i, range.last }, dt, scale);
+}
+
+void mini::gk2::RunParticleBenchmark(const std::wstring& reportPath, int frames)
+{
+	std::wofstream report(reportPath);
+	if (!report)
+		THROW(L"Couldn't open the particle benchmark report file");
+
+	report << L"particles\tscalar ms\tavx2 ms\tmax difference\n";
+
+	for (size_t count : { 10000, 100000, 1000000 })
+	{
+		ParticlePool scalar(count);
+		Philox random = RandomStreams(1).Stream(RandomSubsystem::Benchmark);
+
+		for (size_t i = 0; i < count; i++)
+			scalar.Emit();
+		for (int a = 0; a < ParticlePool::AttributeCount; a++)
+		{
+			auto attribute = static_cast<ParticlePool::Attribute>(a);
+			random.FillUniform(std::span<float>(scalar.data(attribute), count), -1.0f, 1.0f);
+		}
+
+		ParticlePool simd = scalar;
+		const ParticlePool::Range all{ 0, count };
+
+		auto start = std::chrono::steady_clock::now();
+		for (int f = 0; f < frames; f++)
+			IntegrateParticlesScalar(scalar, all, BENCHMARK_FRAME_TIME, BENCHMARK_SCALE);
+		auto scalarEnd = std::chrono::steady_clock::now();
+
+		// without AVX2 the second pass runs the scalar kernel again
+		for (int f = 0; f < frames; f++)
+			IntegrateParticles(simd, all, BENCHMARK_FRAME_TIME, BENCHMARK_SCALE);
+		auto simdEnd = std::chrono::steady_clock::now();
+
+		// every attribute of every particle has to match exactly, the first mismatch is reported
+		float difference = 0.0f;
+		int mismatchAttribute = -1;
+		size_t mismatchIndex = 0;
+		for (int a = 0; a < ParticlePool::AttributeCount; a++)
+		{
+			auto attribute = static_cast<ParticlePool::Attribute>(a);
+			for (size_t i = 0; i < count; i++)
+			{
+				const float s = scalar.data(attribute)[i], v = simd.data(attribute)[i];
+				if (s != v && mismatchAttribute < 0)
+				{
+					mismatchAttribute = a;
+					mismatchIndex = i;
+				}
+				difference = std::max(difference, fabsf(s - v));
+			}
+		}
+
+		report << count << L"\t" << 1000.0 * std::chrono::duration<double>(scalarEnd - start).count() / frames << L"\t"
+			<< 1000.0 * std::chrono::duration<double>(simdEnd - scalarEnd).count() / frames << L"\t" << difference << L"\n";
+
+		if (mismatchAttribute >= 0)
+			THROW(L"Scalar and AVX2 particle kernels disagree on attribute " + std::to_wstring(mismatchAttribute)
+				+ L" of particle " + std::to_wstring(mismatchIndex) + L" out of " + std::to_wstring(count));
+	}
+}
+
+bool mini::gk2::RunParticleCommand(int argc, wchar_t** argv)
+{
+	if (argc < 3 || std::wstring(argv[1]) != L"--particle-bench")
+		return false;
+
+	RunParticleBenchmark(argv[2]);
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+
+#include "particlePool.h"
+
+namespace mini::gk2
+{
+	//Advances particles in slots of the range by dt:
+	//position += velocity * dt, age += dt, angle += angularVelocity * dt, size *= 1 + scale * dt.
+	//Uses the AVX2 kernel when available, both kernels give bit-identical results.
+	void IntegrateParticles(ParticlePool& pool, ParticlePool::Range range, float dt, float scale);
+
+	void IntegrateParticlesScalar(ParticlePool& pool, ParticlePool::Range range, float dt, float scale);
+	void IntegrateParticlesAvx2(ParticlePool& pool, ParticlePool::Range range, float dt, float scale);
+
+	//Times both kernels on pools of 10k, 100k and 1M particles, checks that their results agree
+	//and writes both to reportPath
+	void RunParticleBenchmark(const std::wstring& reportPath, int frames = 100);
+
+	//Handles the --particle-bench <report> command line switch, returns false if it's not present
+	bool RunParticleCommand(int argc, wchar_t** argv);
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#include "particlePool.h"
+
+using namespace mini::gk2;
+
+ParticlePool::ParticlePool(size_t capacity)
+	: m_capacity(capacity), m_head(0), m_size(0), m_data(AttributeCount * capacity)
+{ }
+
+std::array<ParticlePool::Range, 2> ParticlePool::Ranges() const
+{
+	const size_t end = m_head + m_size;
+	if (end <= m_capacity)
+		return { Range{ m_head, end }, Range{ 0, 0 } };
+
+	return { Range{ m_head, m_capacity }, Range{ 0, end - m_capacity } };
+}
+
+size_t ParticlePool::Emit()
+{
+	return Slot(m_size++);
+}
+
+size_t ParticlePool::Expire(float timeToLive)
+{
+	// the oldest particle is always at the head
+	const float* age = data(Age);
+
+	size_t expired = 0;
+	while (m_size > 0 && age[m_head] >= timeToLive)
+	{
+		m_head = m_head + 1 < m_capacity ? m_head + 1 : 0;
+		m_size--;
+		expired++;
+	}
+
+	return expired;
+}
+
+void ParticlePool::Clear()
+{
+	m_head = 0;
+	m_size = 0;
+}
\ No newline at end of file
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+namespace mini::gk2
+{
+	//Fixed-capacity particle storage with one contiguous array per attribute.
+	//All particles live equally long, so they die in the order they were born: new ones are
+	//appended at the tail of a ring and expired ones leave from its head. Survivors are never
+	//moved and the live particles always occupy at most two contiguous ranges of slots.
+	class ParticlePool
+	{
+	public:
+		enum Attribute
+		{
+			PositionX,
+			PositionY,
+			PositionZ,
+			VelocityX,
+			VelocityY,
+			VelocityZ,
+			Age,
+			Angle,
+			AngularVelocity,
+			Size,
+			AttributeCount
+		};
+
+		//Slots [first, last) of the attribute arrays
+		struct Range
+		{
+			size_t first, last;
+
+			size_t size() const { return last - first; }
+		};
+
+		explicit ParticlePool(size_t capacity = 0);
+
+		size_t capacity() const { return m_capacity; }
+		size_t size() const { return m_size; }
+		bool empty() const { return m_size == 0; }
+		bool full() const { return m_size == m_capacity; }
+
+		float* data(Attribute a) { return m_data.data() + a * m_capacity; }
+		const float* data(Attribute a) const { return m_data.data() + a * m_capacity; }
+
+		//Slot of the i-th live particle counting from the oldest one
+		size_t Slot(size_t i) const
+		{
+			const size_t slot = m_head + i;
+			return slot < m_capacity ? slot : slot - m_capacity;
+		}
+
+		//Live particles from the oldest one, the second range is empty unless the ring wraps around
+		std::array<Range, 2> Ranges() const;
+
+		//Reserves the slot following the youngest particle, its attributes are left to the caller.
+		//The pool must not be full.
+		size_t Emit();
+
+		//Drops particles from the head as long as their age reached timeToLive, returns their number
+		size_t Expire(float timeToLive);
+
+		void Clear();
+
+	private:
+		size_t m_capacity;
+		size_t m_head;
+		size_t m_size;
+
+		std::vector<float> m_data;	//AttributeCount arrays of m_capacity values
+	};
+}
\ No newline at end of file
@@ -1,6 +1,5 @@
 #include "particleSystem.h"
-
-#include <iterator>
+#include "particleKernels.h"
 
 #include "dxDevice.h"
 #include "exceptions.h"
@@ -18,79 +17,100 @@ const D3D11_INPUT_ELEMENT_DESC ParticleVertex::Layout[4] =
 	{ "TEXCOORD", 2, DXGI_FORMAT_R32_FLOAT, 0, 20, D3D11_INPUT_PER_VERTEX_DATA, 0 }
 };
 
-const XMFLOAT3 ParticleSystem::EMITTER_DIR = XMFLOAT3(0.0f, 1.0f, 0.0f);
-const float ParticleSystem::TIME_TO_LIVE = 4.0f;
-const float ParticleSystem::EMISSION_RATE = 10.0f;
-const float ParticleSystem::MAX_ANGLE = XM_PIDIV2 / 9.0f;
-const float ParticleSystem::MIN_VELOCITY = 0.2f;
-const float ParticleSystem::MAX_VELOCITY = 0.33f;
-const float ParticleSystem::PARTICLE_SIZE = 0.08f;
-const float ParticleSystem::PARTICLE_SCALE = 1.0f;
-const float ParticleSystem::MIN_ANGLE_VEL = -XM_PI;
-const float ParticleSystem::MAX_ANGLE_VEL = XM_PI;
-const int ParticleSystem::MAX_PARTICLES = 500;
+EmitterDesc EmitterDesc::Smoke(XMFLOAT3 position)
+{
+	EmitterDesc desc;
+	desc.position = position;
+	desc.direction = XMFLOAT3(0.0f, 1.0f, 0.0f);
+	desc.capacity = 500;
+	desc.emissionRate = 10.0f;
+	desc.timeToLive = 4.0f;
+	desc.maxAngle = XM_PIDIV2 / 9.0f;
+	desc.minVelocity = 0.2f;
+	desc.maxVelocity = 0.33f;
+	desc.particleSize = 0.08f;
+	desc.particleScale = 1.0f;
+	desc.minAngleVelocity = -XM_PI;
+	desc.maxAngleVelocity = XM_PI;
+	return desc;
+}
 
 ParticleSystem::ParticleSystem(DirectX::XMFLOAT3 emmiterPosition)
-	: m_emitterPos(emmiterPosition), m_particlesToCreate(0.0f), m_random(random_device{}())
+	: ParticleSystem(EmitterDesc::Smoke(emmiterPosition))
 { }
 
-vector<ParticleVertex> ParticleSystem::Update(float dt, DirectX::XMFLOAT4 cameraPosition)
+ParticleSystem::ParticleSystem(const EmitterDesc& desc, uint32_t job)
+	: m_desc(desc), m_particlesToCreate(0.0f), m_emissionRatio(1.0f), m_pool(desc.capacity), m_sort(desc.capacity), m_expired(0),
+	m_random(RandomStreams::Global().Stream(RandomSubsystem::Particles, job))
+{ }
+
+void ParticleSystem::Update(float dt)
 {
-	size_t removeCount = 0;
-	for (auto& p : m_particles)
-	{
-		UpdateParticle(p, dt);
-		if (p.Vertex.Age >= TIME_TO_LIVE)
-			++removeCount;
-	}
-	m_particles.erase(m_particles.begin(), m_particles.begin() + removeCount);
+	for (const auto& range : m_pool.Ranges())
+		Integrate(range, dt);
 
-	m_particlesToCreate += dt * EMISSION_RATE;
-	while (m_particlesToCreate >= 1.0f)
-	{
-		--m_particlesToCreate;
-		if (m_particles.size() < MAX_PARTICLES)
-			m_particles.push_back(RandomParticle());
-	}
-	return GetParticleVerts(cameraPosition);
+	Spawn(dt);
 }
 
-XMFLOAT3 ParticleSystem::RandomVelocity()
+void ParticleSystem::Integrate(ParticlePool::Range range, float dt)
 {
-	static uniform_real_distribution<float> angleDist(0, XM_2PI);
-	static uniform_real_distribution<float> magnitudeDist(0, tan(MAX_ANGLE));
-	static uniform_real_distribution<float> velDist(MIN_VELOCITY, MAX_VELOCITY);
-	float angle = angleDist(m_random);
-	float magnitude = magnitudeDist(m_random);
-	XMFLOAT3 v{ cos(angle)*magnitude, 1.0f, sin(angle)*magnitude };
-
-	auto velocity = XMLoadFloat3(&v);
-	auto len = velDist(m_random);
-	velocity = len * XMVector3Normalize(velocity);
-	XMStoreFloat3(&v, velocity);
-	return v;
+	IntegrateParticles(m_pool, range, dt, m_desc.particleScale);
 }
 
-Particle ParticleSystem::RandomParticle()
+void ParticleSystem::Spawn(float dt)
 {
-	static const uniform_real_distribution<float> anglularVelDist(MIN_ANGLE_VEL, MAX_ANGLE_VEL);
-	Particle p;
-	// TODO : 1.27 Setup initial particle properties
+	m_expired += m_pool.Expire(m_desc.timeToLive);
 
-	return p;
+	m_particlesToCreate += dt * m_desc.emissionRate * m_emissionRatio;
+	while (m_particlesToCreate >= 1.0f)
+	{
+		--m_particlesToCreate;
+		if (!m_pool.full())
+			EmitParticle();
+	}
 }
 
-void ParticleSystem::UpdateParticle(Particle& p, float dt)
+void ParticleSystem::WriteVertices(DirectX::XMFLOAT4 cameraPosition, span<ParticleVertex> output)
 {
-	// TODO : 1.28 Update particle properties
+	if (output.size() < m_pool.size())
+		THROW(L"Particle vertex output is too small");
+
+	m_sort.Sort(m_pool, m_expired, XMFLOAT3(cameraPosition.x, cameraPosition.y, cameraPosition.z), output.data());
+	m_expired = 0;
 }
 
-vector<ParticleVertex> ParticleSystem::GetParticleVerts(DirectX::XMFLOAT4 cameraPosition)
+XMFLOAT3 ParticleSystem::RandomVelocity()
 {
-	XMFLOAT4 cameraTarget(0.0f, 0.0f, 0.0f, 1.0f);
+	float angle = m_random.Uniform(0.0f, XM_2PI);
+	float magnitude = m_random.Uniform(0.0f, tan(m_desc.maxAngle));
 
-	vector<ParticleVertex> vertices;
-	// TODO : 1.29 Copy particles' vertex data to a vector and sort them
+	// the cone's base is spanned by two vectors perpendicular to its axis
+	auto dir = XMVector3Normalize(XMLoadFloat3(&m_desc.direction));
+	auto up = fabs(m_desc.direction.x) < fabs(m_desc.direction.y) ? XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f) : XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+	auto u = XMVector3Normalize(XMVector3Cross(up, dir));
+	auto w = XMVector3Cross(dir, u);
 
-	return vertices;
+	auto velocity = dir + (sin(angle)*magnitude) * u + (cos(angle)*magnitude) * w;
+	auto len = m_random.Uniform(m_desc.minVelocity, m_desc.maxVelocity);
+	velocity = len * XMVector3Normalize(velocity);
+	XMFLOAT3 v;
+	XMStoreFloat3(&v, velocity);
+	return v;
+}
+
+void ParticleSystem::EmitParticle()
+{
+	auto velocity = RandomVelocity();
+	auto slot = m_pool.Emit();
+
+	m_pool.data(ParticlePool::PositionX)[slot] = m_desc.position.x;
+	m_pool.data(ParticlePool::PositionY)[slot] = m_desc.position.y;
+	m_pool.data(ParticlePool::PositionZ)[slot] = m_desc.position.z;
+	m_pool.data(ParticlePool::VelocityX)[slot] = velocity.x;
+	m_pool.data(ParticlePool::VelocityY)[slot] = velocity.y;
+	m_pool.data(ParticlePool::VelocityZ)[slot] = velocity.z;
+	m_pool.data(ParticlePool::Age)[slot] = 0.0f;
+	m_pool.data(ParticlePool::Angle)[slot] = 0.0f;
+	m_pool.data(ParticlePool::AngularVelocity)[slot] = m_random.Uniform(m_desc.minAngleVelocity, m_desc.maxAngleVelocity);
+	m_pool.data(ParticlePool::Size)[slot] = m_desc.particleSize;
 }
\ No newline at end of file
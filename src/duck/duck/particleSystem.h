@@ -1,9 +1,13 @@
 #pragma once
 #include <DirectXMath.h>
-#include <vector>
-#include <random>
+#include <cstdint>
+#include <span>
 #include <d3d11.h>
 
+#include "particlePool.h"
+#include "depthSort.h"
+#include "randomStreams.h"
+
 namespace mini
 {
 	namespace gk2
@@ -19,18 +23,24 @@ namespace mini
 			ParticleVertex() : Pos(0.0f, 0.0f, 0.0f), Age(0.0f), Angle(0.0f), Size(0.0f) { }
 		};
 
-		struct ParticleVelocities
-		{
-			DirectX::XMFLOAT3 Velocity;
-			float AngularVelocity;
-
-			ParticleVelocities() : Velocity(0.0f, 0.0f, 0.0f), AngularVelocity(0.0f) { }
-		};
-
-		struct Particle
+		//Parameters of a single emitter
+		struct EmitterDesc
 		{
-			ParticleVertex Vertex;
-			ParticleVelocities Velocities;
+			DirectX::XMFLOAT3 position;
+			DirectX::XMFLOAT3 direction;	//mean direction of particles' velocity
+			size_t capacity;		//maximal number of particles in the system
+			float emissionRate;		//number of particles to be born per second
+			float timeToLive;		//time of particle's life in seconds
+			float maxAngle;			//maximal angle declination from mean direction
+			float minVelocity;		//minimal value of particle's velocity
+			float maxVelocity;		//maximal value of particle's velocity
+			float particleSize;		//initial size of a particle
+			float particleScale;	//size += size*scale*dtime
+			float minAngleVelocity;	//minimal rotation speed
+			float maxAngleVelocity;	//maximal rotation speed
+
+			//Smoke rising slowly from a single point
+			static EmitterDesc Smoke(DirectX::XMFLOAT3 position);
 		};
 
 		class ParticleSystem
@@ -42,36 +52,46 @@ namespace mini
 
 			ParticleSystem(DirectX::XMFLOAT3 emmiterPosition);
 
+			//job - index of the emitter's random stream, emitters updated together should differ in it
+			explicit ParticleSystem(const EmitterDesc& desc, uint32_t job = 0);
+
 			ParticleSystem& operator=(ParticleSystem&& other) = default;
 
-			std::vector<ParticleVertex> Update(float dt, DirectX::XMFLOAT4 cameraPosition);
+			//Moves and ages particles, drops the expired ones and emits new ones
+			void Update(float dt);
 
-			size_t particlesCount() const { return m_particles.size(); }
-			static const int MAX_PARTICLES;		//maximal number of particles in the system
+			//Both steps of Update. Disjoint ranges of live slots may be integrated concurrently,
+			//all of them before Spawn.
+			void Integrate(ParticlePool::Range range, float dt);
+			void Spawn(float dt);
+
+			//Scales the emission rate of the description, e.g. to lower the number of live particles
+			void SetEmissionRatio(float ratio) { m_emissionRatio = ratio; }
+
+			//Writes vertices of all particles sorted back to front directly to output (e.g. a mapped
+			//vertex buffer), which must have room for particlesCount() vertices
+			void WriteVertices(DirectX::XMFLOAT4 cameraPosition, std::span<ParticleVertex> output);
+
+			size_t particlesCount() const { return m_pool.size(); }
+			size_t capacity() const { return m_pool.capacity(); }
+
+			const EmitterDesc& desc() const { return m_desc; }
+			const ParticlePool& pool() const { return m_pool; }
 
 		private:
-			static const DirectX::XMFLOAT3 EMITTER_DIR;	//mean direction of particles' velocity
-			static const float TIME_TO_LIVE;	//time of particle's life in seconds
-			static const float EMISSION_RATE;	//number of particles to be born per second
-			static const float MAX_ANGLE;		//maximal angle declination from mean direction
-			static const float MIN_VELOCITY;	//minimal value of particle's velocity
-			static const float MAX_VELOCITY;	//maximal value of particle's velocity
-			static const float PARTICLE_SIZE;	//initial size of a particle
-			static const float PARTICLE_SCALE;	//size += size*scale*dtime
-			static const float MIN_ANGLE_VEL;	//minimal rotation speed
-			static const float MAX_ANGLE_VEL;	//maximal rotation speed
-
-			DirectX::XMFLOAT3 m_emitterPos;
+			EmitterDesc m_desc;
 			float m_particlesToCreate;
+			float m_emissionRatio;
+
+			ParticlePool m_pool;
 
-			std::vector<Particle> m_particles;
+			DepthSort m_sort;
+			size_t m_expired;	//particles dropped from the pool since the last WriteVertices
 
-			std::default_random_engine m_random;
+			Philox m_random;
 
 			DirectX::XMFLOAT3 RandomVelocity();
-			Particle RandomParticle();
-			static void UpdateParticle(Particle& p, float dt);
-			std::vector<ParticleVertex> GetParticleVerts(DirectX::XMFLOAT4 cameraPosition);
+			void EmitParticle();
 		};
 	}
 }
\ No newline at end of file
@@ -0,0 +1,218 @@
+#include "pondBatch.h"
+#include "waterNormalMap.h"
+#include "waterStencil.h"
+#include "exceptions.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <execution>
+#include <fstream>
+
+using namespace mini::gk2;
+using namespace mini::gk2::waterStencil;
+
+namespace
+{
+	constexpr int BENCHMARK_SIZES[] = { 32, 64, 128 };
+	constexpr float BENCHMARK_WAVE_SPEED = 1.0f;
+	constexpr float BENCHMARK_TIME_STEP = 0.5f;
+	constexpr float BENCHMARK_POINTS_DISTANCE = 1.0f;
+
+	//Deterministic drop placed differently in every pond
+	template<typename Drop>
+	void AddBenchmarkDrops(int count, int size, Drop drop)
+	{
+		for (int p = 0; p < count; p++)
+			drop(p, size / 4 + p % (size / 2), size / 4 + (p * 7) % (size / 2), 1.0f);
+	}
+}
+
+PondBatch::PondBatch(int count, int size, float waveSpeed, float timeStep, float pointsDistance, int bandWidth,
+	Stencil stencil)
+	: m_count(count), m_size(size), m_stencil(stencil), m_pointsDistance(pointsDistance),
+	m_groups((count + LANES - 1) / LANES), m_instanceSteps(0), m_stepSeconds(0.0)
+{
+	m_weights = StencilWeights::Create(stencil, waveSpeed, timeStep, pointsDistance);
+
+	// ponds are small - a full damping grid is cheaper than splitting rows into band spans
+	auto band = BandDamping(size, std::clamp(bandWidth, 1, size / 2), WaterSimulation::INTERIOR_DAMPING);
+	m_damping.resize(static_cast<size_t>(size) * size);
+	for (int y = 0; y < size; y++)
+	{
+		for (int x = 0; x < size; x++)
+		{
+			m_damping[y * size + x] = band[std::min(BorderDistance(x, size), BorderDistance(y, size))];
+		}
+	}
+
+	for (auto& g : m_groups)
+	{
+		g.heights.assign(m_damping.size(), _mm_setzero_ps());
+		g.prevHeights.assign(m_damping.size(), _mm_setzero_ps());
+	}
+}
+
+void PondBatch::Disturb(int pond, int x, int y, float amount)
+{
+	x = std::clamp(x, 1, m_size - 2);
+	y = std::clamp(y, 1, m_size - 2);
+
+	auto& cell = m_groups[pond / LANES].heights[y * m_size + x];
+	reinterpret_cast<float*>(&cell)[pond % LANES] += amount;
+}
+
+float PondBatch::Height(int pond, int x, int y) const
+{
+	const auto& cell = m_groups[pond / LANES].heights[y * m_size + x];
+	return reinterpret_cast<const float*>(&cell)[pond % LANES];
+}
+
+template<bool NinePoint>
+void PondBatch::StepGroup(Group& group) const
+{
+	const int n = m_size;
+	const __m128 axis = _mm_set1_ps(m_weights.axis);
+	const __m128 diagonal = _mm_set1_ps(m_weights.diagonal);
+	const __m128 center = _mm_set1_ps(m_weights.center);
+
+	const __m128* h = group.heights.data();
+	__m128* next = group.prevHeights.data();
+
+	for (int y = 1; y < n - 1; y++)
+	{
+		const __m128* cur = h + y * n;
+		const __m128* up = cur - n;
+		const __m128* down = cur + n;
+		const float* damping = m_damping.data() + y * n;
+		__m128* out = next + y * n;
+
+		for (int x = 1; x < n - 1; x++)
+		{
+			auto sum = _mm_add_ps(_mm_add_ps(up[x], down[x]), _mm_add_ps(cur[x - 1], cur[x + 1]));
+			auto v = _mm_mul_ps(sum, axis);
+
+			if constexpr (NinePoint)
+			{
+				auto corners = _mm_add_ps(_mm_add_ps(up[x - 1], up[x + 1]), _mm_add_ps(down[x - 1], down[x + 1]));
+				v = _mm_add_ps(v, _mm_mul_ps(corners, diagonal));
+			}
+
+			v = _mm_add_ps(v, _mm_sub_ps(_mm_mul_ps(cur[x], center), out[x]));
+			out[x] = _mm_mul_ps(v, _mm_set1_ps(damping[x]));
+		}
+	}
+
+	std::swap(group.heights, group.prevHeights);
+}
+
+void PondBatch::Step()
+{
+	auto start = std::chrono::steady_clock::now();
+
+	const bool ninePoint = m_stencil == Stencil::NinePoint;
+	std::for_each(std::execution::par, m_groups.begin(), m_groups.end(), [this, ninePoint](Group& g)
+	{
+		ninePoint ? StepGroup<true>(g) : StepGroup<false>(g);
+	});
+
+	m_stepSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	m_instanceSteps += m_count;
+}
+
+void PondBatch::ReadHeights(int pond, float* heights) const
+{
+	for (int y = 0; y < m_size; y++)
+	{
+		for (int x = 0; x < m_size; x++)
+		{
+			heights[y * m_size + x] = Height(pond, x, y);
+		}
+	}
+}
+
+void PondBatch::ReadNormalMap(int pond, void* texels, size_t rowPitch) const
+{
+	for (int y = 0; y < m_size; y++)
+	{
+		auto out = static_cast<unsigned char*>(texels) + y * rowPitch;
+		const int ny = std::min(y + 1, m_size - 1);
+
+		for (int x = 0; x < m_size; x++)
+		{
+			const int nx = std::min(x + 1, m_size - 1);
+
+			auto n = WaterNormalMap::ReconstructNormal(Height(pond, x, y), Height(pond, nx, y), Height(pond, x, ny),
+				m_pointsDistance);
+
+			WaterNormalMap::EncodeNormal(n, out + 4 * x);
+		}
+	}
+}
+
+void mini::gk2::RunPondBatchBenchmark(const std::wstring& reportPath, int count, int steps)
+{
+	std::wofstream report(reportPath);
+	if (!report)
+		THROW(L"Couldn't open the pond batch benchmark report file");
+
+	report << L"size\tstencil\tponds\tbatch steps/s\tscalar steps/s\tspeedup\tmax difference\n";
+
+	for (int size : BENCHMARK_SIZES)
+	{
+		for (auto stencil : { Stencil::FivePoint, Stencil::NinePoint })
+		{
+			const int band = size / 8;
+
+			PondBatch batch(count, size, BENCHMARK_WAVE_SPEED, BENCHMARK_TIME_STEP, BENCHMARK_POINTS_DISTANCE, band, stencil);
+			AddBenchmarkDrops(count, size, [&batch](int p, int x, int y, float amount) { batch.Disturb(p, x, y, amount); });
+
+			for (int s = 0; s < steps; s++)
+				batch.Step();
+
+			// the scalar baseline steps one whole-grid solver per pond, one pond after another
+			WaterSimulationOptions options;
+			options.stencil = stencil;
+			std::vector<WaterSimulation> ponds;
+			ponds.reserve(count);
+			for (int p = 0; p < count; p++)
+				ponds.emplace_back(size, BENCHMARK_WAVE_SPEED, BENCHMARK_TIME_STEP, BENCHMARK_POINTS_DISTANCE, band, options);
+			AddBenchmarkDrops(count, size, [&ponds](int p, int x, int y, float amount) { ponds[p].Disturb(x, y, amount); });
+
+			auto start = std::chrono::steady_clock::now();
+			for (int s = 0; s < steps; s++)
+			{
+				for (auto& pond : ponds)
+					pond.Step();
+			}
+			double scalarSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			double scalarRate = static_cast<double>(count) * steps / scalarSeconds;
+
+			float difference = 0.0f;
+			std::vector<float> heights(static_cast<size_t>(size) * size), row(size);
+			for (int p = 0; p < count; p++)
+			{
+				batch.ReadHeights(p, heights.data());
+				for (int y = 0; y < size; y++)
+				{
+					ponds[p].ReadRow(y, row.data());
+					for (int x = 0; x < size; x++)
+						difference = std::max(difference, fabsf(row[x] - heights[y * size + x]));
+				}
+			}
+
+			report << size << L"\t" << (stencil == Stencil::NinePoint ? L"nine-point" : L"five-point") << L"\t" << count << L"\t"
+				<< batch.instanceStepsPerSecond() << L"\t" << scalarRate << L"\t" << batch.instanceStepsPerSecond() / scalarRate << L"\t"
+				<< difference << L"\n";
+		}
+	}
+}
+
+bool mini::gk2::RunPondBatchCommand(int argc, wchar_t** argv)
+{
+	if (argc < 3 || std::wstring(argv[1]) != L"--pond-bench")
+		return false;
+
+	RunPondBatchBenchmark(argv[2]);
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <xmmintrin.h>
+
+#include "waterSimulation.h"
+
+namespace mini::gk2
+{
+	//Simulation of many independent small square ponds of the same size.
+	//Ponds are interleaved in groups of four, one pond per SSE lane, so a single stencil
+	//evaluation advances four ponds at once. Groups are stepped in parallel.
+	class PondBatch
+	{
+	public:
+		static constexpr int LANES = 4;
+
+		//count - number of ponds, remaining parameters match those of WaterSimulation
+		PondBatch(int count, int size, float waveSpeed, float timeStep, float pointsDistance, int bandWidth,
+			Stencil stencil = Stencil::FivePoint);
+
+		//Advances all ponds by a single time step
+		void Step();
+
+		void Disturb(int pond, int x, int y, float amount);
+
+		//Copies heights of the pond into a row-major array of size() x size() values
+		void ReadHeights(int pond, float* heights) const;
+
+		//Writes the pond's RGBA8 normal map of size() x size() texels
+		void ReadNormalMap(int pond, void* texels, size_t rowPitch) const;
+
+		int count() const { return m_count; }
+		int size() const { return m_size; }
+
+		//Total number of pond steps and the rate at which they were performed
+		long long instanceSteps() const { return m_instanceSteps; }
+		double instanceStepsPerSecond() const { return m_stepSeconds > 0.0 ? m_instanceSteps / m_stepSeconds : 0.0; }
+
+	private:
+		struct Group
+		{
+			//interleaved grids - element (y * size + x) holds the point (x, y) of four ponds
+			std::vector<__m128> heights, prevHeights;
+		};
+
+		template<bool NinePoint> void StepGroup(Group& group) const;
+
+		float Height(int pond, int x, int y) const;
+
+		int m_count;
+		int m_size;
+		Stencil m_stencil;
+		StencilWeights m_weights;
+		float m_pointsDistance;
+
+		std::vector<float> m_damping;	//damping factor of every grid point
+		std::vector<Group> m_groups;
+
+		long long m_instanceSteps;
+		double m_stepSeconds;
+	};
+
+	//Steps the same ponds with PondBatch and with one single-threaded WaterSimulation per pond for each pond size,
+	//writes instance steps per second of both and the largest height difference between them to reportPath
+	void RunPondBatchBenchmark(const std::wstring& reportPath, int count = 1024, int steps = 100);
+
+	//Handles the --pond-bench <report> command line switch, returns false if it's not present
+	bool RunPondBatchCommand(int argc, wchar_t** argv);
+}
\ No newline at end of file
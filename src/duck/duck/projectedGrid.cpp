@@ -0,0 +1,167 @@
+#include "projectedGrid.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <xmmintrin.h>
+
+using namespace mini::gk2;
+using namespace DirectX;
+
+ProjectedGrid::ProjectedGrid(float extent, float normalStep)
+	: m_extent(extent), m_normalStep(normalStep),
+	m_x(VERTEX_COUNT), m_z(VERTEX_COUNT), m_h(VERTEX_COUNT),
+	m_xStep(VERTEX_COUNT), m_zStep(VERTEX_COUNT), m_hx(VERTEX_COUNT), m_hz(VERTEX_COUNT)
+{ }
+
+void ProjectedGrid::ScreenBounds(const XMFLOAT4X4& viewProjMtx, float planeHeight,
+	float& minX, float& minY, float& maxX, float& maxY) const
+{
+	minX = minY = -1.0f;
+	maxX = maxY = 1.0f;
+
+	const float h = 0.5f * m_extent;
+	const float corners[4][2] = { { -h, -h }, { h, -h }, { h, h }, { -h, h } };
+
+	float bounds[4] = { FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+	for (auto& c : corners)
+	{
+		const auto& m = viewProjMtx.m;
+		float x = c[0] * m[0][0] + planeHeight * m[1][0] + c[1] * m[2][0] + m[3][0];
+		float y = c[0] * m[0][1] + planeHeight * m[1][1] + c[1] * m[2][1] + m[3][1];
+		float w = c[0] * m[0][3] + planeHeight * m[1][3] + c[1] * m[2][3] + m[3][3];
+
+		// corner behind the camera - its projection is meaningless, cover the whole screen
+		if (w <= 1e-4f)
+			return;
+
+		bounds[0] = std::min(bounds[0], x / w);
+		bounds[1] = std::min(bounds[1], y / w);
+		bounds[2] = std::max(bounds[2], x / w);
+		bounds[3] = std::max(bounds[3], y / w);
+	}
+
+	minX = std::clamp(bounds[0], -1.0f, 1.0f);
+	minY = std::clamp(bounds[1], -1.0f, 1.0f);
+	maxX = std::clamp(bounds[2], -1.0f, 1.0f);
+	maxY = std::clamp(bounds[3], -1.0f, 1.0f);
+}
+
+void ProjectedGrid::Update(const XMFLOAT4X4& viewProjMtx, const XMFLOAT4X4& invViewProjMtx,
+	float planeHeight, const HeightSource& heights, VertexPositionNormal* output)
+{
+	float minX, minY, maxX, maxY;
+	ScreenBounds(viewProjMtx, planeHeight, minX, minY, maxX, maxY);
+
+	const auto& m = invViewProjMtx.m;
+	const float h = 0.5f * m_extent;
+	const float du = (maxX - minX) / (RESOLUTION - 1);
+	const float dv = (maxY - minY) / (RESOLUTION - 1);
+
+	const __m128 lane = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+	const __m128 plane = _mm_set1_ps(planeHeight);
+	const __m128 lo = _mm_set1_ps(-h), hi = _mm_set1_ps(h);
+	const __m128 zero = _mm_setzero_ps(), maxT = _mm_set1_ps(1e6f);
+
+	// 1. intersect camera rays going through the grid vertices with the water plane
+	for (int j = 0; j < RESOLUTION; j++)
+	{
+		const __m128 sy = _mm_set1_ps(maxY - j * dv);
+
+		// terms of the unprojection that don't depend on the screen x coordinate
+		const __m128 nearX = _mm_add_ps(_mm_mul_ps(sy, _mm_set1_ps(m[1][0])), _mm_set1_ps(m[3][0]));
+		const __m128 nearY = _mm_add_ps(_mm_mul_ps(sy, _mm_set1_ps(m[1][1])), _mm_set1_ps(m[3][1]));
+		const __m128 nearZ = _mm_add_ps(_mm_mul_ps(sy, _mm_set1_ps(m[1][2])), _mm_set1_ps(m[3][2]));
+		const __m128 nearW = _mm_add_ps(_mm_mul_ps(sy, _mm_set1_ps(m[1][3])), _mm_set1_ps(m[3][3]));
+
+		for (int i = 0; i < RESOLUTION; i += 4)
+		{
+			const __m128 sx = _mm_add_ps(_mm_set1_ps(minX), _mm_mul_ps(_mm_add_ps(_mm_set1_ps(static_cast<float>(i)), lane), _mm_set1_ps(du)));
+
+			// points on the near (z = 0) and far (z = 1) planes in homogeneous coordinates
+			auto nx = _mm_add_ps(nearX, _mm_mul_ps(sx, _mm_set1_ps(m[0][0])));
+			auto ny = _mm_add_ps(nearY, _mm_mul_ps(sx, _mm_set1_ps(m[0][1])));
+			auto nz = _mm_add_ps(nearZ, _mm_mul_ps(sx, _mm_set1_ps(m[0][2])));
+			auto nw = _mm_add_ps(nearW, _mm_mul_ps(sx, _mm_set1_ps(m[0][3])));
+			auto fx = _mm_add_ps(nx, _mm_set1_ps(m[2][0]));
+			auto fy = _mm_add_ps(ny, _mm_set1_ps(m[2][1]));
+			auto fz = _mm_add_ps(nz, _mm_set1_ps(m[2][2]));
+			auto fw = _mm_add_ps(nw, _mm_set1_ps(m[2][3]));
+
+			auto invNw = _mm_div_ps(_mm_set1_ps(1.0f), nw);
+			auto invFw = _mm_div_ps(_mm_set1_ps(1.0f), fw);
+			nx = _mm_mul_ps(nx, invNw); ny = _mm_mul_ps(ny, invNw); nz = _mm_mul_ps(nz, invNw);
+			fx = _mm_mul_ps(fx, invFw); fy = _mm_mul_ps(fy, invFw); fz = _mm_mul_ps(fz, invFw);
+
+			auto t = _mm_div_ps(_mm_sub_ps(plane, ny), _mm_sub_ps(fy, ny));
+			auto hit = _mm_and_ps(_mm_cmpgt_ps(t, zero), _mm_cmplt_ps(t, maxT));
+
+			// rays missing the plane (above the horizon) are pushed to the far plane
+			auto px = _mm_add_ps(nx, _mm_mul_ps(t, _mm_sub_ps(fx, nx)));
+			auto pz = _mm_add_ps(nz, _mm_mul_ps(t, _mm_sub_ps(fz, nz)));
+			px = _mm_or_ps(_mm_and_ps(hit, px), _mm_andnot_ps(hit, fx));
+			pz = _mm_or_ps(_mm_and_ps(hit, pz), _mm_andnot_ps(hit, fz));
+
+			px = _mm_min_ps(_mm_max_ps(px, lo), hi);
+			pz = _mm_min_ps(_mm_max_ps(pz, lo), hi);
+
+			const int idx = j * RESOLUTION + i;
+			_mm_storeu_ps(m_x.data() + idx, px);
+			_mm_storeu_ps(m_z.data() + idx, pz);
+			_mm_storeu_ps(m_xStep.data() + idx, _mm_add_ps(px, _mm_set1_ps(m_normalStep)));
+			_mm_storeu_ps(m_zStep.data() + idx, _mm_add_ps(pz, _mm_set1_ps(m_normalStep)));
+		}
+	}
+
+	// 2. sample the height field at the vertices and their neighbours
+	heights.SampleHeights(m_x.data(), m_z.data(), m_h.data(), VERTEX_COUNT);
+	heights.SampleHeights(m_xStep.data(), m_z.data(), m_hx.data(), VERTEX_COUNT);
+	heights.SampleHeights(m_x.data(), m_zStep.data(), m_hz.data(), VERTEX_COUNT);
+
+	// 3. finite difference normals and output
+	const __m128 step = _mm_set1_ps(m_normalStep);
+	for (int idx = 0; idx < VERTEX_COUNT; idx += 4)
+	{
+		auto hc = _mm_loadu_ps(m_h.data() + idx);
+		auto nx = _mm_sub_ps(hc, _mm_loadu_ps(m_hx.data() + idx));
+		auto nz = _mm_sub_ps(hc, _mm_loadu_ps(m_hz.data() + idx));
+		auto len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(step, step)), _mm_mul_ps(nz, nz)));
+		auto invLen = _mm_div_ps(_mm_set1_ps(1.0f), len);
+
+		alignas(16) float n[3][4];
+		_mm_store_ps(n[0], _mm_mul_ps(nx, invLen));
+		_mm_store_ps(n[1], _mm_mul_ps(step, invLen));
+		_mm_store_ps(n[2], _mm_mul_ps(nz, invLen));
+
+		for (int k = 0; k < 4; k++)
+		{
+			auto& v = output[idx + k];
+			v.position = XMFLOAT3(m_x[idx + k], m_h[idx + k], m_z[idx + k]);
+			v.normal = XMFLOAT3(n[0][k], n[1][k], n[2][k]);
+		}
+	}
+}
+
+std::vector<unsigned short> ProjectedGrid::Indices()
+{
+	std::vector<unsigned short> indices;
+	indices.reserve((RESOLUTION - 1) * (RESOLUTION - 1) * 6);
+
+	for (int j = 0; j < RESOLUTION - 1; j++)
+	{
+		for (int i = 0; i < RESOLUTION - 1; i++)
+		{
+			unsigned short v = j * RESOLUTION + i;
+
+			indices.push_back(v);
+			indices.push_back(v + 1);
+			indices.push_back(v + RESOLUTION);
+
+			indices.push_back(v + 1);
+			indices.push_back(v + RESOLUTION + 1);
+			indices.push_back(v + RESOLUTION);
+		}
+	}
+
+	return indices;
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+
+#include "heightSource.h"
+#include "vertexTypes.h"
+
+namespace mini::gk2
+{
+	//Water surface mesh generated in screen space. A fixed grid of vertices is projected
+	//from the camera onto the water plane, so the vertex budget doesn't depend on the size
+	//of the visible water area.
+	class ProjectedGrid
+	{
+	public:
+		static constexpr int RESOLUTION = 128;	//number of vertices along each side of the grid
+		static constexpr int VERTEX_COUNT = RESOLUTION * RESOLUTION;
+
+		//extent - side of the square water area centered at the origin
+		//normalStep - distance between height samples used for normal calculation
+		ProjectedGrid(float extent, float normalStep);
+
+		//Writes VERTEX_COUNT vertices (in water plane local space) to output, which is
+		//expected to be a mapped dynamic vertex buffer.
+		void Update(const DirectX::XMFLOAT4X4& viewProjMtx, const DirectX::XMFLOAT4X4& invViewProjMtx,
+			float planeHeight, const HeightSource& heights, VertexPositionNormal* output);
+
+		static std::vector<unsigned short> Indices();
+
+	private:
+		//Finds the part of the screen (in NDC) covered by the water area
+		void ScreenBounds(const DirectX::XMFLOAT4X4& viewProjMtx, float planeHeight,
+			float& minX, float& minY, float& maxX, float& maxY) const;
+
+		float m_extent;
+		float m_normalStep;
+
+		//structure of arrays scratch buffers, one entry per grid vertex
+		std::vector<float> m_x, m_z, m_h;
+		std::vector<float> m_xStep, m_zStep, m_hx, m_hz;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,66 @@
+#include "proximityGrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace mini::gk2;
+
+ProximityGrid::ProximityGrid(float extent, float cellSize)
+	: m_halfExtent(0.5f * extent), m_invCellSize(1.0f / cellSize),
+	m_side(std::max(1, static_cast<int>(ceilf(extent / cellSize)))),
+	m_cellStart(static_cast<size_t>(m_side) * m_side + 1), m_cursor(static_cast<size_t>(m_side) * m_side)
+{ }
+
+int ProximityGrid::CellCoord(float v) const
+{
+	return std::clamp(static_cast<int>(floorf((v + m_halfExtent) * m_invCellSize)), 0, m_side - 1);
+}
+
+void ProximityGrid::Build(const float* x, const float* z, size_t count)
+{
+	m_cellOf.resize(count);
+	m_indices.resize(count);
+	m_x.resize(count);
+	m_z.resize(count);
+
+	std::fill(m_cellStart.begin(), m_cellStart.end(), 0u);
+
+	// histogram shifted by one, so that the prefix sum leaves the first point of every cell
+	for (size_t i = 0; i < count; i++)
+	{
+		const unsigned cell = CellCoord(z[i]) * m_side + CellCoord(x[i]);
+		m_cellOf[i] = cell;
+		m_cellStart[cell + 1]++;
+	}
+
+	for (size_t c = 1; c < m_cellStart.size(); c++)
+		m_cellStart[c] += m_cellStart[c - 1];
+
+	std::copy(m_cellStart.begin(), m_cellStart.end() - 1, m_cursor.begin());
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const unsigned k = m_cursor[m_cellOf[i]]++;
+		m_indices[k] = static_cast<unsigned>(i);
+		m_x[k] = x[i];
+		m_z[k] = z[i];
+	}
+}
+
+void ProximityGrid::QueryNeighbours(const float* x, const float* z, size_t count, float radius,
+	std::vector<unsigned>& offsets, std::vector<unsigned>& neighbours) const
+{
+	offsets.resize(count + 1);
+	neighbours.clear();
+
+	for (size_t i = 0; i < count; i++)
+	{
+		offsets[i] = static_cast<unsigned>(neighbours.size());
+		ForEachNeighbour(x[i], z[i], radius, [&neighbours](unsigned j, float, float, float)
+		{
+			neighbours.push_back(j);
+		});
+	}
+
+	offsets[count] = static_cast<unsigned>(neighbours.size());
+}
\ No newline at end of file
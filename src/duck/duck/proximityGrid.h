@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace mini::gk2
+{
+	//Uniform grid over the square [-extent/2, extent/2]^2 of the xz plane for proximity queries
+	//between many points. Points are bucketed by a counting sort into flat arrays, so rebuilding
+	//the grid every frame allocates nothing once the arrays have grown. Points outside of the
+	//square fall into the border cells.
+	class ProximityGrid
+	{
+	public:
+		ProximityGrid(float extent, float cellSize);
+
+		void Build(const float* x, const float* z, size_t count);
+
+		//Calls f(index, dx, dz, distanceSq) for every point closer than radius to (x, z),
+		//dx and dz point from the found point towards (x, z)
+		template<typename F>
+		void ForEachNeighbour(float x, float z, float radius, F&& f) const
+		{
+			const int x0 = CellCoord(x - radius), x1 = CellCoord(x + radius);
+			const int z0 = CellCoord(z - radius), z1 = CellCoord(z + radius);
+			const float radiusSq = radius * radius;
+
+			for (int cz = z0; cz <= z1; cz++)
+			{
+				// cells of a grid row are adjacent in the sorted arrays
+				const unsigned first = m_cellStart[cz * m_side + x0];
+				const unsigned last = m_cellStart[cz * m_side + x1 + 1];
+
+				for (unsigned k = first; k < last; k++)
+				{
+					const float dx = x - m_x[k], dz = z - m_z[k];
+					const float distanceSq = dx * dx + dz * dz;
+
+					if (distanceSq < radiusSq)
+						f(m_indices[k], dx, dz, distanceSq);
+				}
+			}
+		}
+
+		//Batched query, indices of the points near (x[i], z[i]) are written to
+		//neighbours[offsets[i] .. offsets[i + 1]), offsets gets count + 1 entries
+		void QueryNeighbours(const float* x, const float* z, size_t count, float radius,
+			std::vector<unsigned>& offsets, std::vector<unsigned>& neighbours) const;
+
+		size_t count() const { return m_indices.size(); }
+
+		//Index of the k-th point in cell order, visiting points in this order keeps queries cache friendly
+		unsigned sortedIndex(size_t k) const { return m_indices[k]; }
+		int cellsPerSide() const { return m_side; }
+
+	private:
+		int CellCoord(float v) const;
+
+		float m_halfExtent;
+		float m_invCellSize;
+		int m_side;
+
+		std::vector<unsigned> m_cellStart;	//first sorted point of every cell, one extra entry at the end
+		std::vector<unsigned> m_cursor;	//scratch of the counting sort
+		std::vector<unsigned> m_cellOf;	//cell of every input point
+
+		//points sorted by cell
+		std::vector<unsigned> m_indices;
+		std::vector<float> m_x, m_z;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,321 @@
+#include "randomStreams.h"
+#include "cpuFeatures.h"
+#include "exceptions.h"
+
+#include <chrono>
+#include <fstream>
+#include <immintrin.h>
+#include <random>
+#include <vector>
+
+using namespace mini::gk2;
+
+namespace
+{
+	constexpr uint32_t PHILOX_M0 = 0xD2511F53, PHILOX_M1 = 0xCD9E8D57;	//round multipliers
+	constexpr uint32_t PHILOX_W0 = 0x9E3779B9, PHILOX_W1 = 0xBB67AE85;	//key schedule increments
+	constexpr int PHILOX_ROUNDS = 10;
+	constexpr size_t BLOCKS_PER_AVX2_STEP = 8;
+	//an odd number of blocks leaves a tail for the scalar path after the AVX2 steps
+	constexpr size_t AGREEMENT_BLOCKS = 1001;
+
+	//Known-answer vectors of Philox4x32-10 shipped with Random123 (kat_vectors),
+	//counter words from the lowest one, key words from the lowest one
+	struct PhiloxAnswer
+	{
+		std::array<uint32_t, 4> counter;
+		std::array<uint32_t, 2> key;
+		std::array<uint32_t, 4> output;
+	};
+
+	constexpr PhiloxAnswer PHILOX_ANSWERS[] = {
+		{ { 0x00000000, 0x00000000, 0x00000000, 0x00000000 }, { 0x00000000, 0x00000000 },
+			{ 0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8 } },
+		{ { 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff }, { 0xffffffff, 0xffffffff },
+			{ 0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd } },
+		{ { 0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344 }, { 0xa4093822, 0x299f31d0 },
+			{ 0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1 } }
+	};
+
+	//32 x 32 -> 64 bit products of all eight lanes, _mm256_mul_epu32 multiplies only the even ones
+	inline void MulHiLo(__m256i a, __m256i m, __m256i& lo, __m256i& hi)
+	{
+		__m256i even = _mm256_mul_epu32(a, m);
+		__m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), m);
+
+		lo = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+		hi = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+	}
+
+	inline __m256 UniformLanes(__m256i x)
+	{
+		return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(x, 8)), _mm256_set1_ps(1.0f / 16777216.0f));
+	}
+
+	template<typename F>
+	double Measure(F&& f)
+	{
+		auto start = std::chrono::steady_clock::now();
+		f();
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+Philox::Philox(uint64_t key, uint64_t stream)
+	: m_key(key), m_stream(stream), m_block(0), m_outputs{}, m_index(4)
+{ }
+
+std::array<uint32_t, 4> Philox::Block(uint64_t key, uint64_t stream, uint64_t block)
+{
+	uint32_t c0 = static_cast<uint32_t>(block), c1 = static_cast<uint32_t>(block >> 32);
+	uint32_t c2 = static_cast<uint32_t>(stream), c3 = static_cast<uint32_t>(stream >> 32);
+	uint32_t k0 = static_cast<uint32_t>(key), k1 = static_cast<uint32_t>(key >> 32);
+
+	for (int r = 0; r < PHILOX_ROUNDS; r++)
+	{
+		const uint64_t p0 = static_cast<uint64_t>(PHILOX_M0) * c0;
+		const uint64_t p1 = static_cast<uint64_t>(PHILOX_M1) * c2;
+
+		c0 = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ k0;
+		c1 = static_cast<uint32_t>(p1);
+		c2 = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ k1;
+		c3 = static_cast<uint32_t>(p0);
+
+		k0 += PHILOX_W0;
+		k1 += PHILOX_W1;
+	}
+
+	return { c0, c1, c2, c3 };
+}
+
+Philox::result_type Philox::operator()()
+{
+	if (m_index == 4)
+	{
+		m_outputs = Block(m_key, m_stream, m_block++);
+		m_index = 0;
+	}
+
+	return m_outputs[m_index++];
+}
+
+void Philox::FillUniform(std::span<float> values)
+{
+	float* out = values.data();
+	size_t n = values.size();
+
+	// outputs left from the last block come first
+	for (; n > 0 && m_index < 4; n--)
+		*out++ = ToUniform(m_outputs[m_index++]);
+
+	const size_t blocks = n / 4;
+	if (HasAvx2())
+		FillBlocksAvx2(out, blocks);
+	else
+		FillBlocksScalar(out, blocks);
+
+	out += 4 * blocks;
+	n -= 4 * blocks;
+
+	for (; n > 0; n--)
+		*out++ = Uniform();
+}
+
+void Philox::FillUniform(std::span<float> values, float min, float max)
+{
+	FillUniform(values);
+
+	const float range = max - min;
+	for (float& v : values)
+		v = min + range * v;
+}
+
+void Philox::FillBlocksScalar(float* values, size_t count)
+{
+	for (size_t b = 0; b < count; b++)
+	{
+		auto outputs = Block(m_key, m_stream, m_block++);
+		for (int i = 0; i < 4; i++)
+			values[4 * b + i] = ToUniform(outputs[i]);
+	}
+}
+
+void Philox::FillBlocksAvx2(float* values, size_t count)
+{
+	const __m256i m0 = _mm256_set1_epi32(static_cast<int>(PHILOX_M0));
+	const __m256i m1 = _mm256_set1_epi32(static_cast<int>(PHILOX_M1));
+	const __m256i c2Start = _mm256_set1_epi32(static_cast<int>(m_stream));
+	const __m256i c3Start = _mm256_set1_epi32(static_cast<int>(m_stream >> 32));
+
+	size_t b = 0;
+	for (; b + BLOCKS_PER_AVX2_STEP <= count; b += BLOCKS_PER_AVX2_STEP)
+	{
+		// lane j computes block m_block + j, the lower counter word may carry into the upper one
+		alignas(32) uint32_t low[BLOCKS_PER_AVX2_STEP], high[BLOCKS_PER_AVX2_STEP];
+		for (size_t j = 0; j < BLOCKS_PER_AVX2_STEP; j++)
+		{
+			low[j] = static_cast<uint32_t>(m_block + j);
+			high[j] = static_cast<uint32_t>((m_block + j) >> 32);
+		}
+
+		__m256i c0 = _mm256_load_si256(reinterpret_cast<const __m256i*>(low));
+		__m256i c1 = _mm256_load_si256(reinterpret_cast<const __m256i*>(high));
+		__m256i c2 = c2Start, c3 = c3Start;
+
+		uint32_t k0 = static_cast<uint32_t>(m_key), k1 = static_cast<uint32_t>(m_key >> 32);
+		for (int r = 0; r < PHILOX_ROUNDS; r++)
+		{
+			__m256i lo0, hi0, lo1, hi1;
+			MulHiLo(c0, m0, lo0, hi0);
+			MulHiLo(c2, m1, lo1, hi1);
+
+			c0 = _mm256_xor_si256(_mm256_xor_si256(hi1, c1), _mm256_set1_epi32(static_cast<int>(k0)));
+			c1 = lo1;
+			c2 = _mm256_xor_si256(_mm256_xor_si256(hi0, c3), _mm256_set1_epi32(static_cast<int>(k1)));
+			c3 = lo0;
+
+			k0 += PHILOX_W0;
+			k1 += PHILOX_W1;
+		}
+
+		// transpose the words of eight blocks so that each block's outputs are consecutive
+		__m256i t0 = _mm256_unpacklo_epi32(c0, c1), t1 = _mm256_unpackhi_epi32(c0, c1);
+		__m256i t2 = _mm256_unpacklo_epi32(c2, c3), t3 = _mm256_unpackhi_epi32(c2, c3);
+		__m256i u0 = _mm256_unpacklo_epi64(t0, t2), u1 = _mm256_unpackhi_epi64(t0, t2);
+		__m256i u2 = _mm256_unpacklo_epi64(t1, t3), u3 = _mm256_unpackhi_epi64(t1, t3);
+
+		float* out = values + 4 * b;
+		_mm256_storeu_ps(out, UniformLanes(_mm256_permute2x128_si256(u0, u1, 0x20)));
+		_mm256_storeu_ps(out + 8, UniformLanes(_mm256_permute2x128_si256(u2, u3, 0x20)));
+		_mm256_storeu_ps(out + 16, UniformLanes(_mm256_permute2x128_si256(u0, u1, 0x31)));
+		_mm256_storeu_ps(out + 24, UniformLanes(_mm256_permute2x128_si256(u2, u3, 0x31)));
+
+		m_block += BLOCKS_PER_AVX2_STEP;
+	}
+
+	FillBlocksScalar(values + 4 * b, count - b);
+}
+
+Philox::State Philox::state() const
+{
+	return { m_key, m_stream, m_block, m_index };
+}
+
+void Philox::Restore(const State& state)
+{
+	m_key = state.key;
+	m_stream = state.stream;
+	m_block = state.block;
+	m_index = state.index;
+
+	// unused outputs of the previous block are generated again
+	if (m_index < 4)
+		m_outputs = Block(m_key, m_stream, m_block - 1);
+}
+
+const RandomStreams& RandomStreams::Global()
+{
+	static const RandomStreams streams = []
+	{
+		std::random_device rd;
+		return RandomStreams(static_cast<uint64_t>(rd()) << 32 | rd());
+	}();
+
+	return streams;
+}
+
+void mini::gk2::RunRandomBenchmark(const std::wstring& reportPath, size_t count)
+{
+	std::wofstream report(reportPath);
+	if (!report)
+		THROW(L"Couldn't open the random number benchmark report file");
+
+	// the generator must be Philox4x32-10 itself, so that its statistical quality carries over
+	for (size_t i = 0; i < std::size(PHILOX_ANSWERS); i++)
+	{
+		const auto& answer = PHILOX_ANSWERS[i];
+		const auto block = Philox::Block(static_cast<uint64_t>(answer.key[1]) << 32 | answer.key[0],
+			static_cast<uint64_t>(answer.counter[3]) << 32 | answer.counter[2], static_cast<uint64_t>(answer.counter[1]) << 32 | answer.counter[0]);
+		if (block != answer.output)
+			THROW(L"Philox differs from the Random123 known-answer vector " + std::to_wstring(i));
+	}
+
+	// both paths of FillUniform must give the values of consecutive Uniform calls
+	if (HasAvx2())
+	{
+		std::vector<float> scalarValues(4 * AGREEMENT_BLOCKS), avx2Values(4 * AGREEMENT_BLOCKS);
+		// the run starts a few blocks below a carry into the upper counter word
+		Philox scalar = RandomStreams(1).Stream(RandomSubsystem::Benchmark);
+		scalar.Restore({ 1, scalar.state().stream, (1ull << 32) - 4, 4 });
+		Philox avx2 = scalar;
+		scalar.FillBlocksScalar(scalarValues.data(), AGREEMENT_BLOCKS);
+		avx2.FillBlocksAvx2(avx2Values.data(), AGREEMENT_BLOCKS);
+
+		for (size_t i = 0; i < scalarValues.size(); i++)
+		{
+			if (scalarValues[i] != avx2Values[i])
+				THROW(L"Philox FillUniform AVX2 differs from the scalar path at value " + std::to_wstring(i));
+		}
+	}
+
+	report << L"generator\tns per value\tmean\n";
+
+	std::vector<float> values(count);
+	auto write = [&report, &values](const wchar_t* name, double seconds)
+	{
+		double sum = 0.0;
+		for (float v : values)
+			sum += v;
+
+		report << name << L"\t" << 1e9 * seconds / values.size() << L"\t" << sum / values.size() << L"\n";
+	};
+
+	std::mt19937 mt(1);
+	std::uniform_real_distribution<> doubleDist(0, 1);
+	write(L"mt19937 double distribution", Measure([&]
+	{
+		for (float& v : values)
+			v = static_cast<float>(doubleDist(mt));
+	}));
+
+	std::default_random_engine engine(1);
+	std::uniform_real_distribution<float> floatDist(0.0f, 1.0f);
+	write(L"default_random_engine float distribution", Measure([&]
+	{
+		for (float& v : values)
+			v = floatDist(engine);
+	}));
+
+	const RandomStreams streams(1);
+
+	Philox single = streams.Stream(RandomSubsystem::Benchmark);
+	write(L"Philox Uniform", Measure([&]
+	{
+		for (float& v : values)
+			v = single.Uniform();
+	}));
+
+	Philox scalar = streams.Stream(RandomSubsystem::Benchmark, 1);
+	write(L"Philox FillUniform scalar", Measure([&]
+	{
+		scalar.FillBlocksScalar(values.data(), values.size() / 4);
+	}));
+
+	if (HasAvx2())
+	{
+		Philox avx2 = streams.Stream(RandomSubsystem::Benchmark, 2);
+		write(L"Philox FillUniform AVX2", Measure([&]
+		{
+			avx2.FillBlocksAvx2(values.data(), values.size() / 4);
+		}));
+	}
+}
+
+bool mini::gk2::RunRandomCommand(int argc, wchar_t** argv)
+{
+	if (argc < 3 || std::wstring(argv[1]) != L"--rng-bench")
+		return false;
+
+	RunRandomBenchmark(argv[2]);
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string>
+
+namespace mini::gk2
+{
+	//Subsystems drawing random numbers, each one gets its own streams derived from the common seed
+	enum class RandomSubsystem : uint32_t
+	{
+		Weather,
+		Ducks,
+		Particles,
+		Benchmark
+	};
+
+	//Philox4x32-10 counter-based generator (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3").
+	//Every block of four outputs is a pure function of the key and a 128-bit counter whose lower half
+	//counts the blocks and upper half selects the stream, so streams never overlap and the state is just
+	//a few integers. Meets the UniformRandomBitGenerator requirements, std distributions can use it.
+	class Philox
+	{
+	public:
+		using result_type = uint32_t;
+
+		//Everything needed to continue the sequence from the same point
+		struct State
+		{
+			uint64_t key;
+			uint64_t stream;
+			uint64_t block;	//index of the next block to generate
+			uint32_t index;	//outputs of the previous block already used, 4 if none are left
+		};
+
+		explicit Philox(uint64_t key = 0, uint64_t stream = 0);
+
+		static constexpr result_type min() { return 0; }
+		static constexpr result_type max() { return UINT32_MAX; }
+
+		result_type operator()();
+
+		//Uniformly distributed values in [0, 1), the 24 high bits of an output scaled by 2^-24
+		float Uniform() { return ToUniform((*this)()); }
+		float Uniform(float min, float max) { return min + (max - min) * Uniform(); }
+
+		//Same values as consecutive calls to Uniform, whole blocks are generated eight at a time with AVX2
+		void FillUniform(std::span<float> values);
+		void FillUniform(std::span<float> values, float min, float max);
+
+		State state() const;
+		void Restore(const State& state);
+
+		//Four outputs of the block with the given counter
+		static std::array<uint32_t, 4> Block(uint64_t key, uint64_t stream, uint64_t block);
+
+	private:
+		static float ToUniform(uint32_t x) { return static_cast<float>(x >> 8) * (1.0f / 16777216.0f); }
+
+		//Writes uniform values of blocks [m_block, m_block + count) and advances the counter
+		void FillBlocksScalar(float* values, size_t count);
+		void FillBlocksAvx2(float* values, size_t count);
+
+		friend void RunRandomBenchmark(const std::wstring& reportPath, size_t count);
+
+		uint64_t m_key;
+		uint64_t m_stream;
+		uint64_t m_block;
+		std::array<uint32_t, 4> m_outputs;
+		uint32_t m_index;
+	};
+
+	//Root of all random streams of the application. Generators of a (subsystem, job) pair repeat
+	//the same sequence for the same seed, parallel jobs should take the stream of their job index
+	//instead of sharing a generator.
+	class RandomStreams
+	{
+	public:
+		explicit RandomStreams(uint64_t seed) : m_seed(seed) { }
+
+		Philox Stream(RandomSubsystem subsystem, uint32_t job = 0) const
+		{
+			return Philox(m_seed, static_cast<uint64_t>(subsystem) << 32 | job);
+		}
+
+		uint64_t seed() const { return m_seed; }
+
+		//Streams of the application seeded from std::random_device at the first use
+		static const RandomStreams& Global();
+
+	private:
+		uint64_t m_seed;
+	};
+
+	//Checks Philox against the Random123 known-answer vectors and the AVX2 path against the scalar one,
+	//throwing on any difference, then times the generators with count uniform floats each and writes them to reportPath
+	void RunRandomBenchmark(const std::wstring& reportPath, size_t count = 1 << 24);
+
+	//Handles the --rng-bench <report> command line switch, returns false if it's not present
+	bool RunRandomCommand(int argc, wchar_t** argv);
+}
\ No newline at end of file
@@ -0,0 +1,145 @@
+#include "rippleSprites.h"
+
+#include <algorithm>
+#include <cmath>
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+using namespace mini::gk2;
+
+namespace
+{
+	constexpr float PI = 3.14159265f;
+	//number of crests across the ring
+	constexpr float RING_CRESTS = 2.0f;
+}
+
+RippleSprites::RippleSprites(float speed, float ringWidth, float lifetime)
+	: m_speed(speed), m_halfWidth(0.5f * ringWidth), m_lifetime(lifetime), m_time(0.0f)
+{
+	for (int i = 0; i < PROFILE_SIZE; i++)
+	{
+		float s = 2.0f * i / (PROFILE_SIZE - 1) - 1.0f;
+
+		// crests windowed with a Hann window, the profile drops to zero at both ends
+		m_profile[i] = cosf(PI * RING_CRESTS * s) * 0.5f * (1.0f + cosf(PI * s));
+	}
+
+	m_x.reserve(MAX_RIPPLES);
+	m_z.reserve(MAX_RIPPLES);
+	m_birth.reserve(MAX_RIPPLES);
+	m_amplitude.reserve(MAX_RIPPLES);
+}
+
+void RippleSprites::Add(float x, float z, float amplitude)
+{
+	if (m_x.size() >= MAX_RIPPLES)
+	{
+		auto oldest = std::min_element(m_birth.begin(), m_birth.end()) - m_birth.begin();
+		Remove(oldest);
+	}
+
+	m_x.push_back(x);
+	m_z.push_back(z);
+	m_birth.push_back(m_time);
+	m_amplitude.push_back(amplitude);
+}
+
+void RippleSprites::Remove(size_t i)
+{
+	m_x[i] = m_x.back();
+	m_z[i] = m_z.back();
+	m_birth[i] = m_birth.back();
+	m_amplitude[i] = m_amplitude.back();
+
+	m_x.pop_back();
+	m_z.pop_back();
+	m_birth.pop_back();
+	m_amplitude.pop_back();
+}
+
+void RippleSprites::Update(float dt)
+{
+	m_time += dt;
+
+	for (size_t i = 0; i < m_x.size();)
+	{
+		if (m_time - m_birth[i] > m_lifetime)
+			Remove(i);
+		else
+			i++;
+	}
+}
+
+void RippleSprites::CompositeRow(float z, float x0, float spacing, float* row, int count) const
+{
+	const float toProfile = 0.5f * (PROFILE_SIZE - 1) / m_halfWidth;
+	const float maxIndex = static_cast<float>(PROFILE_SIZE - 2);
+
+	for (size_t r = 0; r < m_x.size(); r++)
+	{
+		const float age = m_time - m_birth[r];
+		const float radius = m_speed * age;
+		const float outer = radius + m_halfWidth;
+
+		const float dz = z - m_z[r];
+		if (fabsf(dz) >= outer)
+			continue;
+
+		// span of the row covered by the ring's bounding circle
+		const float chord = sqrtf(outer * outer - dz * dz);
+		const int i0 = std::max(0, static_cast<int>(ceilf((m_x[r] - chord - x0) / spacing)));
+		const int i1 = std::min(count, static_cast<int>(floorf((m_x[r] + chord - x0) / spacing)) + 1);
+
+		if (i1 <= i0)
+			continue;
+
+		// ripples fade out over their lifetime and spread their energy over a growing ring
+		const float fade = 1.0f - age / m_lifetime;
+		const float gain = m_amplitude[r] * fade * fade / sqrtf(1.0f + radius);
+
+		const __m128 dz2 = _mm_set1_ps(dz * dz);
+		const __m128 cx = _mm_set1_ps(m_x[r]);
+		const __m128 inner = _mm_set1_ps(radius - m_halfWidth);
+		const __m128 scale = _mm_set1_ps(toProfile), upper = _mm_set1_ps(maxIndex);
+		const __m128 zero = _mm_setzero_ps(), g = _mm_set1_ps(gain);
+		const __m128 step = _mm_set1_ps(4.0f * spacing);
+
+		auto px = _mm_add_ps(_mm_set1_ps(x0 + i0 * spacing), _mm_mul_ps(_mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f), _mm_set1_ps(spacing)));
+
+		int i = i0;
+		for (; i + 4 <= i1; i += 4)
+		{
+			auto dx = _mm_sub_ps(px, cx);
+			auto dist = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), dz2));
+
+			// points outside of the ring clamp onto the zero ends of the profile
+			auto t = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(dist, inner), scale), zero), upper);
+			auto idx = _mm_cvttps_epi32(t);
+			auto f = _mm_sub_ps(t, _mm_cvtepi32_ps(idx));
+
+			alignas(16) int id[4];
+			_mm_store_si128(reinterpret_cast<__m128i*>(id), idx);
+
+			auto p0 = _mm_set_ps(m_profile[id[3]], m_profile[id[2]], m_profile[id[1]], m_profile[id[0]]);
+			auto p1 = _mm_set_ps(m_profile[id[3] + 1], m_profile[id[2] + 1], m_profile[id[1] + 1], m_profile[id[0] + 1]);
+			auto h = _mm_add_ps(p0, _mm_mul_ps(f, _mm_sub_ps(p1, p0)));
+
+			_mm_storeu_ps(row + i, _mm_add_ps(_mm_loadu_ps(row + i), _mm_mul_ps(h, g)));
+
+			px = _mm_add_ps(px, step);
+		}
+
+		for (; i < i1; i++)
+		{
+			float dx = x0 + i * spacing - m_x[r];
+			float dist = sqrtf(dx * dx + dz * dz);
+
+			float t = std::clamp((dist - radius + m_halfWidth) * toProfile, 0.0f, maxIndex);
+			int idx = static_cast<int>(t);
+			float f = t - idx;
+
+			row[i] += gain * (m_profile[idx] + f * (m_profile[idx + 1] - m_profile[idx]));
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+namespace mini::gk2
+{
+	//Analytic ripples of small raindrops, composited into the water heights instead of
+	//disturbing the simulation. Each ripple is a damped ring expanding at a constant speed,
+	//its cross-section comes from a precomputed radial profile table.
+	class RippleSprites
+	{
+	public:
+		static constexpr int MAX_RIPPLES = 512;
+		static constexpr int PROFILE_SIZE = 256;
+
+		//speed - expansion speed of the ring, ringWidth - width of its cross-section,
+		//lifetime - time after which the ripple is removed
+		RippleSprites(float speed, float ringWidth, float lifetime);
+
+		//Adds a ripple centered at (x, z), the oldest one is replaced when the pool is full
+		void Add(float x, float z, float amplitude);
+
+		//Advances time and removes expired ripples
+		void Update(float dt);
+
+		//Adds heights of all ripples to a row of count points lying at (x0 + i * spacing, z)
+		void CompositeRow(float z, float x0, float spacing, float* row, int count) const;
+
+		int count() const { return static_cast<int>(m_x.size()); }
+
+	private:
+		void Remove(size_t i);
+
+		float m_speed;
+		float m_halfWidth;
+		float m_lifetime;
+		float m_time;
+
+		//cross-section of the ring, sampled over [-m_halfWidth, m_halfWidth] around its radius
+		std::array<float, PROFILE_SIZE> m_profile;
+
+		//structure of arrays pool - center, birth time and amplitude of each ripple
+		std::vector<float> m_x, m_z, m_birth, m_amplitude;
+	};
+}
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include <array>
 #include "mesh.h"
 #include "textureGenerator.h"
+#include "exceptions.h"
 
 using namespace mini;
 using namespace gk2;
@@ -9,6 +10,7 @@ using namespace DirectX;
 using namespace std;
 
 const XMFLOAT3 RoomDemo::TEAPOT_POS{ -1.3f, -0.74f, -0.6f };
+const XMFLOAT3 RoomDemo::PARTICLES_POS{ -1.3f, -0.6f, -0.14f };
 const XMFLOAT4 RoomDemo::TABLE_POS{ 0.5f, -0.96f, 0.5f, 1.0f };
 const XMFLOAT4 RoomDemo::LIGHT_POS[2] = { {1.0f, 1.0f, 1.0f, 1.0f}, {-1.0f, -1.0f, -1.0f, 1.0f} };
 
@@ -29,8 +31,7 @@ RoomDemo::RoomDemo(HINSTANCE appInstance)
 	m_opacityTexture(m_device.CreateShaderResourceView(L"resources/textures/smokecolors.png")),
 	//EnvMapper
 	m_envMapper{ m_device, MAPPER_NEAR, MAPPER_FAR, TEAPOT_POS },
-	//Particles
-	m_particles{ {-1.3f, -0.6f, -0.14f} }
+	m_frameBudget(TARGET_FRAME_TIME)
 {
 	//Projection matrix
 	auto s = m_window.getClientSize();
@@ -39,6 +40,8 @@ RoomDemo::RoomDemo(HINSTANCE appInstance)
 	UpdateBuffer(m_cbProjMtx, m_projMtx);
 	UpdateCameraCB();
 
+	m_envMapper.schedule().SetFacesPerFrame(MAPPER_FACES_PER_FRAME);
+
 	//Sampler States
 	SamplerDescription sd;
 	// TODO : 0.01 Set to proper addressing (wrap) and filtering (16x anisotropic) modes of the sampler
@@ -102,7 +105,12 @@ RoomDemo::RoomDemo(HINSTANCE appInstance)
 	m_duck = Mesh::LoadDuckMesh(m_device, L"../resources/mesh/duck.txt");
 	XMStoreFloat4x4(&m_duckMtx, XMMatrixScaling(0.005f, 0.005f, 0.005f));
 
-	m_vbParticles = m_device.CreateVertexBuffer<ParticleVertex>(ParticleSystem::MAX_PARTICLES);
+	m_particles.AddEmitter(EmitterDesc::Smoke(PARTICLES_POS));
+	m_vbParticles = m_device.CreateVertexBuffer<ParticleVertex>(static_cast<unsigned int>(m_particles.capacity()));
+
+	// stale reflections are noticed less than thin smoke, so the mapper gives up its faces first
+	m_budgetMapperFaces = m_frameBudget.Register(L"environment map faces", { 0.5f, 1.0f }, 0);
+	m_budgetParticles = m_frameBudget.Register(L"particles", { 0.25f, 0.5f, 1.0f }, 1);
 
 	//World matrix of all objects
 	auto temp = XMMatrixTranslation(0.0f, 0.0f, 2.0f);
@@ -208,17 +216,58 @@ void RoomDemo::UpdateLamp(float dt)
 	XMStoreFloat4x4(&m_lampMtx, lamp);
 }
 
+void RoomDemo::ApplyFrameBudget(double frameTime)
+{
+	// costs recorded during the previous frame belong to the frame measured by the clock
+	m_frameBudget.EndFrame(frameTime);
+	m_frameBudget.BeginFrame();
+
+	m_particles.SetEmissionRatio(PARTICLE_BUDGET_RATIOS[m_frameBudget.level(m_budgetParticles)]);
+	m_envMapper.schedule().SetFacesPerFrame(MAPPER_BUDGET_FACES[m_frameBudget.level(m_budgetMapperFaces)]);
+}
+
 void mini::gk2::RoomDemo::UpdateParticles(float dt)
 {
-	// TODO : 1.31 update particle system and copy vertex data to the buffer
+	auto scope = m_frameBudget.Measure(m_budgetParticles);
+
+	m_particles.Update(dt);
+
+	// checked before mapping, so that a failure doesn't leave the buffer mapped
+	if (m_particles.particlesCount() > m_particles.capacity())
+		THROW(L"Particle vertex buffer is too small");
+
+	// sorted vertices are written straight to the buffer without an intermediate copy
+	D3D11_MAPPED_SUBRESOURCE res;
+	auto hr = m_device.context()->Map(m_vbParticles.get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &res);
+	if (FAILED(hr))
+		THROW_DX(hr);
+
+	try
+	{
+		m_particles.WriteVertices(m_camera.getCameraPosition(),
+			span<ParticleVertex>(static_cast<ParticleVertex*>(res.pData), m_particles.capacity()));
+	}
+	catch (...)
+	{
+		m_device.context()->Unmap(m_vbParticles.get(), 0);
+		throw;
+	}
+
+	m_device.context()->Unmap(m_vbParticles.get(), 0);
 }
 
 void RoomDemo::Update(const Clock& c)
 {
 	double dt = c.getFrameTime();
 	HandleCameraInput(dt);
+	ApplyFrameBudget(dt);
 	UpdateLamp(static_cast<float>(dt));
 	UpdateParticles(dt);
+
+	// only faces that can see the lamp or the smoke change between frames
+	m_envMapper.schedule().MarkMoving(XMFLOAT3(m_lampMtx._41, m_lampMtx._42, m_lampMtx._43), LAMP_RADIUS);
+	if (m_particles.particlesCount() > 0)
+		m_envMapper.schedule().MarkMoving(PARTICLES_POS, SMOKE_RADIUS);
 }
 
 void RoomDemo::SetWorldMtx(DirectX::XMFLOAT4X4 mtx)
@@ -445,14 +494,31 @@ void RoomDemo::DrawScene()
 	DrawTransparentObjects();
 }
 
-void RoomDemo::Render()
+void RoomDemo::UpdateEnvironmentMap()
 {
-	Base::Render();
-	// TODO : 1.20 Change projection matrix to for drawing in environment cube
+	// only the submission is timed, rendering the faces on the GPU counts towards the frame's overhead
+	auto scope = m_frameBudget.Measure(m_budgetMapperFaces);
 
-	// TODO : 1.21 Set evnMapper render target
+	auto faces = m_envMapper.schedule().NextFaces();
+	if (faces.empty())
+		return;
+
+	UpdateBuffer(m_cbProjMtx, m_envMapper.FaceProjMtx());
+	m_envMapper.SetTarget(m_device.context());
 
-	// TODO : 1.22 For each cube face: clear envMapper render target, update camera constant buffer, draw the scene and copy the result to cubemap
+	for (auto face : faces)
+	{
+		m_envMapper.ClearTarget(m_device.context());
+		UpdateCameraCB(m_envMapper.FaceViewMtx(face));
+		DrawScene();
+		m_envMapper.SaveFace(m_device.context(), face);
+	}
+}
+
+void RoomDemo::Render()
+{
+	Base::Render();
+	UpdateEnvironmentMap();
 
 	ResetRenderTarget();
 	UpdateBuffer(m_cbProjMtx, m_projMtx);
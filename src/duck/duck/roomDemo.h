@@ -2,7 +2,8 @@
 #include "dxApplication.h"
 #include "mesh.h"
 #include "environmentMapper.h"
-#include "particleSystem.h"
+#include "particleEngine.h"
+#include "frameBudget.h"
 
 namespace mini::gk2
 {
@@ -24,9 +25,18 @@ namespace mini::gk2
 		static constexpr float TABLE_R = 1.5f;
 		static constexpr float MAPPER_NEAR = 0.4f;
 		static constexpr float MAPPER_FAR = 8.0f;
+		static constexpr int MAPPER_FACES_PER_FRAME = 2;
+		//environment map faces rendered per frame and emission ratios of the smoke, chosen by the frame budget
+		//from the cheapest level
+		static constexpr int MAPPER_BUDGET_FACES[] = { 1, MAPPER_FACES_PER_FRAME };
+		static constexpr float PARTICLE_BUDGET_RATIOS[] = { 0.25f, 0.5f, 1.0f };
+		static constexpr double TARGET_FRAME_TIME = 1.0 / 60.0;
+		static constexpr float LAMP_RADIUS = 0.3f;
+		static constexpr float SMOKE_RADIUS = 0.6f;
 
 		//can't have in-class initializer since XMFLOAT... types' constructors are not constexpr
 		static const DirectX::XMFLOAT3 TEAPOT_POS;
+		static const DirectX::XMFLOAT3 PARTICLES_POS;
 		static const DirectX::XMFLOAT4 TABLE_POS;
 		static const DirectX::XMFLOAT4 LIGHT_POS[2];
 #pragma endregion
@@ -79,12 +89,18 @@ namespace mini::gk2
 
 		EnvironmentMapper m_envMapper;
 
-		ParticleSystem m_particles;
+		ParticleEngine m_particles;
 
+		//number of particles and of refreshed environment map faces are chosen by the frame budget
+		FrameBudget m_frameBudget;
+		int m_budgetParticles, m_budgetMapperFaces;
+
+		void ApplyFrameBudget(double frameTime);
 		void UpdateCameraCB(DirectX::XMMATRIX viewMtx);
 		void UpdateCameraCB() { UpdateCameraCB(m_camera.getViewMatrix()); }
 		void UpdateLamp(float dt);
 		void UpdateParticles(float dt);
+		void UpdateEnvironmentMap();
 
 		void DrawMesh(const Mesh& m, DirectX::XMFLOAT4X4 worldMtx);
 		void DrawParticles();
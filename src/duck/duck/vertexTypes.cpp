@@ -17,4 +17,14 @@ const D3D11_INPUT_ELEMENT_DESC VertexPositionNormalTex::Layout[3] = {
 	{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, offsetof(VertexPositionNormalTex, position), 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
 	{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, offsetof(VertexPositionNormalTex, normal), D3D11_INPUT_PER_VERTEX_DATA, 0 },
 	{ "TEXTURE", 0, DXGI_FORMAT_R32G32_FLOAT, 0, offsetof(VertexPositionNormalTex, tex), D3D11_INPUT_PER_VERTEX_DATA, 0 }
+};
+
+const D3D11_INPUT_ELEMENT_DESC InstanceTransform::Layout[2] = {
+	{ "INSTANCE", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, offsetof(InstanceTransform, position), D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	{ "INSTANCE", 1, DXGI_FORMAT_R32G32_FLOAT, 1, offsetof(InstanceTransform, rotation), D3D11_INPUT_PER_INSTANCE_DATA, 1 }
+};
+
+const D3D11_INPUT_ELEMENT_DESC InstanceTransform::PointLayout[2] = {
+	{ "INSTANCE", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, offsetof(InstanceTransform, position), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "INSTANCE", 1, DXGI_FORMAT_R32G32_FLOAT, 0, offsetof(InstanceTransform, rotation), D3D11_INPUT_PER_VERTEX_DATA, 0 }
 };
\ No newline at end of file
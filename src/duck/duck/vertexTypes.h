@@ -35,4 +35,17 @@ namespace mini
 
 		static const D3D11_INPUT_ELEMENT_DESC Layout[3];
 	};
+
+	//Per-instance data read from the vertex buffer slot following the mesh's buffers,
+	//Layout names slot 1 and users rebind it to Mesh::instanceSlot()
+	struct InstanceTransform
+	{
+		DirectX::XMFLOAT3 position;
+		float scale;
+		DirectX::XMFLOAT2 rotation;	//cosine and sine of the rotation about the y axis
+
+		static const D3D11_INPUT_ELEMENT_DESC Layout[2];
+		//the same data read per vertex from slot 0, each instance drawn as a single point
+		static const D3D11_INPUT_ELEMENT_DESC PointLayout[2];
+	};
 }
\ No newline at end of file
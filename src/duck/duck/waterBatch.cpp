@@ -0,0 +1,303 @@
+#include "waterBatch.h"
+#include "haloTransport.h"
+#include "waterSubdomain.h"
+#include "exceptions.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+using namespace mini::gk2;
+
+namespace
+{
+	constexpr const wchar_t* DEFAULT_BATCH_OUTPUT = L"water_batch";
+	constexpr const wchar_t* SOCKET_PREFIX = L"tcp://";
+
+	std::wstring StripPath(const WaterBatchConfig& config, int index)
+	{
+		return config.output + L"_" + std::to_wstring(index) + L".raw";
+	}
+
+	void SaveStrip(const WaterBatchConfig& config, int index, const WaterSubdomain& strip)
+	{
+		std::ofstream file(StripPath(config, index), std::ios::binary);
+		if (!file)
+			THROW(L"Couldn't open the water batch output file");
+
+		for (int y = strip.firstRow(); y < strip.firstRow() + strip.rowCount(); y++)
+		{
+			file.write(reinterpret_cast<const char*>(strip.row(y)), strip.size() * sizeof(float));
+		}
+	}
+
+	//Deterministic initial drops, independent of the number of workers
+	template<typename Grid>
+	void AddInitialDrops(Grid& grid, int size)
+	{
+		for (int i = 1; i < 8; i++)
+		{
+			grid.Disturb(size * i / 8, size * ((i * 5) % 8 + 1) / 10, 1.0f);
+		}
+	}
+
+	//Terminates the workers which are still running and closes all handles
+	void StopWorkers(const std::vector<HANDLE>& processes)
+	{
+		for (auto p : processes)
+		{
+			TerminateProcess(p, EXIT_FAILURE);
+			CloseHandle(p);
+		}
+	}
+}
+
+void mini::gk2::RunWaterWorker(const WaterBatchConfig& config, int index)
+{
+	std::unique_ptr<HaloTransport> transport;
+	if (config.port)
+		transport = std::make_unique<SocketHaloTransport>(index, config.workers, config.size, config.topHost, config.port);
+	else
+		transport = std::make_unique<SharedMemoryHaloTransport>(config.name, config.workers, config.size, false);
+
+	WaterSubdomain strip(config.size, index, config.workers, config.waveSpeed, config.timeStep,
+		config.pointsDistance, config.bandWidth, config.stencil, *transport);
+
+	AddInitialDrops(strip, config.size);
+
+	strip.Start();
+
+	for (int s = 0; s < config.steps; s++)
+	{
+		strip.Step();
+	}
+
+	if (!config.output.empty())
+		SaveStrip(config, index, strip);
+}
+
+double mini::gk2::RunWaterBatch(const WaterBatchConfig& config)
+{
+	if (config.workers < 1 || config.workers > MAXIMUM_WAIT_OBJECTS)
+		THROW(L"Invalid number of water batch workers");
+
+	// workers connected by sockets find each other without a shared block
+	std::unique_ptr<SharedMemoryHaloTransport> transport;
+	if (!config.port)
+		transport = std::make_unique<SharedMemoryHaloTransport>(config.name, config.workers, config.size, true);
+
+	const std::wstring transportName = config.port ? SOCKET_PREFIX + config.topHost + L":" + std::to_wstring(config.port) : config.name;
+
+	wchar_t exePath[MAX_PATH];
+	if (!GetModuleFileNameW(nullptr, exePath, MAX_PATH))
+		THROW_WINAPI;
+
+	std::vector<HANDLE> processes;
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (int i = 0; i < config.workers; i++)
+	{
+		std::wstring cmd = L"\"" + std::wstring(exePath) + L"\" --water-worker " + std::to_wstring(i) + L" "
+			+ std::to_wstring(config.workers) + L" " + std::to_wstring(config.size) + L" "
+			+ std::to_wstring(config.steps) + L" " + transportName;
+		if (!config.output.empty())
+			cmd += L" \"" + config.output + L"\"";
+
+		STARTUPINFOW si = { sizeof(si) };
+		PROCESS_INFORMATION pi = {};
+
+		if (!CreateProcessW(nullptr, cmd.data(), nullptr, nullptr, FALSE, 0, nullptr, nullptr, &si, &pi))
+		{
+			auto error = GetLastError();
+			StopWorkers(processes);
+			throw WinAPIException(__AT__, error);
+		}
+
+		CloseHandle(pi.hThread);
+		processes.push_back(pi.hProcess);
+	}
+
+	// a failed worker leaves its neighbours waiting for its rows forever,
+	// so the batch stops as soon as any worker fails or the time runs out
+	const auto deadline = start + std::chrono::seconds(config.timeout);
+	std::vector<HANDLE> running = processes;
+	while (!running.empty())
+	{
+		auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+		auto result = WaitForMultipleObjects(static_cast<DWORD>(running.size()), running.data(), FALSE,
+			static_cast<DWORD>(std::max<long long>(remaining, 0)));
+
+		if (result == WAIT_TIMEOUT)
+		{
+			StopWorkers(processes);
+			THROW(L"Water batch workers didn't finish in " + std::to_wstring(config.timeout) + L" s");
+		}
+		if (result == WAIT_FAILED)
+		{
+			auto error = GetLastError();
+			StopWorkers(processes);
+			throw WinAPIException(__AT__, error);
+		}
+
+		const auto finished = running.begin() + (result - WAIT_OBJECT_0);
+		DWORD exitCode = EXIT_FAILURE;
+		if (!GetExitCodeProcess(*finished, &exitCode) || exitCode != EXIT_SUCCESS)
+		{
+			const auto worker = std::find(processes.begin(), processes.end(), *finished) - processes.begin();
+			StopWorkers(processes);
+			THROW(L"Water batch worker " + std::to_wstring(worker) + L" failed with exit code " + std::to_wstring(exitCode));
+		}
+
+		running.erase(finished);
+	}
+
+	auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	for (auto p : processes)
+	{
+		CloseHandle(p);
+	}
+
+	return elapsed;
+}
+
+void mini::gk2::VerifyWaterBatch(const WaterBatchConfig& config)
+{
+	WaterSimulationOptions options;
+	options.stencil = config.stencil;
+	WaterSimulation water(config.size, config.waveSpeed, config.timeStep, config.pointsDistance, config.bandWidth, options);
+
+	AddInitialDrops(water, config.size);
+
+	for (int s = 0; s < config.steps; s++)
+	{
+		water.Step();
+	}
+
+	// strips follow each other top to bottom, so their files hold consecutive rows of the grid
+	std::vector<float> expected(config.size), row(config.size);
+	int y = 0;
+	for (int i = 0; i < config.workers; i++)
+	{
+		std::ifstream file(StripPath(config, i), std::ios::binary);
+		if (!file)
+			THROW(L"Couldn't open the water batch output file");
+
+		while (y < config.size && file.read(reinterpret_cast<char*>(row.data()), config.size * sizeof(float)))
+		{
+			water.ReadRow(y, expected.data());
+			if (memcmp(row.data(), expected.data(), config.size * sizeof(float)) != 0)
+				THROW(L"Water batch row " + std::to_wstring(y) + L" of strip " + std::to_wstring(i) + L" differs from the single-process solver");
+			y++;
+		}
+	}
+
+	if (y != config.size)
+		THROW(L"Water batch strips hold " + std::to_wstring(y) + L" of " + std::to_wstring(config.size) + L" rows");
+}
+
+void mini::gk2::RunWaterWeakScaling(int baseSize, int maxWorkers, int steps, const std::wstring& reportPath)
+{
+	std::wofstream report(reportPath);
+	if (!report)
+		THROW(L"Couldn't open the weak scaling report file");
+
+	report << L"workers\tsize\tseconds\tMpoints/s\tefficiency\n";
+
+	double baseTime = 0.0;
+	for (int workers = 1; workers <= maxWorkers; workers *= 2)
+	{
+		WaterBatchConfig config;
+		config.workers = workers;
+		config.steps = steps;
+		// grid side grows with the square root of the number of workers
+		config.size = static_cast<int>(baseSize * sqrt(static_cast<double>(workers)));
+
+		double seconds = RunWaterBatch(config);
+		if (workers == 1)
+			baseTime = seconds;
+
+		double points = static_cast<double>(config.size) * config.size * steps;
+		report << workers << L"\t" << config.size << L"\t" << seconds << L"\t" << points / seconds * 1e-6
+			<< L"\t" << baseTime / seconds << L"\n";
+	}
+}
+
+bool mini::gk2::RunWaterBatchCommand(int argc, wchar_t** argv)
+{
+	if (argc < 2)
+		return false;
+
+	const std::wstring command = argv[1];
+
+	if (command == L"--water-worker" && argc >= 7)
+	{
+		WaterBatchConfig config;
+		config.workers = _wtoi(argv[3]);
+		config.size = _wtoi(argv[4]);
+		config.steps = _wtoi(argv[5]);
+
+		const std::wstring transport = argv[6];
+		if (transport.rfind(SOCKET_PREFIX, 0) == 0)
+		{
+			const auto colon = transport.rfind(L':');
+			const auto hostStart = wcslen(SOCKET_PREFIX);
+			config.topHost = transport.substr(hostStart, colon - hostStart);
+			config.port = _wtoi(transport.c_str() + colon + 1);
+		}
+		else
+		{
+			config.name = transport;
+		}
+
+		if (argc >= 8)
+			config.output = argv[7];
+
+		// workers have no window to report errors in, the batch learns about a failure from the exit code
+		try
+		{
+			RunWaterWorker(config, _wtoi(argv[2]));
+		}
+		catch (Exception& e)
+		{
+			OutputDebugStringW((e.getMessage() + L"\n").c_str());
+			ExitProcess(EXIT_FAILURE);
+		}
+		catch (std::exception&)
+		{
+			ExitProcess(EXIT_FAILURE);
+		}
+		return true;
+	}
+
+	const bool socketBatch = command == L"--water-socket-batch" && argc >= 6;
+	if ((command == L"--water-batch" && argc >= 5) || socketBatch)
+	{
+		const int first = socketBatch ? 3 : 2;
+
+		WaterBatchConfig config;
+		if (socketBatch)
+			config.port = _wtoi(argv[2]);
+		config.workers = _wtoi(argv[first]);
+		config.size = _wtoi(argv[first + 1]);
+		config.steps = _wtoi(argv[first + 2]);
+		config.output = argc > first + 3 ? argv[first + 3] : DEFAULT_BATCH_OUTPUT;
+
+		RunWaterBatch(config);
+		VerifyWaterBatch(config);
+		return true;
+	}
+
+	if (command == L"--water-scaling" && argc >= 6)
+	{
+		RunWaterWeakScaling(_wtoi(argv[2]), _wtoi(argv[3]), _wtoi(argv[4]), argv[5]);
+		return true;
+	}
+
+	return false;
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+
+#include "waterSimulation.h"
+
+namespace mini::gk2
+{
+	//Offline generation of a large water field by worker processes, each owning one strip of the grid
+	struct WaterBatchConfig
+	{
+		std::wstring name = L"QuackWaterBatch";	//name of the shared halo memory block
+		int size = 4096;
+		int workers = 4;
+		int steps = 200;
+		float waveSpeed = 1.0f;
+		float timeStep = 0.5f;
+		float pointsDistance = 1.0f;
+		int bandWidth = 32;
+		Stencil stencil = Stencil::NinePoint;
+		std::wstring output;	//prefix of the files receiving the final strips, nothing is saved if empty
+		int port = 0;	//port of the first strip's socket transport, the shared memory block is used if 0
+		std::wstring topHost = L"127.0.0.1";	//host of the strip above, used by the socket transport
+		int timeout = 600;	//seconds after which the workers of a batch are terminated
+	};
+
+	//Steps a single strip, the shared halo block has to be created by RunWaterBatch beforehand
+	void RunWaterWorker(const WaterBatchConfig& config, int index);
+
+	//Spawns config.workers worker processes of the current executable and waits for them,
+	//returns the elapsed wall time in seconds. Throws if a worker fails or the batch exceeds config.timeout.
+	double RunWaterBatch(const WaterBatchConfig& config);
+
+	//Steps the whole grid with a single WaterSimulation and throws unless the strips saved by the batch
+	//match its heights bit for bit
+	void VerifyWaterBatch(const WaterBatchConfig& config);
+
+	//Runs batches with 1, 2, 4, ... maxWorkers workers keeping the number of grid points
+	//per worker constant and writes the timings to reportPath
+	void RunWaterWeakScaling(int baseSize, int maxWorkers, int steps, const std::wstring& reportPath);
+
+	//Handles the water batch command line switches, returns false if none is present.
+	//Batches save their strips, "water_batch" is used if no output is given, and verify them.
+	//  --water-worker <index> <workers> <size> <steps> <name | tcp://topHost:port> [output]
+	//  --water-batch <workers> <size> <steps> [output]
+	//  --water-socket-batch <port> <workers> <size> <steps> [output]
+	//  --water-scaling <baseSize> <maxWorkers> <steps> <report>
+	bool RunWaterBatchCommand(int argc, wchar_t** argv);
+}
\ No newline at end of file
@@ -0,0 +1,93 @@
+SamplerState samp : register(s0);
+
+cbuffer cbView : register(b0)
+{
+    matrix viewMatrix;
+    matrix invViewMatrix;
+};
+
+TextureCube envMap : register(t0);
+Texture2D<float> heightMap : register(t1);
+
+struct PSInput
+{
+    float4 pos : SV_POSITION;
+    float3 localPos : POSITION0;
+    float3 worldPos : POSITION1;
+};
+
+float3 intersectRay(float3 p, float3 r)
+{
+    float3 t = max((-p + 1) / r, (-p - 1) / r);
+    float minT = min(t.x, min(t.y, t.z));
+
+    return p + minT * r;
+}
+
+// same finite differences as WaterNormalMap::ReconstructNormal on the CPU,
+// the height grid spans the whole [-1, 1] local square
+float3 heightNormal(float2 tex)
+{
+    uint width, height;
+    heightMap.GetDimensions(width, height);
+
+    float2 texel = 1.0 / float2(width, height);
+    float d = 2.0 / (width - 1);
+
+    // neighbours past the center of the last texel are clamped to it instead of wrapping around,
+    // which gives the same flat border as the CPU normal map
+    float2 last = 1.0 - 0.5 * texel;
+
+    float h = heightMap.SampleLevel(samp, tex, 0);
+    float hNeighbourX = heightMap.SampleLevel(samp, float2(min(tex.x + texel.x, last.x), tex.y), 0);
+    float hNeighbourY = heightMap.SampleLevel(samp, float2(tex.x, min(tex.y + texel.y, last.y)), 0);
+
+    return normalize(float3(h - hNeighbourX, d, h - hNeighbourY));
+}
+
+float fresnel(float3 normal, float3 view)
+{
+    const float F0 = 0.14;
+    float cosTetha = max(0.0, dot(normal, view));
+	
+    return F0 + (1 - F0) * pow(1 - cosTetha, 5);
+}
+
+float4 main(PSInput i) : SV_TARGET
+{
+    float4 camPos = mul(invViewMatrix, float4(0.0, 0.0, 0.0, 1.0));
+    
+    float3 viewVec = normalize(camPos.xyz - i.worldPos);
+    float3 worldNorm = float3(0.0f, 1.0f, 0.0f);
+
+    float2 tex = (i.localPos.xz + 1.0) / 2.0;
+    float3 norm = heightNormal(tex);
+
+    float refractIndex = 0.75;
+
+    if (dot(viewVec, worldNorm) < 0)
+    {
+        refractIndex = 1.33;
+        norm = -norm;
+    }
+
+    float3 reflected = reflect(-viewVec, norm);
+    float3 refracted = refract(-viewVec, norm, refractIndex);
+
+    float3 reflectedCube = normalize(intersectRay(i.localPos, reflected));
+    float3 refractedCube = normalize(intersectRay(i.localPos, refracted));
+
+    float4 reflectedColor = envMap.Sample(samp, reflectedCube);
+    float4 refractedColor = envMap.Sample(samp, refractedCube);
+
+    float4 color = reflectedColor;
+
+    float f = fresnel(norm, viewVec);
+
+    if (any(refracted))
+    {
+        color = f * reflectedColor + (1 - f) * refractedColor;
+    }
+
+    return pow(color, 0.4545);
+}
\ No newline at end of file
@@ -0,0 +1,394 @@
+#include "waterNormalMap.h"
+#include "exceptions.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <utility>
+#include <xmmintrin.h>
+
+using namespace mini::gk2;
+using namespace DirectX;
+
+namespace
+{
+	void CatmullRomWeights(float t, float* w)
+	{
+		float t2 = t * t;
+		float t3 = t2 * t;
+
+		w[0] = -0.5f * t3 + t2 - 0.5f * t;
+		w[1] = 1.5f * t3 - 2.5f * t2 + 1.0f;
+		w[2] = -1.5f * t3 + 2.0f * t2 + 0.5f * t;
+		w[3] = 0.5f * t3 - 0.5f * t2;
+	}
+
+	//Bilinear sample of a square texture with wrap addressing, as done by the demo's sampler
+	XMFLOAT3 SampleLinear(const XMFLOAT3* texels, int size, float u, float v)
+	{
+		const float x = u * size - 0.5f, y = v * size - 0.5f;
+		const int x0 = static_cast<int>(floorf(x)), y0 = static_cast<int>(floorf(y));
+		const float fx = x - x0, fy = y - y0;
+
+		auto texel = [=](int i, int j) { return texels[((j % size + size) % size) * size + (i % size + size) % size]; };
+		auto a = texel(x0, y0), b = texel(x0 + 1, y0), c = texel(x0, y0 + 1), d = texel(x0 + 1, y0 + 1);
+
+		auto lerp = [=](float p, float q, float r, float s) { return (1 - fy) * ((1 - fx) * p + fx * q) + fy * ((1 - fx) * r + fx * s); };
+		return { lerp(a.x, b.x, c.x, d.x), lerp(a.y, b.y, c.y, d.y), lerp(a.z, b.z, c.z, d.z) };
+	}
+
+	//Transcription of heightNormal from waterHeightPS.hlsl, heights are stored in the x components.
+	//It doesn't call WaterNormalMap::ReconstructNormal, so that a wrong formula on either side shows up.
+	XMFLOAT3 ShaderNormal(const XMFLOAT3* heights, int size, float u, float v)
+	{
+		const float texel = 1.0f / size;
+		const float d = 2.0f / (size - 1);
+		const float last = 1.0f - 0.5f * texel;
+
+		const float h = SampleLinear(heights, size, u, v).x;
+		const float hNeighbourX = SampleLinear(heights, size, std::min(u + texel, last), v).x;
+		const float hNeighbourY = SampleLinear(heights, size, u, std::min(v + texel, last)).x;
+
+		// normalize(float3(h - hNeighbourX, d, h - hNeighbourY))
+		const XMFLOAT3 n(h - hNeighbourX, d, h - hNeighbourY);
+		const float length = sqrtf(n.x * n.x + n.y * n.y + n.z * n.z);
+		return { n.x / length, n.y / length, n.z / length };
+	}
+
+	float AngleDegrees(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		const float lengths = sqrtf((a.x * a.x + a.y * a.y + a.z * a.z) * (b.x * b.x + b.y * b.y + b.z * b.z));
+		const float c = std::clamp((a.x * b.x + a.y * b.y + a.z * b.z) / lengths, -1.0f, 1.0f);
+		return acosf(c) * 180.0f / XM_PI;
+	}
+}
+
+WaterNormalMap::WaterNormalMap(float pointsDistance, int resolution, float gridCoverage)
+	: m_pointsDistance(pointsDistance), m_resolution(resolution), m_gridCoverage(gridCoverage), m_gridSize(0)
+{ }
+
+void WaterNormalMap::SetResolution(int resolution)
+{
+	m_resolution = resolution;
+	m_gridSize = 0;
+}
+
+void WaterSurfaceDetail::Apply(int y, int resolution, float* row, std::vector<float>& x, std::vector<float>& z) const
+{
+	const float spacing = extent / (resolution - 1);
+	const float rowZ = -0.5f * extent + y * spacing;
+
+	if (farField)
+	{
+		x.resize(resolution);
+		z.resize(resolution);
+
+		for (int i = 0; i < resolution; i++)
+		{
+			x[i] = -0.5f * extent + i * spacing;
+			z[i] = rowZ;
+		}
+
+		farField->BlendFarField(x.data(), z.data(), row, resolution);
+	}
+
+	if (ripples)
+		ripples->CompositeRow(rowZ, -0.5f * extent, spacing, row, resolution);
+}
+
+DirectX::XMFLOAT3 WaterNormalMap::ReconstructNormal(float height, float hNeighbourX, float hNeighbourY, float d)
+{
+	// cross product of the tangents (d, hx - h, 0) and (0, hy - h, d), facing upwards
+	float nx = height - hNeighbourX;
+	float nz = height - hNeighbourY;
+	float invLen = 1.0f / sqrtf(nx * nx + d * d + nz * nz);
+
+	return { nx * invLen, d * invLen, nz * invLen };
+}
+
+void WaterNormalMap::EncodeNormal(const DirectX::XMFLOAT3& normal, unsigned char* texel)
+{
+	texel[0] = static_cast<unsigned char>((normal.x + 1.0f) / 2.0f * 255);
+	texel[1] = static_cast<unsigned char>(normal.y * 255);
+	texel[2] = static_cast<unsigned char>((normal.z + 1.0f) / 2.0f * 255);
+	texel[3] = 255;
+}
+
+void WaterNormalMap::PrepareFilter(int gridSize)
+{
+	m_gridSize = gridSize;
+
+	// the grid is centered in the map, with full coverage corner texels are aligned with the corner grid points
+	const float ratio = static_cast<float>(gridSize - 1) / ((m_resolution - 1) * m_gridCoverage);
+	const float first = 0.5f * (gridSize - 1) * (1.0f - 1.0f / m_gridCoverage);
+
+	for (int k = 0; k < TAPS; k++)
+	{
+		m_colTaps[k].resize(m_resolution);
+		m_colWeights[k].resize(m_resolution);
+		m_filtered[k].resize(m_resolution);
+		m_filteredRow[k] = -1;
+	}
+
+	for (int i = 0; i < m_resolution; i++)
+	{
+		float s = std::clamp(first + i * ratio, 0.0f, static_cast<float>(gridSize - 1));
+		int base = std::min(static_cast<int>(s), gridSize - 1);
+
+		float w[TAPS];
+		CatmullRomWeights(s - base, w);
+
+		for (int k = 0; k < TAPS; k++)
+		{
+			m_colTaps[k][i] = std::clamp(base - 1 + k, 0, gridSize - 1);
+			m_colWeights[k][i] = w[k];
+		}
+	}
+
+	// the filter is separable and the grid is square - rows use the same taps as columns
+	for (int k = 0; k < TAPS; k++)
+	{
+		m_rowTaps[k] = m_colTaps[k];
+		m_rowWeights[k] = m_colWeights[k];
+	}
+
+	m_source.resize(gridSize);
+	m_row.resize(m_resolution);
+	m_nextRow.resize(m_resolution);
+}
+
+const float* WaterNormalMap::FilteredRow(const WaterSimulation& grid, int gridRow)
+{
+	// the taps of a single output row are consecutive grid rows, so they never share a slot
+	const int slot = gridRow % TAPS;
+	float* out = m_filtered[slot].data();
+
+	if (m_filteredRow[slot] == gridRow)
+		return out;
+
+	m_filteredRow[slot] = gridRow;
+	grid.ReadRow(gridRow, m_source.data());
+
+	const float* src = m_source.data();
+
+	int i = 0;
+	for (; i + 4 <= m_resolution; i += 4)
+	{
+		__m128 acc = _mm_setzero_ps();
+		for (int k = 0; k < TAPS; k++)
+		{
+			const int* t = m_colTaps[k].data() + i;
+			auto v = _mm_set_ps(src[t[3]], src[t[2]], src[t[1]], src[t[0]]);
+			acc = _mm_add_ps(acc, _mm_mul_ps(v, _mm_loadu_ps(m_colWeights[k].data() + i)));
+		}
+
+		_mm_storeu_ps(out + i, acc);
+	}
+
+	for (; i < m_resolution; i++)
+	{
+		float acc = 0.0f;
+		for (int k = 0; k < TAPS; k++)
+			acc += src[m_colTaps[k][i]] * m_colWeights[k][i];
+
+		out[i] = acc;
+	}
+
+	return out;
+}
+
+void WaterNormalMap::ResampleRow(const WaterSimulation& grid, int y, float* row)
+{
+	if (m_resolution == m_gridSize && m_gridCoverage == 1.0f)
+	{
+		grid.ReadRow(y, row);
+		return;
+	}
+
+	const float* taps[TAPS];
+	__m128 w[TAPS];
+	for (int k = 0; k < TAPS; k++)
+	{
+		taps[k] = FilteredRow(grid, m_rowTaps[k][y]);
+		w[k] = _mm_set1_ps(m_rowWeights[k][y]);
+	}
+
+	int i = 0;
+	for (; i + 4 <= m_resolution; i += 4)
+	{
+		auto acc = _mm_mul_ps(_mm_loadu_ps(taps[0] + i), w[0]);
+		acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(taps[1] + i), w[1]));
+		acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(taps[2] + i), w[2]));
+		acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(taps[3] + i), w[3]));
+
+		_mm_storeu_ps(row + i, acc);
+	}
+
+	for (; i < m_resolution; i++)
+	{
+		float acc = 0.0f;
+		for (int k = 0; k < TAPS; k++)
+			acc += taps[k][i] * m_rowWeights[k][y];
+
+		row[i] = acc;
+	}
+}
+
+void WaterNormalMap::BeginFrame(const WaterSimulation& grid)
+{
+	if (m_gridSize != grid.size())
+		PrepareFilter(grid.size());
+
+	// the grid changes between calls, rows filtered during the previous one are stale
+	for (int k = 0; k < TAPS; k++)
+		m_filteredRow[k] = -1;
+}
+
+void WaterNormalMap::GenerateHeights(const WaterSimulation& grid, void* texels, size_t rowPitch, const WaterSurfaceDetail& detail)
+{
+	BeginFrame(grid);
+
+	for (int y = 0; y < m_resolution; y++)
+	{
+		auto row = reinterpret_cast<float*>(static_cast<unsigned char*>(texels) + y * rowPitch);
+
+		ResampleRow(grid, y, row);
+		detail.Apply(y, m_resolution, row, m_texelX, m_texelZ);
+	}
+}
+
+void WaterNormalMap::Generate(const WaterSimulation& grid, void* texels, size_t rowPitch, const WaterSurfaceDetail& detail)
+{
+	BeginFrame(grid);
+
+	const int size = m_resolution;
+	const float d = m_pointsDistance * (m_gridSize - 1) / ((size - 1) * m_gridCoverage);
+
+	auto sampleRow = [&](int y, float* row)
+	{
+		ResampleRow(grid, y, row);
+		detail.Apply(y, size, row, m_texelX, m_texelZ);
+	};
+
+	sampleRow(0, m_row.data());
+
+	for (int y = 0; y < size; y++)
+	{
+		// the last row and column reuse their own heights, which gives a flat border
+		if (y + 1 < size)
+			sampleRow(y + 1, m_nextRow.data());
+		else
+			m_nextRow = m_row;
+
+		auto out = static_cast<unsigned char*>(texels) + y * rowPitch;
+
+		for (int x = 0; x < size; x++)
+		{
+			float height = m_row[x];
+			float hNeighbourX = x + 1 < size ? m_row[x + 1] : height;
+			float hNeighbourY = m_nextRow[x];
+
+			auto n = ReconstructNormal(height, hNeighbourX, hNeighbourY, d);
+
+			EncodeNormal(n, out + 4 * x);
+		}
+
+		std::swap(m_row, m_nextRow);
+	}
+}
+
+void mini::gk2::RunWaterNormalCheck(const std::wstring& reportPath, int resolution)
+{
+	std::wofstream report(reportPath);
+	if (!report)
+		THROW(L"Couldn't open the water normal check report file");
+
+	// RGBA8 steps of 2/255 in x and z tilt a normal by up to about half a degree
+	constexpr float maxCenterAngle = 0.75f;
+	constexpr int samplesPerTexel = 4;
+
+	// reference field of crossing waves, 10 to 40 grid points long, on a grid spanning the [-1, 1] local square
+	const float d = 2.0f / (resolution - 1);
+	WaterSimulation grid(resolution, 1.0f, 0.5f, d, 1);
+	for (int y = 1; y < resolution - 1; y++)
+	{
+		for (int x = 1; x < resolution - 1; x++)
+		{
+			// faded out towards the border points, which stay flat
+			const float window = sinf(XM_PI * x / (resolution - 1)) * sinf(XM_PI * y / (resolution - 1));
+			grid.Disturb(x, y, window * (0.02f * sinf(0.16f * x + 0.05f * y) + 0.01f * sinf(0.11f * x - 0.37f * y) + 0.005f * sinf(0.6f * y)));
+		}
+	}
+
+	// the height texture uploaded by the height-only path and the normal map built on the CPU
+	std::vector<float> row(resolution);
+	std::vector<XMFLOAT3> heights(resolution * resolution);
+	for (int y = 0; y < resolution; y++)
+	{
+		grid.ReadRow(y, row.data());
+		for (int x = 0; x < resolution; x++)
+			heights[y * resolution + x] = { row[x], 0.0f, 0.0f };
+	}
+
+	std::vector<unsigned char> texels(4 * resolution * resolution);
+	WaterNormalMap map(d, resolution);
+	map.Generate(grid, texels.data(), 4 * resolution);
+
+	std::vector<XMFLOAT3> normals(resolution * resolution);
+	for (int i = 0; i < resolution * resolution; i++)
+	{
+		const unsigned char* t = texels.data() + 4 * i;
+		normals[i] = { (t[0] + 0.5f) / 255.0f * 2.0f - 1.0f, (t[1] + 0.5f) / 255.0f, (t[2] + 0.5f) / 255.0f * 2.0f - 1.0f };
+	}
+
+	float centerAngle = 0.0f;
+	int centerX = 0, centerY = 0;
+	for (int y = 0; y < resolution; y++)
+	{
+		for (int x = 0; x < resolution; x++)
+		{
+			const float u = (x + 0.5f) / resolution, v = (y + 0.5f) / resolution;
+			const float angle = AngleDegrees(ShaderNormal(heights.data(), resolution, u, v), normals[y * resolution + x]);
+			if (angle > centerAngle)
+			{
+				centerAngle = angle;
+				centerX = x;
+				centerY = y;
+			}
+		}
+	}
+
+	// between texel centers the shader interpolates heights while the normal map path interpolates normals,
+	// border texels are skipped as both paths wrap around there
+	float betweenAngle = 0.0f;
+	double meanAngle = 0.0;
+	const int samples = (resolution - 3) * samplesPerTexel;
+	for (int j = 0; j < samples; j++)
+	{
+		for (int i = 0; i < samples; i++)
+		{
+			const float u = (1.5f + static_cast<float>(i) / samplesPerTexel) / resolution;
+			const float v = (1.5f + static_cast<float>(j) / samplesPerTexel) / resolution;
+			const float angle = AngleDegrees(ShaderNormal(heights.data(), resolution, u, v), SampleLinear(normals.data(), resolution, u, v));
+			betweenAngle = std::max(betweenAngle, angle);
+			meanAngle += angle;
+		}
+	}
+	meanAngle /= static_cast<double>(samples) * samples;
+
+	report << L"samples\tmax angle deg\tmean angle deg\n";
+	report << L"texel centers\t" << centerAngle << L"\t-\n";
+	report << L"between texels\t" << betweenAngle << L"\t" << meanAngle << L"\n";
+
+	if (centerAngle > maxCenterAngle)
+		THROW(L"Shader and CPU water normals differ at texel (" + std::to_wstring(centerX) + L", " + std::to_wstring(centerY) + L")");
+}
+
+bool mini::gk2::RunWaterNormalCommand(int argc, wchar_t** argv)
+{
+	if (argc < 3 || std::wstring(argv[1]) != L"--water-normal-check")
+		return false;
+
+	RunWaterNormalCheck(argv[2]);
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "heightSource.h"
+#include "rippleSprites.h"
+#include "waterSimulation.h"
+
+namespace mini::gk2
+{
+	//Analytic layers added on top of the grid heights. Their coordinates span a square of side
+	//extent centered at the origin, which is mapped onto the whole normal map.
+	struct WaterSurfaceDetail
+	{
+		float extent = 0.0f;
+		const HybridHeightSource* farField = nullptr;
+		const RippleSprites* ripples = nullptr;
+
+		//Adds the layers to row y of a square grid of resolution x resolution points
+		void Apply(int y, int resolution, float* row, std::vector<float>& x, std::vector<float>& z) const;
+	};
+
+	//Builds the RGBA8 normal map of the water surface from the simulation's height grid.
+	//Heights are read one row at a time, so the grid's memory layout doesn't matter and
+	//texels are written straight into the mapped texture.
+	//The normal map resolution is independent of the grid size, heights are resampled
+	//with a separable Catmull-Rom filter when the two differ. The grid may cover only the central
+	//part of the map, texels outside of it get the heights of the nearest border points.
+	class WaterNormalMap
+	{
+	public:
+		//pointsDistance - distance between neighbouring grid points
+		//resolution - side of the normal map in texels
+		//gridCoverage - side of the area covered by the grid relative to the side of the map, at most 1
+		WaterNormalMap(float pointsDistance, int resolution, float gridCoverage = 1.0f);
+
+		int resolution() const { return m_resolution; }
+		void SetResolution(int resolution);
+
+		//texels - mapped texture of resolution() x resolution() texels, rowPitch - its row pitch in bytes
+		void Generate(const WaterSimulation& grid, void* texels, size_t rowPitch, const WaterSurfaceDetail& detail = {});
+		//Writes the resampled heights instead of normals, texels - mapped R32 texture of resolution() x resolution() texels
+		void GenerateHeights(const WaterSimulation& grid, void* texels, size_t rowPitch, const WaterSurfaceDetail& detail = {});
+
+		//Normal from the heights of a point and its +x and +y neighbours lying d apart,
+		//CPU reference of the reconstruction done by waterHeightPS.hlsl
+		static DirectX::XMFLOAT3 ReconstructNormal(float height, float hNeighbourX, float hNeighbourY, float d);
+		//Packs a unit normal into an RGBA8 texel
+		static void EncodeNormal(const DirectX::XMFLOAT3& normal, unsigned char* texel);
+
+	private:
+		static constexpr int TAPS = 4;
+
+		void PrepareFilter(int gridSize);
+		//Prepares the filter for the grid and drops rows filtered from its previous state
+		void BeginFrame(const WaterSimulation& grid);
+
+		//Heights of the output row y at the normal map resolution
+		void ResampleRow(const WaterSimulation& grid, int y, float* row);
+		//Grid row resampled horizontally to the normal map resolution, cached for the neighbouring output rows
+		const float* FilteredRow(const WaterSimulation& grid, int gridRow);
+
+		float m_pointsDistance;
+		int m_resolution;
+		float m_gridCoverage;
+		int m_gridSize;
+
+		//clamped source indices and Catmull-Rom weights of every output column and row, one array per tap
+		std::vector<int> m_colTaps[TAPS], m_rowTaps[TAPS];
+		std::vector<float> m_colWeights[TAPS], m_rowWeights[TAPS];
+
+		std::vector<float> m_source;
+		std::vector<float> m_filtered[TAPS];
+		int m_filteredRow[TAPS];
+
+		std::vector<float> m_row, m_nextRow;
+		std::vector<float> m_texelX, m_texelZ;
+	};
+
+	//Compares normals reconstructed the way waterHeightPS.hlsl does it with the CPU normal map on a reference
+	//height field and writes the largest angles between them to reportPath. Throws if they differ at texel centers.
+	void RunWaterNormalCheck(const std::wstring& reportPath, int resolution = 256);
+
+	//Handles the --water-normal-check <report> command line switch, returns false if it's not present
+	bool RunWaterNormalCommand(int argc, wchar_t** argv);
+}
\ No newline at end of file
@@ -0,0 +1,173 @@
+#include "waterPlanner.h"
+#include "waterNormalMap.h"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <intrin.h>
+#include <sstream>
+#include <thread>
+
+using namespace mini::gk2;
+
+namespace
+{
+	//simulation parameters used for timing, they don't affect the speed of the kernels
+	constexpr float PLAN_WAVE_SPEED = 1.0f;
+	constexpr float PLAN_TIME_STEP = 0.5f;
+	constexpr float PLAN_POINTS_DISTANCE = 1.0f;
+
+	constexpr int TILE_SIZES[] = { 16, 32, 64 };
+}
+
+WaterPlanner::WaterPlanner(int size, Stencil stencil)
+	: m_size(size), m_stencil(stencil)
+{ }
+
+std::string WaterPlanner::CpuModel()
+{
+	int regs[4];
+	__cpuid(regs, 0x80000000);
+	if (static_cast<unsigned>(regs[0]) < 0x80000004)
+		return "unknown";
+
+	char brand[49] = {};
+	for (int i = 0; i < 3; i++)
+	{
+		__cpuid(regs, 0x80000002 + i);
+		memcpy(brand + 16 * i, regs, sizeof(regs));
+	}
+
+	// the brand string is padded with spaces, which would break the wisdom file format
+	std::string model(brand);
+	model.erase(0, model.find_first_not_of(' '));
+	model.erase(model.find_last_not_of(' ') + 1);
+	for (auto& c : model)
+	{
+		if (c == '|')
+			c = '/';
+	}
+
+	return model;
+}
+
+std::string WaterPlanner::WisdomKey() const
+{
+	return CpuModel() + "|" + std::to_string(m_size) + "|" + std::to_string(static_cast<int>(m_stencil));
+}
+
+std::vector<WaterSimulationOptions> WaterPlanner::Candidates() const
+{
+	std::vector<int> jobCounts = { 1 };
+	const int threads = static_cast<int>(std::thread::hardware_concurrency());
+	for (int jobs = 2; jobs <= threads; jobs *= 2)
+	{
+		jobCounts.push_back(jobs);
+	}
+
+	std::vector<WaterSimulationOptions> candidates;
+	for (int jobs : jobCounts)
+	{
+		candidates.push_back({ GridLayout::RowMajor, 32, m_stencil, jobs });
+
+		for (int tile : TILE_SIZES)
+		{
+			if (tile < m_size)
+				candidates.push_back({ GridLayout::Tiled, tile, m_stencil, jobs });
+		}
+	}
+
+	return candidates;
+}
+
+WaterSimulationOptions WaterPlanner::Measure(int steps) const
+{
+	WaterNormalMap normals(PLAN_POINTS_DISTANCE, m_size);
+	std::vector<unsigned char> texels(static_cast<size_t>(m_size) * m_size * 4);
+
+	WaterSimulationOptions best;
+	double bestTime = 0.0;
+
+	for (const auto& options : Candidates())
+	{
+		WaterSimulation water(m_size, PLAN_WAVE_SPEED, PLAN_TIME_STEP, PLAN_POINTS_DISTANCE, m_size / 8, options);
+		water.Disturb(m_size / 2, m_size / 2, 1.0f);
+
+		// warm up caches and the thread pool before timing
+		water.Step();
+		normals.Generate(water, texels.data(), m_size * 4);
+
+		auto start = std::chrono::steady_clock::now();
+		for (int s = 0; s < steps; s++)
+		{
+			water.Step();
+			normals.Generate(water, texels.data(), m_size * 4);
+		}
+		double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		if (bestTime == 0.0 || time < bestTime)
+		{
+			best = options;
+			bestTime = time;
+		}
+	}
+
+	return best;
+}
+
+WaterSimulationOptions WaterPlanner::Plan(const std::wstring& wisdomPath, bool remeasure)
+{
+	const auto key = WisdomKey();
+
+	// each line holds: cpu model|grid size|stencil|layout tile size jobs
+	std::vector<std::string> lines;
+	{
+		std::ifstream file(wisdomPath);
+		std::string line;
+		while (std::getline(file, line))
+		{
+			if (line.compare(0, key.size() + 1, key + "|") != 0)
+			{
+				lines.push_back(line);
+				continue;
+			}
+
+			std::istringstream values(line.substr(key.size() + 1));
+			int layout = 0;
+			WaterSimulationOptions options;
+			options.stencil = m_stencil;
+
+			// a corrupted or hand-edited entry is dropped and measured again
+			if (!remeasure && values >> layout >> options.tileSize >> options.jobs
+				&& (layout == static_cast<int>(GridLayout::RowMajor) || layout == static_cast<int>(GridLayout::Tiled))
+				&& options.tileSize > 0 && options.jobs >= 1)
+			{
+				options.layout = static_cast<GridLayout>(layout);
+				return options;
+			}
+		}
+	}
+
+	auto options = Measure();
+
+	lines.push_back(key + "|" + std::to_string(static_cast<int>(options.layout)) + " "
+		+ std::to_string(options.tileSize) + " " + std::to_string(options.jobs));
+
+	// failing to store wisdom only costs another measurement on the next startup
+	std::ofstream file(wisdomPath, std::ios::trunc);
+	for (const auto& line : lines)
+	{
+		file << line << "\n";
+	}
+
+	return options;
+}
+
+bool mini::gk2::RunWaterPlannerCommand(int argc, wchar_t** argv)
+{
+	if (argc < 4 || std::wstring(argv[1]) != L"--water-plan")
+		return false;
+
+	WaterPlanner(_wtoi(argv[2]), Stencil::NinePoint).Plan(argv[3], true);
+	return true;
+}
\ No newline at end of file
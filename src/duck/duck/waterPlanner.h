@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "waterSimulation.h"
+
+namespace mini::gk2
+{
+	//Picks the fastest memory layout, tile size and job count of the water solver for the host
+	//by timing one simulation step followed by normal map generation for each candidate.
+	//Results are cached as wisdom in a text file, keyed by the CPU model and the grid parameters.
+	class WaterPlanner
+	{
+	public:
+		WaterPlanner(int size, Stencil stencil);
+
+		//Returns the options stored in the wisdom file, measures and stores them if missing or if remeasure is set
+		WaterSimulationOptions Plan(const std::wstring& wisdomPath, bool remeasure = false);
+
+		//Times all candidates and returns the fastest one
+		WaterSimulationOptions Measure(int steps = 20) const;
+
+		std::vector<WaterSimulationOptions> Candidates() const;
+
+		//Processor brand string reported by cpuid
+		static std::string CpuModel();
+
+	private:
+		std::string WisdomKey() const;
+
+		int m_size;
+		Stencil m_stencil;
+	};
+
+	//Handles the --water-plan <size> <wisdomPath> command line switch, returns false if it's not present
+	bool RunWaterPlannerCommand(int argc, wchar_t** argv);
+}
\ No newline at end of file
@@ -0,0 +1,347 @@
+#include "waterSimulation.h"
+#include "waterStencil.h"
+#include "exceptions.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <execution>
+#include <fstream>
+#include <numeric>
+
+using namespace mini::gk2;
+using namespace mini::gk2::waterStencil;
+
+WaterSimulation::WaterSimulation(int size, float waveSpeed, float timeStep, float pointsDistance, int bandWidth,
+	const WaterSimulationOptions& options)
+	: m_size(size), m_bandWidth(std::clamp(bandWidth, 1, size / 2)), m_options(options), m_tilesPerRow(0), m_jobs(1),
+	m_scratchSize(size)
+{
+	m_weights = StencilWeights::Create(m_options.stencil, waveSpeed, timeStep, pointsDistance);
+	m_bandDamping = BandDamping(size, m_bandWidth, INTERIOR_DAMPING);
+
+	size_t cells = static_cast<size_t>(size) * size;
+	if (m_options.layout == GridLayout::Tiled)
+	{
+		// the last row and column of tiles are padded if the size isn't a multiple of the tile size
+		m_tilesPerRow = (size + m_options.tileSize - 1) / m_options.tileSize;
+		cells = static_cast<size_t>(m_tilesPerRow) * m_tilesPerRow * m_options.tileSize * m_options.tileSize;
+		m_scratchSize = m_options.tileSize + 3 * (m_options.tileSize + 2);
+	}
+
+	// row-major grids are split into ranges of rows, tiled ones into ranges of tile rows
+	m_jobs = std::clamp(m_options.jobs, 1, m_options.layout == GridLayout::RowMajor ? size : m_tilesPerRow);
+	m_scratch.resize(m_jobs * m_scratchSize);
+	m_jobIndices.resize(m_jobs);
+	std::iota(m_jobIndices.begin(), m_jobIndices.end(), 0);
+
+	m_heights.resize(cells);
+	m_prevHeights.resize(cells);
+}
+
+void WaterSimulation::Disturb(int x, int y, float amount)
+{
+	x = std::clamp(x, 1, m_size - 2);
+	y = std::clamp(y, 1, m_size - 2);
+
+	m_heights[Index(x, y)] += amount;
+}
+
+void WaterSimulation::ReadRow(int y, float* row) const
+{
+	if (m_options.layout == GridLayout::RowMajor)
+	{
+		memcpy(row, m_heights.data() + y * m_size, m_size * sizeof(float));
+		return;
+	}
+
+	const int t = m_options.tileSize;
+	for (int x = 0; x < m_size; x += t)
+	{
+		memcpy(row + x, m_heights.data() + Index(x, y), std::min(t, m_size - x) * sizeof(float));
+	}
+}
+
+void WaterSimulation::CopyHaloRow(int x0, int x1, int y, float* row) const
+{
+	row[0] = m_heights[Index(x0 - 1, y)];
+	memcpy(row + 1, m_heights.data() + Index(x0, y), (x1 - x0) * sizeof(float));
+	row[x1 - x0 + 1] = m_heights[Index(x1, y)];
+}
+
+void WaterSimulation::Step()
+{
+	const bool ninePoint = m_options.stencil == Stencil::NinePoint;
+	const bool rowMajor = m_options.layout == GridLayout::RowMajor;
+
+	const int units = rowMajor ? m_size : m_tilesPerRow;
+	const int jobs = m_jobs;
+
+	auto stepRange = [this, ninePoint, rowMajor, units, jobs](int job)
+	{
+		const int first = units * job / jobs;
+		const int last = units * (job + 1) / jobs;
+		float* scratch = m_scratch.data() + job * m_scratchSize;
+
+		if (rowMajor)
+			ninePoint ? StepRowMajor<true>(first, last, scratch) : StepRowMajor<false>(first, last, scratch);
+		else
+			ninePoint ? StepTiled<true>(first, last, scratch) : StepTiled<false>(first, last, scratch);
+	};
+
+	if (jobs == 1)
+	{
+		stepRange(0);
+	}
+	else
+	{
+		// new heights of a point depend only on the current grid, ranges can be stepped in any order
+		std::for_each(std::execution::par, m_jobIndices.begin(), m_jobIndices.end(), stepRange);
+	}
+
+	std::swap(m_heights, m_prevHeights);
+}
+
+template<bool NinePoint>
+void WaterSimulation::StepRowMajor(int firstRow, int lastRow, float* damping)
+{
+	const int n = m_size;
+
+	for (int y = std::max(firstRow, 1); y < std::min(lastRow, n - 1); y++)
+	{
+		const float* cur = m_heights.data() + y * n;
+		float* next = m_prevHeights.data() + y * n;
+
+		StepRow<NinePoint>(cur - n, cur, cur + n, next, n, y, m_bandWidth, m_bandDamping.data(), INTERIOR_DAMPING,
+			m_weights, damping);
+	}
+}
+
+template<bool NinePoint>
+void WaterSimulation::StepTiled(int firstTileRow, int lastTileRow, float* scratch)
+{
+	const int n = m_size;
+	const int t = m_options.tileSize;
+	const int tileCells = t * t;
+
+	float* damping = scratch;
+
+	// rows of the tile extended with the neighbouring points of adjacent tiles
+	float* halo = scratch + t;
+
+	for (int ty = firstTileRow; ty < lastTileRow; ty++)
+	{
+		for (int tx = 0; tx < m_tilesPerRow; tx++)
+		{
+			const int gx0 = tx * t;
+			const int gy0 = ty * t;
+
+			// only cells with coordinates in [1, n - 2] are updated
+			const int lx0 = std::max(0, 1 - gx0), lx1 = std::min(t, n - 1 - gx0);
+			const int ly0 = std::max(0, 1 - gy0), ly1 = std::min(t, n - 1 - gy0);
+
+			if (lx1 <= lx0 || ly1 <= ly0)
+				continue;
+
+			const bool interior = gx0 + lx0 >= m_bandWidth && gx0 + lx1 <= n - m_bandWidth
+				&& gy0 + ly0 >= m_bandWidth && gy0 + ly1 <= n - m_bandWidth;
+
+			const int count = lx1 - lx0;
+			float* nextTile = m_prevHeights.data() + (ty * m_tilesPerRow + tx) * tileCells;
+
+			float* up = halo;
+			float* cur = up + t + 2;
+			float* down = cur + t + 2;
+
+			CopyHaloRow(gx0 + lx0, gx0 + lx1, gy0 + ly0 - 1, up);
+			CopyHaloRow(gx0 + lx0, gx0 + lx1, gy0 + ly0, cur);
+
+			for (int ly = ly0; ly < ly1; ly++)
+			{
+				const int gy = gy0 + ly;
+				CopyHaloRow(gx0 + lx0, gx0 + lx1, gy + 1, down);
+
+				float* next = nextTile + ly * t + lx0;
+
+				if (interior)
+				{
+					StepCells<NinePoint>(up + 1, cur + 1, down + 1, next, count, m_weights,
+						ConstantDamping{ INTERIOR_DAMPING });
+				}
+				else
+				{
+					const int dy = BorderDistance(gy, n);
+					for (int lx = lx0; lx < lx1; lx++)
+						damping[lx - lx0] = m_bandDamping[std::min(BorderDistance(gx0 + lx, n), dy)];
+
+					StepCells<NinePoint>(up + 1, cur + 1, down + 1, next, count, m_weights,
+						TableDamping{ damping });
+				}
+
+				std::swap(up, cur);
+				std::swap(cur, down);
+			}
+		}
+	}
+}
+void mini::gk2::RunWaterLayoutBenchmark(const std::wstring& reportPath, int steps)
+{
+	std::wofstream report(reportPath);
+	if (!report)
+		THROW(L"Couldn't open the water layout benchmark report file");
+
+	report << L"size\tstencil\tlayout\ttile\tms/step\tMpoints/s\tmax difference\n";
+
+	const WaterSimulationOptions layouts[] = { { GridLayout::RowMajor }, { GridLayout::Tiled, 32 }, { GridLayout::Tiled, 64 } };
+
+	for (int size : { 1024, 4096 })
+	{
+		for (auto stencil : { Stencil::FivePoint, Stencil::NinePoint })
+		{
+			std::vector<float> row(size);
+			std::vector<float> rows;
+
+			for (auto options : layouts)
+			{
+				options.stencil = stencil;
+				WaterSimulation water(size, 1.0f, 0.5f, 1.0f, 32, options);
+				for (int i = 1; i < 8; i++)
+					water.Disturb(size * i / 8, size * ((i * 5) % 8 + 1) / 10, 1.0f);
+
+				auto start = std::chrono::steady_clock::now();
+				for (int s = 0; s < steps; s++)
+					water.Step();
+				double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+				// all layouts run the same cell kernel, heights are compared with the row-major run
+				float difference = 0.0f;
+				if (rows.empty())
+				{
+					rows.resize(static_cast<size_t>(size) * size);
+					for (int y = 0; y < size; y++)
+						water.ReadRow(y, rows.data() + static_cast<size_t>(y) * size);
+				}
+				else
+				{
+					for (int y = 0; y < size; y++)
+					{
+						water.ReadRow(y, row.data());
+						for (int x = 0; x < size; x++)
+							difference = std::max(difference, fabsf(row[x] - rows[static_cast<size_t>(y) * size + x]));
+					}
+				}
+
+				const double points = static_cast<double>(size) * size * steps;
+				report << size << L"\t" << (stencil == Stencil::NinePoint ? L"nine-point" : L"five-point") << L"\t"
+					<< (options.layout == GridLayout::RowMajor ? L"row-major" : L"tiled") << L"\t"
+					<< (options.layout == GridLayout::RowMajor ? 0 : options.tileSize) << L"\t" << 1000.0 * seconds / steps << L"\t"
+					<< points / seconds * 1e-6 << L"\t" << difference << L"\n";
+			}
+		}
+	}
+}
+
+bool mini::gk2::RunWaterLayoutCommand(int argc, wchar_t** argv)
+{
+	if (argc < 3 || std::wstring(argv[1]) != L"--water-layout-bench")
+		return false;
+
+	RunWaterLayoutBenchmark(argv[2]);
+	return true;
+}
+
+void mini::gk2::RunRippleRoundnessBenchmark(const std::wstring& reportPath, int steps)
+{
+	std::wofstream report(reportPath);
+	if (!report)
+		THROW(L"Couldn't open the ripple roundness report file");
+
+	// Courant number 0.5 as in the demo
+	constexpr int size = 257;
+	constexpr int center = size / 2;
+	constexpr int directions = 360;
+	constexpr float radiusStep = 0.25f;
+	constexpr float dropSigma = 1.0f;
+	constexpr int dropRadius = 3;
+	constexpr float frontThreshold = 0.05f;
+
+	report << L"stencil\tsteps\tmean radius\tradius std dev %\tmin radius\tmax radius\n";
+
+	// relative standard deviations of the front radius, the nine-point one has to come out rounder
+	double anisotropy[2] = {};
+	for (auto stencil : { Stencil::FivePoint, Stencil::NinePoint })
+	{
+		WaterSimulationOptions options;
+		options.stencil = stencil;
+		WaterSimulation water(size, 1.0f, 0.5f, 1.0f, 8, options);
+
+		// a smooth drop, a single point would excite waves of the grid spacing which no stencil carries well
+		for (int y = -dropRadius; y <= dropRadius; y++)
+		{
+			for (int x = -dropRadius; x <= dropRadius; x++)
+				water.Disturb(center + x, center + y, expf(-0.5f * (x * x + y * y) / (dropSigma * dropSigma)));
+		}
+
+		for (int s = 0; s < steps; s++)
+			water.Step();
+
+		float peak = 0.0f;
+		for (int y = 0; y < size; y++)
+		{
+			for (int x = 0; x < size; x++)
+				peak = std::max(peak, fabsf(water.height(x, y)));
+		}
+
+		// the front is the farthest point along a ray from the drop still displaced by a noticeable part of the peak
+		std::vector<float> radii(directions);
+		for (int d = 0; d < directions; d++)
+		{
+			const float angle = 2.0f * 3.14159265f * d / directions;
+			const float cx = cosf(angle), cy = sinf(angle);
+
+			float front = 0.0f;
+			for (float r = 1.0f; r < center - 2; r += radiusStep)
+			{
+				const float x = center + r * cx, y = center + r * cy;
+				const int x0 = static_cast<int>(x), y0 = static_cast<int>(y);
+				const float fx = x - x0, fy = y - y0;
+
+				const float h = (1.0f - fy) * ((1.0f - fx) * water.height(x0, y0) + fx * water.height(x0 + 1, y0))
+					+ fy * ((1.0f - fx) * water.height(x0, y0 + 1) + fx * water.height(x0 + 1, y0 + 1));
+
+				if (fabsf(h) >= frontThreshold * peak)
+					front = r;
+			}
+
+			radii[d] = front;
+		}
+
+		double mean = 0.0, variance = 0.0;
+		for (float r : radii)
+			mean += r;
+		mean /= directions;
+		for (float r : radii)
+			variance += (r - mean) * (r - mean);
+		variance /= directions;
+
+		anisotropy[stencil == Stencil::NinePoint] = sqrt(variance) / mean;
+
+		auto [minRadius, maxRadius] = std::minmax_element(radii.begin(), radii.end());
+		report << (stencil == Stencil::NinePoint ? L"nine-point" : L"five-point") << L"\t" << steps << L"\t" << mean << L"\t"
+			<< 100.0 * sqrt(variance) / mean << L"\t" << *minRadius << L"\t" << *maxRadius << L"\n";
+	}
+
+	if (!(anisotropy[1] < anisotropy[0]))
+		THROW(L"Nine-point stencil ripples aren't rounder than five-point ones: radius std dev " + std::to_wstring(100.0 * anisotropy[1])
+			+ L"% against " + std::to_wstring(100.0 * anisotropy[0]) + L"%");
+}
+
+bool mini::gk2::RunRippleRoundnessCommand(int argc, wchar_t** argv)
+{
+	if (argc < 3 || std::wstring(argv[1]) != L"--water-ripple-bench")
+		return false;
+
+	RunRippleRoundnessBenchmark(argv[2]);
+	return true;
+}
\ No newline at end of file
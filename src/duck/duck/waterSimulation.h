@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+namespace mini::gk2
+{
+	//Memory layout of the simulation grids
+	enum class GridLayout
+	{
+		RowMajor,	//plain rows of the whole grid
+		Tiled		//square tiles stored one after another, row-major inside each tile
+	};
+
+	//Discretization of the Laplacian
+	enum class Stencil
+	{
+		FivePoint,	//axis neighbours only, ripples turn square on coarse grids
+		NinePoint	//isotropic stencil including diagonal neighbours
+	};
+
+	//Stencil coefficients of the discretized wave equation
+	struct StencilWeights
+	{
+		float axis, diagonal, center;	//weights of the axis neighbours, diagonal neighbours and the center point
+
+		static StencilWeights Create(Stencil stencil, float waveSpeed, float timeStep, float pointsDistance)
+		{
+			const float a = powf(waveSpeed * timeStep / pointsDistance, 2.0f);
+
+			// (4 * axis + diagonal - 20 * center) / 6 - error term of the Laplacian doesn't depend on the direction
+			if (stencil == Stencil::NinePoint)
+				return { 4.0f * a / 6.0f, a / 6.0f, 2.0f - 20.0f * a / 6.0f };
+
+			return { a, 0.0f, 2.0f - 4.0f * a };
+		}
+	};
+
+	struct WaterSimulationOptions
+	{
+		GridLayout layout = GridLayout::RowMajor;
+		int tileSize = 32;	//side of a tile in grid points, used by the tiled layout
+		Stencil stencil = Stencil::FivePoint;
+		int jobs = 1;	//number of row ranges stepped in parallel
+	};
+
+	//Finite difference solver of the 2D wave equation on a square grid
+	//(Game Programming Gems 1, Chapter 2.6).
+	//Waves are absorbed only in a thin band along the grid border, the interior
+	//uses a single constant damping factor.
+	class WaterSimulation
+	{
+	public:
+		static constexpr float INTERIOR_DAMPING = 0.95f;
+
+		//size - number of grid points along each side
+		//waveSpeed, timeStep, pointsDistance - parameters of the discretized wave equation
+		//bandWidth - width of the absorbing border band in grid points
+		WaterSimulation(int size, float waveSpeed, float timeStep, float pointsDistance, int bandWidth,
+			const WaterSimulationOptions& options = {});
+
+		void Step();
+
+		//Adds amount to the height of the grid point (x, y), border points are moved inwards
+		void Disturb(int x, int y, float amount);
+
+		int size() const { return m_size; }
+		GridLayout layout() const { return m_options.layout; }
+		int tileSize() const { return m_options.tileSize; }
+		int tilesPerRow() const { return m_tilesPerRow; }
+		Stencil stencil() const { return m_options.stencil; }
+		const WaterSimulationOptions& options() const { return m_options; }
+
+		//Grid storage in the simulation's own layout, use Index to address it
+		const float* data() const { return m_heights.data(); }
+
+		int Index(int x, int y) const
+		{
+			if (m_options.layout == GridLayout::RowMajor)
+				return y * m_size + x;
+
+			const int t = m_options.tileSize;
+			return ((y / t) * m_tilesPerRow + x / t) * t * t + (y % t) * t + x % t;
+		}
+
+		float height(int x, int y) const { return m_heights[Index(x, y)]; }
+
+		//Copies row y of the grid into a contiguous array of size() values
+		void ReadRow(int y, float* row) const;
+
+	private:
+		//scratch - scratchSize() values owned by the calling job
+		template<bool NinePoint> void StepRowMajor(int firstRow, int lastRow, float* scratch);
+		template<bool NinePoint> void StepTiled(int firstTileRow, int lastTileRow, float* scratch);
+
+		//Copies grid points (x0 - 1 .. x1, y) into a contiguous row of x1 - x0 + 2 values
+		void CopyHaloRow(int x0, int x1, int y, float* row) const;
+
+		int m_size;
+		int m_bandWidth;
+		StencilWeights m_weights;
+
+		WaterSimulationOptions m_options;
+		int m_tilesPerRow;
+		int m_jobs;
+		std::vector<int> m_jobIndices;	//0 .. m_jobs - 1, iterated by the parallel step
+
+		//damping factors of a row (and halo rows of a tile in the tiled layout) for every job
+		std::vector<float> m_scratch;
+		size_t m_scratchSize;
+
+		//damping factor indexed by the distance from the nearest grid border,
+		//entries past the absorbing band hold INTERIOR_DAMPING
+		std::vector<float> m_bandDamping;
+
+		std::vector<float> m_heights;
+		std::vector<float> m_prevHeights;
+	};
+
+	//Times the row-major and tiled layouts on 1024^2 and 4096^2 grids and writes them to reportPath
+	void RunWaterLayoutBenchmark(const std::wstring& reportPath, int steps = 50);
+
+	//Handles the --water-layout-bench <report> command line switch, returns false if it's not present
+	bool RunWaterLayoutCommand(int argc, wchar_t** argv);
+
+	//Spreads a small drop with both stencils and writes how round the ring is after the given number
+	//of steps: the mean and the relative standard deviation of the front radius over 360 directions.
+	//Throws if the nine-point stencil's ring isn't rounder than the five-point one's.
+	void RunRippleRoundnessBenchmark(const std::wstring& reportPath, int steps = 80);
+
+	//Handles the --water-ripple-bench <report> command line switch, returns false if it's not present
+	bool RunRippleRoundnessCommand(int argc, wchar_t** argv);
+}
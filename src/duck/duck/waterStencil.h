@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <xmmintrin.h>
+
+#include "waterSimulation.h"
+
+//Row kernels of the wave equation solver shared by the whole-grid and the decomposed solvers
+namespace mini::gk2::waterStencil
+{
+	//Damping factor indexed by the distance from the nearest border of a grid of the given size,
+	//entries past the absorbing band hold interiorDamping
+	inline std::vector<float> BandDamping(int size, int bandWidth, float interiorDamping)
+	{
+		// graded profile - a smooth quadratic ramp reflects much less than a linear one
+		// at the inner edge of the band
+		std::vector<float> damping(size / 2 + 1, interiorDamping);
+		for (int i = 0; i < bandWidth; i++)
+		{
+			float t = 1.0f - static_cast<float>(i) / bandWidth;
+			damping[i] = interiorDamping * (1.0f - t * t);
+		}
+
+		return damping;
+	}
+
+	inline int BorderDistance(int i, int size) { return i < size - 1 - i ? i : size - 1 - i; }
+
+	struct ConstantDamping
+	{
+		float value;
+		float operator[](int) const { return value; }
+		__m128 Load(int) const { return _mm_set1_ps(value); }
+	};
+
+	struct TableDamping
+	{
+		const float* values;
+		float operator[](int i) const { return values[i]; }
+		__m128 Load(int i) const { return _mm_loadu_ps(values + i); }
+	};
+
+	//Updates n consecutive cells of a row. Elements -1 and n of up, cur and down
+	//must hold the neighbours of the first and the last cell.
+	//next initially holds the heights from the previous step, each cell reads only
+	//its own old value so the new one can overwrite it in place.
+	template<bool NinePoint, typename Damping>
+	void StepCells(const float* up, const float* cur, const float* down, float* next, int n,
+		const StencilWeights& weights, const Damping& damping)
+	{
+		const float axis = weights.axis, diagonal = weights.diagonal, center = weights.center;
+		const __m128 axisW = _mm_set1_ps(axis), diagonalW = _mm_set1_ps(diagonal), centerW = _mm_set1_ps(center);
+
+		int i = 0;
+		for (; i + 4 <= n; i += 4)
+		{
+			auto sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(up + i), _mm_loadu_ps(down + i)),
+				_mm_add_ps(_mm_loadu_ps(cur + i - 1), _mm_loadu_ps(cur + i + 1)));
+			auto h = _mm_mul_ps(sum, axisW);
+
+			if constexpr (NinePoint)
+			{
+				auto corners = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(up + i - 1), _mm_loadu_ps(up + i + 1)),
+					_mm_add_ps(_mm_loadu_ps(down + i - 1), _mm_loadu_ps(down + i + 1)));
+				h = _mm_add_ps(h, _mm_mul_ps(corners, diagonalW));
+			}
+
+			h = _mm_add_ps(h, _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(cur + i), centerW), _mm_loadu_ps(next + i)));
+			_mm_storeu_ps(next + i, _mm_mul_ps(h, damping.Load(i)));
+		}
+
+		for (; i < n; i++)
+		{
+			float h = axis * (up[i] + down[i] + cur[i - 1] + cur[i + 1]);
+
+			if constexpr (NinePoint)
+				h += diagonal * (up[i - 1] + up[i + 1] + down[i - 1] + down[i + 1]);
+
+			next[i] = damping[i] * (h + center * cur[i] - next[i]);
+		}
+	}
+
+	//Updates inner points (1 .. n - 2) of a row of a row-major grid with n points per row.
+	//y - row's index in a grid of size n, bandDamping - table created by BandDamping,
+	//scratch - buffer of n values
+	template<bool NinePoint>
+	void StepRow(const float* up, const float* cur, const float* down, float* next, int n, int y, int bandWidth,
+		const float* bandDamping, float interiorDamping, const StencilWeights& weights, float* scratch)
+	{
+		const int inner0 = bandWidth;
+		const int inner1 = n - bandWidth;
+		const int dy = BorderDistance(y, n);
+
+		if (y < inner0 || y >= inner1)
+		{
+			for (int x = 1; x < n - 1; x++)
+				scratch[x] = bandDamping[std::min(BorderDistance(x, n), dy)];
+
+			StepCells<NinePoint>(up + 1, cur + 1, down + 1, next + 1, n - 2, weights, TableDamping{ scratch + 1 });
+			return;
+		}
+
+		for (int x = 1; x < inner0; x++)
+			scratch[x] = bandDamping[BorderDistance(x, n)];
+		for (int x = inner1; x < n - 1; x++)
+			scratch[x] = bandDamping[BorderDistance(x, n)];
+
+		StepCells<NinePoint>(up + 1, cur + 1, down + 1, next + 1, inner0 - 1, weights, TableDamping{ scratch + 1 });
+		StepCells<NinePoint>(up + inner0, cur + inner0, down + inner0, next + inner0, inner1 - inner0,
+			weights, ConstantDamping{ interiorDamping });
+		StepCells<NinePoint>(up + inner1, cur + inner1, down + inner1, next + inner1, n - 1 - inner1,
+			weights, TableDamping{ scratch + inner1 });
+	}
+}
\ No newline at end of file
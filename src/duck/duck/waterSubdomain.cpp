@@ -0,0 +1,96 @@
+#include "waterSubdomain.h"
+#include "waterStencil.h"
+
+#include <algorithm>
+
+using namespace mini::gk2;
+using namespace mini::gk2::waterStencil;
+
+WaterSubdomain::WaterSubdomain(int size, int index, int count, float waveSpeed, float timeStep, float pointsDistance,
+	int bandWidth, Stencil stencil, HaloTransport& transport)
+	: m_size(size), m_index(index), m_count(count), m_bandWidth(std::clamp(bandWidth, 1, size / 2)), m_step(0),
+	m_stencil(stencil), m_transport(transport)
+{
+	// the first (size % count) strips get one extra row
+	const int rows = size / count;
+	const int extra = size % count;
+
+	m_y0 = index * rows + std::min(index, extra);
+	m_y1 = m_y0 + rows + (index < extra ? 1 : 0);
+
+	m_weights = StencilWeights::Create(stencil, waveSpeed, timeStep, pointsDistance);
+	m_bandDamping = BandDamping(size, m_bandWidth, WaterSimulation::INTERIOR_DAMPING);
+	m_scratch.resize(size);
+
+	m_heights.resize(static_cast<size_t>(m_y1 - m_y0 + 2) * size);
+	m_prevHeights.resize(m_heights.size());
+}
+
+void WaterSubdomain::Disturb(int x, int y, float amount)
+{
+	x = std::clamp(x, 1, m_size - 2);
+	y = std::clamp(y, 1, m_size - 2);
+
+	if (y < m_y0 || y >= m_y1)
+		return;
+
+	Row(m_heights, y)[x] += amount;
+}
+
+void WaterSubdomain::Start()
+{
+	if (m_index > 0)
+		m_transport.Publish(m_index, HaloSide::Top, m_step, Row(m_heights, m_y0));
+	if (m_index < m_count - 1)
+		m_transport.Publish(m_index, HaloSide::Bottom, m_step, Row(m_heights, m_y1 - 1));
+
+	if (m_index > 0)
+		m_transport.Receive(m_index, HaloSide::Top, m_step, Row(m_heights, m_y0 - 1));
+	if (m_index < m_count - 1)
+		m_transport.Receive(m_index, HaloSide::Bottom, m_step, Row(m_heights, m_y1));
+}
+
+template<bool NinePoint>
+void WaterSubdomain::StepRows(int y0, int y1)
+{
+	// border rows of the whole grid stay fixed
+	y0 = std::max(y0, 1);
+	y1 = std::min(y1, m_size - 1);
+
+	for (int y = y0; y < y1; y++)
+	{
+		const float* cur = Row(m_heights, y);
+		float* next = Row(m_prevHeights, y);
+
+		StepRow<NinePoint>(cur - m_size, cur, cur + m_size, next, m_size, y, m_bandWidth, m_bandDamping.data(),
+			WaterSimulation::INTERIOR_DAMPING, m_weights, m_scratch.data());
+	}
+}
+
+void WaterSubdomain::Step()
+{
+	const bool ninePoint = m_stencil == Stencil::NinePoint;
+	auto stepRows = [this, ninePoint](int y0, int y1) { ninePoint ? StepRows<true>(y0, y1) : StepRows<false>(y0, y1); };
+
+	const int next = m_step + 1;
+
+	// boundary rows first - neighbours can continue while the interior is computed
+	stepRows(m_y0, m_y0 + 1);
+	if (m_y1 - 1 > m_y0)
+		stepRows(m_y1 - 1, m_y1);
+
+	if (m_index > 0)
+		m_transport.Publish(m_index, HaloSide::Top, next, Row(m_prevHeights, m_y0));
+	if (m_index < m_count - 1)
+		m_transport.Publish(m_index, HaloSide::Bottom, next, Row(m_prevHeights, m_y1 - 1));
+
+	stepRows(m_y0 + 1, m_y1 - 1);
+
+	if (m_index > 0)
+		m_transport.Receive(m_index, HaloSide::Top, next, Row(m_prevHeights, m_y0 - 1));
+	if (m_index < m_count - 1)
+		m_transport.Receive(m_index, HaloSide::Bottom, next, Row(m_prevHeights, m_y1));
+
+	std::swap(m_heights, m_prevHeights);
+	m_step = next;
+}
\ No newline at end of file
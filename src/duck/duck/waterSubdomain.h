@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+
+#include "haloTransport.h"
+#include "waterSimulation.h"
+
+namespace mini::gk2
+{
+	//Horizontal strip of a large square water grid, stepped independently of the other strips,
+	//possibly in another process. Neighbouring strips exchange their boundary rows through
+	//a HaloTransport. Boundary rows are computed and published first, so the exchange
+	//overlaps with the computation of the strip's interior.
+	class WaterSubdomain
+	{
+	public:
+		//size - number of grid points along each side of the whole grid
+		//index, count - position of the strip among count strips of (nearly) equal height
+		//remaining parameters match those of WaterSimulation
+		WaterSubdomain(int size, int index, int count, float waveSpeed, float timeStep, float pointsDistance,
+			int bandWidth, Stencil stencil, HaloTransport& transport);
+
+		//Adds amount to the height of the grid point (x, y) given in whole grid coordinates,
+		//points outside of the strip are ignored. Must be called before Start.
+		void Disturb(int x, int y, float amount);
+
+		//Exchanges the initial boundary rows with the neighbouring strips
+		void Start();
+		void Step();
+
+		int firstRow() const { return m_y0; }
+		int rowCount() const { return m_y1 - m_y0; }
+		int size() const { return m_size; }
+
+		//Row y of the whole grid, y has to lie inside of the strip
+		const float* row(int y) const { return m_heights.data() + (y - m_y0 + 1) * m_size; }
+
+	private:
+		template<bool NinePoint> void StepRows(int y0, int y1);
+
+		float* Row(std::vector<float>& grid, int y) const { return grid.data() + (y - m_y0 + 1) * m_size; }
+
+		int m_size;
+		int m_index, m_count;
+		int m_y0, m_y1;	//rows of the whole grid owned by the strip
+		int m_bandWidth;
+		int m_step;
+
+		Stencil m_stencil;
+		StencilWeights m_weights;
+		std::vector<float> m_bandDamping;
+		std::vector<float> m_scratch;
+
+		HaloTransport& m_transport;
+
+		//owned rows with one halo row above and below
+		std::vector<float> m_heights;
+		std::vector<float> m_prevHeights;
+	};
+}
\ No newline at end of file